@@ -0,0 +1,665 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "audio_sink.h"
+#include "util.h"
+
+#ifdef __ANDROID__
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#endif
+
+/**
+ * 初始化环形缓冲区
+ * @param ring
+ * @param min_size 最小容量 向上取 2 的幂
+ */
+static void audio_ring_init(AudioRing* ring, unsigned int min_size) {
+    unsigned int capacity = 1;
+    while (capacity < min_size) {
+        capacity <<= 1;
+    }
+    ring->data = (uint8_t*) malloc(capacity);
+    ring->capacity = capacity;
+    ring->read_position.store(0);
+    ring->write_position.store(0);
+    ring->writer_waiting.store(false);
+    ring->flush_requested.store(false);
+    ring->is_block.store(true);
+    ring->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(ring->mutex_id, NULL);
+    ring->not_full_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(ring->not_full_condition, NULL);
+}
+
+/**
+ * 销毁环形缓冲区
+ * @param ring
+ */
+static void audio_ring_destroy(AudioRing* ring) {
+    free(ring->data);
+    ring->data = NULL;
+    pthread_mutex_destroy(ring->mutex_id);
+    pthread_cond_destroy(ring->not_full_condition);
+    free(ring->mutex_id);
+    free(ring->not_full_condition);
+}
+
+/**
+ * 已缓冲的字节数
+ * @param ring
+ * @return
+ */
+static unsigned int audio_ring_size(AudioRing* ring) {
+    return ring->write_position.load() - ring->read_position.load();
+}
+
+/**
+ * 打断写线程的等待
+ * @param ring
+ */
+static void audio_ring_break_block(AudioRing* ring) {
+    ring->is_block.store(false);
+    pthread_mutex_lock(ring->mutex_id);
+    pthread_cond_signal(ring->not_full_condition);
+    pthread_mutex_unlock(ring->mutex_id);
+}
+
+/**
+ * 写入数据 (阻塞)
+ * @param ring
+ * @param data
+ * @param size
+ */
+static void audio_ring_write(AudioRing* ring, const uint8_t* data, int size) {
+    while (size > 0) {
+        unsigned int free_size = ring->capacity - audio_ring_size(ring);
+        if (free_size == 0) {
+            // 写满了 等待读线程消耗
+            pthread_mutex_lock(ring->mutex_id);
+            ring->writer_waiting.store(true);
+            while (audio_ring_size(ring) == ring->capacity && ring->is_block) {
+                pthread_cond_wait(ring->not_full_condition, ring->mutex_id);
+            }
+            ring->writer_waiting.store(false);
+            pthread_mutex_unlock(ring->mutex_id);
+            if (!ring->is_block) {
+                return;
+            }
+            continue;
+        }
+        unsigned int write_position = ring->write_position.load(std::memory_order_relaxed);
+        unsigned int offset = write_position & (ring->capacity - 1);
+        unsigned int length = (unsigned int) size < free_size ? (unsigned int) size : free_size;
+        // 可能跨过缓冲区末尾 分两段拷贝
+        unsigned int first = length < ring->capacity - offset ? length : ring->capacity - offset;
+        memcpy(ring->data + offset, data, first);
+        memcpy(ring->data, data + first, length - first);
+        ring->write_position.store(write_position + length);
+        data += length;
+        size -= length;
+    }
+}
+
+/**
+ * 读取数据 (不阻塞) 不够的部分填充静音
+ * 只能由输出回调线程调用
+ * @param ring
+ * @param buffer
+ * @param size
+ * @return 消耗的字节数 (包括快进/快退丢弃的)
+ */
+static unsigned int audio_ring_read(AudioRing* ring, uint8_t* buffer, unsigned int size) {
+    unsigned int skipped = 0;
+    if (ring->flush_requested.exchange(false)) {
+        unsigned int write_position = ring->write_position.load();
+        skipped = write_position - ring->read_position.load();
+        ring->read_position.store(write_position);
+    }
+    unsigned int read_position = ring->read_position.load(std::memory_order_relaxed);
+    unsigned int available = ring->write_position.load(std::memory_order_acquire) - read_position;
+    unsigned int offset = read_position & (ring->capacity - 1);
+    unsigned int length = size < available ? size : available;
+    unsigned int first = length < ring->capacity - offset ? length : ring->capacity - offset;
+    memcpy(buffer, ring->data + offset, first);
+    memcpy(buffer + first, ring->data, length - first);
+    memset(buffer + length, 0, size - length);
+    ring->read_position.store(read_position + length);
+    if (skipped + length > 0 && ring->writer_waiting.load()) {
+        pthread_mutex_lock(ring->mutex_id);
+        pthread_cond_signal(ring->not_full_condition);
+        pthread_mutex_unlock(ring->mutex_id);
+    }
+    return skipped + length;
+}
+
+/**
+ * 单调时钟 (微秒)
+ * @return
+ */
+static int64_t audio_sink_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * 记录播放位置
+ * 输出线程调用 用序号保证读线程读到一致的三个值
+ * @param sink
+ * @param frames 此刻已经播放的帧数
+ * @param advance 到下次更新前最多还会播放的帧数
+ */
+static void audio_sink_set_position(AudioSink* sink, int64_t frames, int64_t advance) {
+    sink->position_sequence.fetch_add(1);
+    sink->position_frames.store(frames > 0 ? frames : 0, std::memory_order_relaxed);
+    sink->position_time.store(audio_sink_now(), std::memory_order_relaxed);
+    sink->position_advance.store(advance > 0 ? advance : 0, std::memory_order_relaxed);
+    sink->position_sequence.fetch_add(1);
+}
+
+/**
+ * 拉模式输出消耗了一段数据
+ * @param sink
+ * @param bytes 消耗的字节数
+ * @param queued_frames 已经交给设备但还没播放的帧数
+ */
+static void audio_sink_on_consume(AudioSink* sink, unsigned int bytes, int64_t queued_frames) {
+    int64_t consumed = sink->frames_consumed.fetch_add(bytes / sink->bytes_per_frame) + bytes / sink->bytes_per_frame;
+    audio_sink_set_position(sink, consumed - queued_frames, sink->period_bytes / sink->bytes_per_frame);
+}
+
+#ifdef __ANDROID__
+
+// OpenSL ES 后端
+typedef struct _OpenSLBackend {
+    SLObjectItf engine_object;
+    SLEngineItf engine;
+    SLObjectItf output_mix_object;
+    SLObjectItf player_object;
+    SLPlayItf play;
+    SLAndroidSimpleBufferQueueItf buffer_queue;
+    // 轮流送给缓冲队列的缓冲区
+    uint8_t* buffers[AUDIO_SINK_OPENSL_BUFFERS];
+    int buffer_index;
+} OpenSLBackend;
+
+/**
+ * OpenSL 缓冲队列回调
+ * 一个缓冲区播放完 从环形缓冲区拉取下一段
+ * @param buffer_queue
+ * @param context
+ */
+static void opensl_callback(SLAndroidSimpleBufferQueueItf buffer_queue, void* context) {
+    AudioSink *sink = (AudioSink*) context;
+    OpenSLBackend *backend = (OpenSLBackend*) sink->backend;
+    uint8_t *buffer = backend->buffers[backend->buffer_index];
+    backend->buffer_index = (backend->buffer_index + 1) % AUDIO_SINK_OPENSL_BUFFERS;
+    unsigned int consumed = audio_ring_read(&(sink->ring), buffer, (unsigned int) sink->period_bytes);
+    (*buffer_queue)->Enqueue(buffer_queue, buffer, (SLuint32) sink->period_bytes);
+    // 入队后所有缓冲区都在排队等待播放
+    audio_sink_on_consume(sink, consumed, AUDIO_SINK_OPENSL_BUFFERS * sink->period_bytes / sink->bytes_per_frame);
+}
+
+/**
+ * 销毁 OpenSL 对象
+ * @param backend
+ */
+static void opensl_destroy(OpenSLBackend* backend) {
+    if (backend->player_object != NULL) {
+        (*backend->player_object)->Destroy(backend->player_object);
+    }
+    if (backend->output_mix_object != NULL) {
+        (*backend->output_mix_object)->Destroy(backend->output_mix_object);
+    }
+    if (backend->engine_object != NULL) {
+        (*backend->engine_object)->Destroy(backend->engine_object);
+    }
+    for (int i = 0; i < AUDIO_SINK_OPENSL_BUFFERS; i++) {
+        free(backend->buffers[i]);
+    }
+    free(backend);
+}
+
+/**
+ * 打开 OpenSL ES 输出
+ * @param sink
+ * @return
+ */
+static int opensl_open(AudioSink* sink) {
+    OpenSLBackend *backend = (OpenSLBackend*) calloc(1, sizeof(OpenSLBackend));
+    SLresult result = slCreateEngine(&(backend->engine_object), 0, NULL, 0, NULL, NULL);
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->engine_object)->Realize(backend->engine_object, SL_BOOLEAN_FALSE);
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->engine_object)->GetInterface(backend->engine_object, SL_IID_ENGINE, &(backend->engine));
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->engine)->CreateOutputMix(backend->engine, &(backend->output_mix_object), 0, NULL, NULL);
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->output_mix_object)->Realize(backend->output_mix_object, SL_BOOLEAN_FALSE);
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        SLDataLocator_AndroidSimpleBufferQueue locator_buffer_queue = {
+                SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, AUDIO_SINK_OPENSL_BUFFERS
+        };
+        SLDataFormat_PCM format_pcm = {
+                SL_DATAFORMAT_PCM,
+                (SLuint32) sink->channels,
+                (SLuint32) sink->sample_rate * 1000,
+                SL_PCMSAMPLEFORMAT_FIXED_16,
+                SL_PCMSAMPLEFORMAT_FIXED_16,
+                (SLuint32) (sink->channels == 1 ? SL_SPEAKER_FRONT_CENTER : (SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT)),
+                SL_BYTEORDER_LITTLEENDIAN
+        };
+        SLDataSource audio_source = {&locator_buffer_queue, &format_pcm};
+        SLDataLocator_OutputMix locator_output_mix = {SL_DATALOCATOR_OUTPUTMIX, backend->output_mix_object};
+        SLDataSink audio_sink = {&locator_output_mix, NULL};
+        const SLInterfaceID ids[1] = {SL_IID_BUFFERQUEUE};
+        const SLboolean required[1] = {SL_BOOLEAN_TRUE};
+        result = (*backend->engine)->CreateAudioPlayer(backend->engine, &(backend->player_object), &audio_source, &audio_sink, 1, ids, required);
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->player_object)->Realize(backend->player_object, SL_BOOLEAN_FALSE);
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->player_object)->GetInterface(backend->player_object, SL_IID_PLAY, &(backend->play));
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->player_object)->GetInterface(backend->player_object, SL_IID_BUFFERQUEUE, &(backend->buffer_queue));
+    }
+    if (result == SL_RESULT_SUCCESS) {
+        result = (*backend->buffer_queue)->RegisterCallback(backend->buffer_queue, opensl_callback, sink);
+    }
+    if (result != SL_RESULT_SUCCESS) {
+        LOGE("Player Error : OpenSL ES open fail %d", (int) result);
+        opensl_destroy(backend);
+        return FAIL_CODE;
+    }
+    sink->backend = backend;
+    // 先送入静音缓冲 启动回调循环
+    for (int i = 0; i < AUDIO_SINK_OPENSL_BUFFERS; i++) {
+        backend->buffers[i] = (uint8_t*) calloc(1, (size_t) sink->period_bytes);
+    }
+    for (int i = 0; i < AUDIO_SINK_OPENSL_BUFFERS; i++) {
+        opensl_callback(backend->buffer_queue, sink);
+    }
+    (*backend->play)->SetPlayState(backend->play, SL_PLAYSTATE_PLAYING);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 关闭 OpenSL ES 输出
+ * @param sink
+ */
+static void opensl_close(AudioSink* sink) {
+    OpenSLBackend *backend = (OpenSLBackend*) sink->backend;
+    (*backend->play)->SetPlayState(backend->play, SL_PLAYSTATE_STOPPED);
+    opensl_destroy(backend);
+}
+
+#endif
+
+// 空输出后端
+typedef struct _NullBackend {
+    pthread_t thread_id;
+    FILE* file;
+    uint8_t* buffer;
+} NullBackend;
+
+/**
+ * 空输出线程
+ * 按实时速度拉取数据 模拟声卡消耗
+ * @param arg
+ * @return
+ */
+static void* null_sink_work(void* arg) {
+    AudioSink *sink = (AudioSink*) arg;
+    NullBackend *backend = (NullBackend*) sink->backend;
+    while (sink->is_running) {
+        unsigned int consumed = audio_ring_read(&(sink->ring), backend->buffer, (unsigned int) sink->period_bytes);
+        // 读出的这一段在接下来的一个周期内 "播放"
+        audio_sink_on_consume(sink, consumed, sink->period_bytes / sink->bytes_per_frame);
+        if (backend->file != NULL) {
+            fwrite(backend->buffer, 1, (size_t) sink->period_bytes, backend->file);
+        }
+        usleep(AUDIO_SINK_PERIOD_MS * 1000);
+    }
+    return NULL;
+}
+
+/**
+ * 打开空输出
+ * @param sink
+ * @return
+ */
+static int null_sink_open(AudioSink* sink) {
+    NullBackend *backend = (NullBackend*) calloc(1, sizeof(NullBackend));
+    if (sink->dump_path[0] != '\0') {
+        backend->file = fopen(sink->dump_path, "wb");
+        if (backend->file == NULL) {
+            LOGE("Player Error : Can not open audio dump file %s", sink->dump_path);
+        }
+    }
+    backend->buffer = (uint8_t*) malloc((size_t) sink->period_bytes);
+    sink->backend = backend;
+    pthread_create(&(backend->thread_id), NULL, null_sink_work, sink);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 关闭空输出
+ * @param sink
+ */
+static void null_sink_close(AudioSink* sink) {
+    NullBackend *backend = (NullBackend*) sink->backend;
+    pthread_join(backend->thread_id, NULL);
+    if (backend->file != NULL) {
+        fclose(backend->file);
+    }
+    free(backend->buffer);
+    free(backend);
+}
+
+// Java AudioTrack 后端
+// PCM 先攒在一块 native 内存里 满了再一次交给 Java
+// 这块内存包装成 DirectByteBuffer 只创建一次 写入时不再分配 Java 对象
+typedef struct _AudioTrackBackend {
+    uint8_t* buffer;
+    int capacity;
+    int size;
+    jobject byte_buffer;
+    jmethodID play_audio_buffer_method_id;
+    jmethodID position_method_id;
+    // 已经交给 AudioTrack 的帧数
+    int64_t sent_frames;
+} AudioTrackBackend;
+
+/**
+ * 获取当前线程的 JNIEnv
+ * @param sink
+ * @return
+ */
+static JNIEnv* audio_track_env(AudioSink* sink) {
+    JNIEnv *env = NULL;
+    sink->java_vm->GetEnv((void**) &env, JNI_VERSION_1_6);
+    return env;
+}
+
+/**
+ * 打开 Java AudioTrack 输出
+ * 调用线程需要已经 Attach 到 JVM
+ * @param sink
+ * @return
+ */
+static int audio_track_open(AudioSink* sink) {
+    JNIEnv *env = audio_track_env(sink);
+    if (env == NULL) {
+        LOGE("Player Error : Can not get current thread env");
+        return FAIL_CODE;
+    }
+    jclass player_class = env->GetObjectClass(sink->instance);
+    jmethodID create_audio_track_method_id = env->GetMethodID(player_class, "createAudioTrack", "(II)V");
+    env->CallVoidMethod(sink->instance, create_audio_track_method_id, sink->sample_rate, sink->channels);
+    jmethodID buffer_size_method_id = env->GetMethodID(player_class, "getAudioTrackBufferSize", "()I");
+    int buffer_size = env->CallIntMethod(sink->instance, buffer_size_method_id);
+    AudioTrackBackend *backend = (AudioTrackBackend*) calloc(1, sizeof(AudioTrackBackend));
+    // 按整帧对齐 至少一个回调周期
+    backend->capacity = buffer_size > sink->period_bytes ? buffer_size : sink->period_bytes;
+    backend->capacity -= backend->capacity % sink->bytes_per_frame;
+    backend->buffer = (uint8_t*) malloc((size_t) backend->capacity);
+    jobject byte_buffer = env->NewDirectByteBuffer(backend->buffer, backend->capacity);
+    backend->byte_buffer = env->NewGlobalRef(byte_buffer);
+    env->DeleteLocalRef(byte_buffer);
+    backend->play_audio_buffer_method_id = env->GetMethodID(player_class, "playAudioBuffer", "(Ljava/nio/ByteBuffer;I)V");
+    backend->position_method_id = env->GetMethodID(player_class, "getAudioTrackPosition", "()I");
+    env->DeleteLocalRef(player_class);
+    sink->backend = backend;
+    return SUCCESS_CODE;
+}
+
+/**
+ * 把攒下的数据交给 Java AudioTrack
+ * @param sink
+ * @param env
+ */
+static void audio_track_flush_buffer(AudioSink* sink, JNIEnv* env) {
+    AudioTrackBackend *backend = (AudioTrackBackend*) sink->backend;
+    if (backend->size == 0) {
+        return;
+    }
+    env->CallVoidMethod(sink->instance, backend->play_audio_buffer_method_id, backend->byte_buffer, backend->size);
+    backend->sent_frames += backend->size / sink->bytes_per_frame;
+    backend->size = 0;
+    // 写入阻塞返回时读取播放头位置 之后按时间推算 不超过已经交给 AudioTrack 的数据
+    int64_t played = env->CallIntMethod(sink->instance, backend->position_method_id);
+    audio_sink_set_position(sink, played, backend->sent_frames - played);
+}
+
+/**
+ * 写入 Java AudioTrack
+ * @param sink
+ * @param data
+ * @param size
+ */
+static void audio_track_write(AudioSink* sink, const uint8_t* data, int size) {
+    JNIEnv *env = audio_track_env(sink);
+    AudioTrackBackend *backend = (AudioTrackBackend*) sink->backend;
+    while (size > 0) {
+        int length = backend->capacity - backend->size;
+        length = size < length ? size : length;
+        memcpy(backend->buffer + backend->size, data, (size_t) length);
+        backend->size += length;
+        data += length;
+        size -= length;
+        if (backend->size == backend->capacity) {
+            audio_track_flush_buffer(sink, env);
+        }
+    }
+}
+
+/**
+ * 关闭 Java AudioTrack
+ * 先把剩下的数据写完
+ * @param sink
+ */
+static void audio_track_close(AudioSink* sink) {
+    AudioTrackBackend *backend = (AudioTrackBackend*) sink->backend;
+    JNIEnv *env = audio_track_env(sink);
+    if (env != NULL) {
+        audio_track_flush_buffer(sink, env);
+        jclass player_class = env->GetObjectClass(sink->instance);
+        jmethodID release_audio_track_method_id = env->GetMethodID(player_class, "releaseAudioTrack", "()V");
+        env->CallVoidMethod(sink->instance, release_audio_track_method_id);
+        env->DeleteLocalRef(player_class);
+        env->DeleteGlobalRef(backend->byte_buffer);
+    }
+    free(backend->buffer);
+    free(backend);
+}
+
+/**
+ * 是否从环形缓冲区拉取数据
+ * @param sink
+ * @return
+ */
+static bool audio_sink_is_pull(AudioSink* sink) {
+    return sink->type != AUDIO_SINK_AUDIO_TRACK;
+}
+
+/**
+ * 初始化音频输出
+ * @param sink
+ * @param type
+ * @param java_vm
+ * @param instance
+ */
+void audio_sink_init(AudioSink* sink, int type, JavaVM* java_vm, jobject instance) {
+#ifndef __ANDROID__
+    if (type == AUDIO_SINK_OPENSL) {
+        type = AUDIO_SINK_NULL;
+    }
+#endif
+    sink->type = type;
+    sink->sample_rate = 0;
+    sink->channels = 0;
+    sink->bytes_per_frame = 0;
+    sink->frames_per_burst = 0;
+    sink->period_bytes = 0;
+    sink->ring.data = NULL;
+    sink->is_running.store(false);
+    sink->frames_written.store(0);
+    sink->frames_consumed.store(0);
+    sink->position_sequence.store(0);
+    sink->position_frames.store(0);
+    sink->position_time.store(0);
+    sink->position_advance.store(0);
+    sink->backend = NULL;
+    sink->java_vm = java_vm;
+    sink->instance = instance;
+    sink->dump_path[0] = '\0';
+}
+
+/**
+ * 打开音频输出
+ * OpenSL ES 打开失败时回退到 AudioTrack
+ * @param sink
+ * @param sample_rate
+ * @param channels
+ * @return
+ */
+int audio_sink_open(AudioSink* sink, int sample_rate, int channels) {
+    sink->sample_rate = sample_rate;
+    sink->channels = channels;
+    sink->bytes_per_frame = channels * 2;
+    int period_frames = sample_rate * AUDIO_SINK_PERIOD_MS / 1000;
+    if (sink->frames_per_burst > 0) {
+        // 取不小于默认周期的 burst 整数倍
+        period_frames = (period_frames + sink->frames_per_burst - 1) / sink->frames_per_burst * sink->frames_per_burst;
+    }
+    sink->period_bytes = period_frames * sink->bytes_per_frame;
+    audio_ring_init(&(sink->ring), (unsigned int) (sample_rate * AUDIO_SINK_BUFFER_MS / 1000 * sink->bytes_per_frame));
+    sink->is_running.store(true);
+    audio_sink_set_position(sink, 0, 0);
+    int result = FAIL_CODE;
+#ifdef __ANDROID__
+    if (sink->type == AUDIO_SINK_OPENSL) {
+        result = opensl_open(sink);
+        if (result < 0 && sink->java_vm != NULL) {
+            LOGE("Player Log : fall back to AudioTrack");
+            sink->type = AUDIO_SINK_AUDIO_TRACK;
+        }
+    }
+#endif
+    if (sink->type == AUDIO_SINK_AUDIO_TRACK) {
+        result = audio_track_open(sink);
+    } else if (sink->type == AUDIO_SINK_NULL) {
+        result = null_sink_open(sink);
+    }
+    if (result < 0) {
+        sink->is_running.store(false);
+    }
+    return result;
+}
+
+/**
+ * 写入 PCM 数据
+ * @param sink
+ * @param data
+ * @param size
+ */
+void audio_sink_write(AudioSink* sink, const uint8_t* data, int size) {
+    if (!sink->is_running) {
+        return;
+    }
+    if (audio_sink_is_pull(sink)) {
+        audio_ring_write(&(sink->ring), data, size);
+    } else {
+        if (sink->ring.flush_requested.exchange(false)) {
+            AudioTrackBackend *backend = (AudioTrackBackend*) sink->backend;
+            sink->frames_written.fetch_sub(backend->size / sink->bytes_per_frame);
+            backend->size = 0;
+        }
+        audio_track_write(sink, data, size);
+    }
+    sink->frames_written.fetch_add(size / sink->bytes_per_frame);
+}
+
+/**
+ * 丢弃还没有播放的数据
+ * AudioTrack 只丢弃还没交给 Java 的部分 由写线程处理
+ * @param sink
+ */
+void audio_sink_flush(AudioSink* sink) {
+    if (sink->is_running) {
+        sink->ring.flush_requested.store(true);
+    }
+}
+
+/**
+ * 获取已经播放的帧数
+ * 上次更新的位置加上经过的时间 不超过输出线程给出的上限
+ * @param sink
+ * @return
+ */
+int64_t audio_sink_get_position(AudioSink* sink) {
+    int64_t frames, time, advance;
+    unsigned int sequence;
+    do {
+        sequence = sink->position_sequence.load();
+        frames = sink->position_frames.load(std::memory_order_relaxed);
+        time = sink->position_time.load(std::memory_order_relaxed);
+        advance = sink->position_advance.load(std::memory_order_relaxed);
+    } while ((sequence & 1) != 0 || sequence != sink->position_sequence.load());
+    int64_t elapsed = (audio_sink_now() - time) * sink->sample_rate / 1000000;
+    return frames + (elapsed < advance ? elapsed : advance);
+}
+
+/**
+ * 获取输出延迟
+ * @param sink
+ * @return
+ */
+double audio_sink_get_delay(AudioSink* sink) {
+    if (!sink->is_running || sink->sample_rate <= 0) {
+        return 0;
+    }
+    int64_t buffered = sink->frames_written.load() - audio_sink_get_position(sink);
+    return buffered > 0 ? (double) buffered / sink->sample_rate : 0;
+}
+
+/**
+ * 关闭音频输出
+ * @param sink
+ */
+void audio_sink_close(AudioSink* sink) {
+    if (!sink->is_running) {
+        if (sink->ring.data != NULL) {
+            audio_ring_destroy(&(sink->ring));
+        }
+        return;
+    }
+    if (audio_sink_is_pull(sink)) {
+        // 等待缓冲的数据播放完 最多等缓冲区时长的两倍
+        for (int i = 0; i < 2 * AUDIO_SINK_BUFFER_MS / AUDIO_SINK_PERIOD_MS && audio_ring_size(&(sink->ring)) > 0; i++) {
+            usleep(AUDIO_SINK_PERIOD_MS * 1000);
+        }
+        audio_ring_break_block(&(sink->ring));
+    }
+    sink->is_running.store(false);
+#ifdef __ANDROID__
+    if (sink->type == AUDIO_SINK_OPENSL) {
+        opensl_close(sink);
+    }
+#endif
+    if (sink->type == AUDIO_SINK_AUDIO_TRACK) {
+        audio_track_close(sink);
+    } else if (sink->type == AUDIO_SINK_NULL) {
+        null_sink_close(sink);
+    }
+    sink->backend = NULL;
+    audio_ring_destroy(&(sink->ring));
+}
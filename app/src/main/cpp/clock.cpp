@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <math.h>
+#include "clock.h"
+
+extern "C" {
+#include "libavutil/time.h"
+#include "libavutil/common.h"
+}
+
+/**
+ * 单调时钟 (秒)
+ * @return
+ */
+double clock_now() {
+    return av_gettime_relative() / 1000000.0;
+}
+
+/**
+ * 初始化时钟
+ * @param clock
+ * @param queue_serial
+ */
+void clock_init(Clock* clock, std::atomic<int>* queue_serial) {
+    clock->speed = 1.0;
+    clock->queue_serial = queue_serial;
+    clock->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(clock->mutex_id, NULL);
+    clock_set(clock, NAN, -1);
+}
+
+/**
+ * 获取时钟当前值
+ * @param clock
+ * @return
+ */
+double clock_get(Clock* clock) {
+    pthread_mutex_lock(clock->mutex_id);
+    if (clock->queue_serial != NULL && clock->queue_serial->load() != clock->serial) {
+        pthread_mutex_unlock(clock->mutex_id);
+        return NAN;
+    }
+    double time = clock_now();
+    double value = clock->pts_drift + time - (time - clock->last_updated) * (1.0 - clock->speed);
+    pthread_mutex_unlock(clock->mutex_id);
+    return value;
+}
+
+/**
+ * 按指定时刻设置时钟
+ * @param clock
+ * @param pts
+ * @param serial
+ * @param time
+ */
+void clock_set_at(Clock* clock, double pts, int serial, double time) {
+    pthread_mutex_lock(clock->mutex_id);
+    clock->pts = pts;
+    clock->last_updated = time;
+    clock->pts_drift = pts - time;
+    clock->serial = serial;
+    pthread_mutex_unlock(clock->mutex_id);
+}
+
+/**
+ * 设置时钟
+ * @param clock
+ * @param pts
+ * @param serial
+ */
+void clock_set(Clock* clock, double pts, int serial) {
+    clock_set_at(clock, pts, serial, clock_now());
+}
+
+/**
+ * 把时钟同步到另一个时钟
+ * @param clock
+ * @param slave
+ */
+void clock_sync_to_slave(Clock* clock, Clock* slave) {
+    double value = clock_get(clock);
+    double slave_value = clock_get(slave);
+    if (!isnan(slave_value) && (isnan(value) || fabs(value - slave_value) > AV_NOSYNC_THRESHOLD)) {
+        clock_set(clock, slave_value, slave->serial);
+    }
+}
+
+/**
+ * 计算显示间隔
+ * @param delay
+ * @param diff
+ * @return
+ */
+double clock_compute_delay(double delay, double diff) {
+    if (isnan(diff) || fabs(diff) >= AV_NOSYNC_THRESHOLD) {
+        return delay;
+    }
+    // 阈值跟着帧间隔走 但限制在 [MIN, MAX] 之间
+    double sync_threshold = FFMAX(AV_SYNC_THRESHOLD_MIN, FFMIN(AV_SYNC_THRESHOLD_MAX, delay));
+    if (diff <= -sync_threshold) {
+        delay = FFMAX(0, delay + diff);
+    } else if (diff >= sync_threshold && delay > AV_SYNC_FRAMEDUP_THRESHOLD) {
+        delay = delay + diff;
+    } else if (diff >= sync_threshold) {
+        delay = 2 * delay;
+    }
+    return delay;
+}
+
+/**
+ * 销毁时钟
+ * @param clock
+ */
+void clock_destroy(Clock* clock) {
+    pthread_mutex_destroy(clock->mutex_id);
+    free(clock->mutex_id);
+}
@@ -0,0 +1,621 @@
+#include <math.h>
+#include "color_convert.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/cpu.h"
+#include "libavutil/pixfmt.h"
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COLOR_CONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define COLOR_CONVERT_SSE2
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__GNUC__)
+// AVX2 不是 x86 ABI 的必选指令 按函数开启 运行时检查 CPU
+#include <immintrin.h>
+#define COLOR_CONVERT_AVX2
+#endif
+#endif
+
+// 输入放大的位数 使 Q15 乘法的结果保留 COLOR_FRACTION_BITS 位小数
+#define Y_INPUT_SHIFT (15 + COLOR_FRACTION_BITS - COLOR_Y_COEFFICIENT_BITS)
+#define C_INPUT_SHIFT (15 + COLOR_FRACTION_BITS - COLOR_C_COEFFICIENT_BITS)
+
+// 一行的色度数据
+// 平面格式 step 为 1 半平面格式 (NV12 / NV21) step 为 2
+typedef struct _ChromaRow {
+    const uint8_t* u;
+    const uint8_t* v;
+    int step;
+} ChromaRow;
+
+/**
+ * 限制到 0 ~ 255
+ * @param value
+ * @return
+ */
+static inline uint8_t clamp_to_byte(int value) {
+    return (uint8_t) (value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/**
+ * 限制到 int16 范围 对应 SIMD 的饱和加减
+ * @param value
+ * @return
+ */
+static inline int clamp_to_int16(int value) {
+    return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+/**
+ * Q15 取整乘法 结果和 pmulhrsw / vqrdmulh 一致
+ * @param value
+ * @param coefficient
+ * @return
+ */
+static inline int multiply_round(int value, int coefficient) {
+    return (value * coefficient + (1 << 14)) >> 15;
+}
+
+/**
+ * 定点结果转换到 8 位
+ * @param value
+ * @return
+ */
+static inline uint8_t to_byte(int value) {
+    return clamp_to_byte((value + (1 << (COLOR_FRACTION_BITS - 1))) >> COLOR_FRACTION_BITS);
+}
+
+/**
+ * 标量转换 处理 SIMD 剩下的像素
+ * 每一步运算和 SIMD 相同 输出逐字节一致
+ * @param converter
+ * @param y_row
+ * @param chroma
+ * @param dst
+ * @param start
+ * @param width
+ */
+static void convert_row_scalar(ColorConverter* converter, const uint8_t* y_row, ChromaRow* chroma, uint8_t* dst, int start, int width) {
+    for (int x = start; x < width; x++) {
+        int y = multiply_round((y_row[x] - converter->y_offset) * (1 << Y_INPUT_SHIFT), converter->y_coefficient);
+        int u = (chroma->u[(x >> 1) * chroma->step] - 128) * (1 << C_INPUT_SHIFT);
+        int v = (chroma->v[(x >> 1) * chroma->step] - 128) * (1 << C_INPUT_SHIFT);
+        int r = multiply_round(v, converter->r_v);
+        int g = multiply_round(u, converter->g_u) + multiply_round(v, converter->g_v);
+        int b = multiply_round(u, converter->b_u);
+        uint8_t *pixel = dst + x * 4;
+        pixel[0] = to_byte(clamp_to_int16(y + r));
+        pixel[1] = to_byte(clamp_to_int16(y - g));
+        pixel[2] = to_byte(clamp_to_int16(y + b));
+        pixel[3] = 255;
+    }
+}
+
+#if defined(COLOR_CONVERT_NEON)
+
+/**
+ * NEON 转换一行 每次 16 个像素
+ * @return 已经处理的像素数
+ */
+static int convert_row_neon(ColorConverter* converter, const uint8_t* y_row, ChromaRow* chroma, uint8_t* dst, int width) {
+    const int16x8_t y_offset = vdupq_n_s16(converter->y_offset);
+    const int16x8_t y_coefficient = vdupq_n_s16(converter->y_coefficient);
+    const int16x8_t r_v = vdupq_n_s16(converter->r_v);
+    const int16x8_t g_u = vdupq_n_s16(converter->g_u);
+    const int16x8_t g_v = vdupq_n_s16(converter->g_v);
+    const int16x8_t b_u = vdupq_n_s16(converter->b_u);
+    const int16x8_t chroma_offset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t u8, v8;
+        if (chroma->step == 1) {
+            u8 = vld1_u8(chroma->u + x / 2);
+            v8 = vld1_u8(chroma->v + x / 2);
+        } else {
+            // 半平面格式用解交织加载分离 U V
+            uint8x8x2_t uv = vld2_u8((chroma->u < chroma->v ? chroma->u : chroma->v) + x);
+            u8 = chroma->u < chroma->v ? uv.val[0] : uv.val[1];
+            v8 = chroma->u < chroma->v ? uv.val[1] : uv.val[0];
+        }
+        int16x8_t u = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), chroma_offset), C_INPUT_SHIFT);
+        int16x8_t v = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), chroma_offset), C_INPUT_SHIFT);
+        // 色度分量 每个值对应两个像素
+        int16x8_t r_value = vqrdmulhq_s16(v, r_v);
+        int16x8_t g_value = vaddq_s16(vqrdmulhq_s16(u, g_u), vqrdmulhq_s16(v, g_v));
+        int16x8_t b_value = vqrdmulhq_s16(u, b_u);
+        int16x8x2_t r_term = vzipq_s16(r_value, r_value);
+        int16x8x2_t g_term = vzipq_s16(g_value, g_value);
+        int16x8x2_t b_term = vzipq_s16(b_value, b_value);
+        uint8x16_t y8 = vld1q_u8(y_row + x);
+        int16x8_t y_low = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8))), y_offset), Y_INPUT_SHIFT);
+        int16x8_t y_high = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8))), y_offset), Y_INPUT_SHIFT);
+        y_low = vqrdmulhq_s16(y_low, y_coefficient);
+        y_high = vqrdmulhq_s16(y_high, y_coefficient);
+        uint8x16x4_t rgba;
+        rgba.val[0] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(y_low, r_term.val[0]), COLOR_FRACTION_BITS),
+                                  vqrshrun_n_s16(vqaddq_s16(y_high, r_term.val[1]), COLOR_FRACTION_BITS));
+        rgba.val[1] = vcombine_u8(vqrshrun_n_s16(vqsubq_s16(y_low, g_term.val[0]), COLOR_FRACTION_BITS),
+                                  vqrshrun_n_s16(vqsubq_s16(y_high, g_term.val[1]), COLOR_FRACTION_BITS));
+        rgba.val[2] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(y_low, b_term.val[0]), COLOR_FRACTION_BITS),
+                                  vqrshrun_n_s16(vqaddq_s16(y_high, b_term.val[1]), COLOR_FRACTION_BITS));
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    return x;
+}
+
+#endif
+
+#if defined(COLOR_CONVERT_SSE2)
+
+/**
+ * Q15 取整乘法
+ * x86 ABI 保证 SSSE3 时直接用 pmulhrsw 否则用 32 位乘法得到相同结果
+ * @param a
+ * @param b
+ * @return
+ */
+static inline __m128i multiply_round_sse2(__m128i a, __m128i b) {
+#if defined(__SSSE3__)
+    return _mm_mulhrs_epi16(a, b);
+#else
+    const __m128i round = _mm_set1_epi32(1 << 14);
+    __m128i low = _mm_mullo_epi16(a, b);
+    __m128i high = _mm_mulhi_epi16(a, b);
+    __m128i result_low = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(low, high), round), 15);
+    __m128i result_high = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(low, high), round), 15);
+    return _mm_packs_epi32(result_low, result_high);
+#endif
+}
+
+/**
+ * 加载 8 个色度值并扩展到 16 位
+ * @param chroma
+ * @param plane
+ * @param x
+ * @return
+ */
+static inline __m128i load_chroma(ChromaRow* chroma, const uint8_t* plane, int x) {
+    if (chroma->step == 1) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (plane + x / 2)), _mm_setzero_si128());
+    }
+    // 半平面格式 取交织数据中的偶数字节
+    return _mm_and_si128(_mm_loadu_si128((const __m128i *) (plane + x)), _mm_set1_epi16(0x00FF));
+}
+
+/**
+ * 定点结果转换到 8 位
+ * @param low
+ * @param high
+ * @return
+ */
+static inline __m128i pack_channel(__m128i low, __m128i high) {
+    const __m128i round = _mm_set1_epi16(1 << (COLOR_FRACTION_BITS - 1));
+    low = _mm_srai_epi16(_mm_adds_epi16(low, round), COLOR_FRACTION_BITS);
+    high = _mm_srai_epi16(_mm_adds_epi16(high, round), COLOR_FRACTION_BITS);
+    return _mm_packus_epi16(low, high);
+}
+
+/**
+ * SSE2 转换一行 每次 16 个像素
+ * @return 已经处理的像素数
+ */
+static int convert_row_sse2(ColorConverter* converter, const uint8_t* y_row, ChromaRow* chroma, uint8_t* dst, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(converter->y_offset);
+    const __m128i y_coefficient = _mm_set1_epi16(converter->y_coefficient);
+    const __m128i r_v = _mm_set1_epi16(converter->r_v);
+    const __m128i g_u = _mm_set1_epi16(converter->g_u);
+    const __m128i g_v = _mm_set1_epi16(converter->g_v);
+    const __m128i b_u = _mm_set1_epi16(converter->b_u);
+    const __m128i chroma_offset = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi8((char) 0xFF);
+    int x = 0;
+    // 半平面格式一次读取 16 字节色度 要保证不越界
+    int limit = chroma->step == 1 ? width : width - 1;
+    for (; x + 16 <= limit; x += 16) {
+        __m128i u = _mm_slli_epi16(_mm_sub_epi16(load_chroma(chroma, chroma->u, x), chroma_offset), C_INPUT_SHIFT);
+        __m128i v = _mm_slli_epi16(_mm_sub_epi16(load_chroma(chroma, chroma->v, x), chroma_offset), C_INPUT_SHIFT);
+        __m128i r_value = multiply_round_sse2(v, r_v);
+        __m128i g_value = _mm_add_epi16(multiply_round_sse2(u, g_u), multiply_round_sse2(v, g_v));
+        __m128i b_value = multiply_round_sse2(u, b_u);
+        __m128i y8 = _mm_loadu_si128((const __m128i *) (y_row + x));
+        __m128i y_low = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), y_offset), Y_INPUT_SHIFT);
+        __m128i y_high = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), y_offset), Y_INPUT_SHIFT);
+        y_low = multiply_round_sse2(y_low, y_coefficient);
+        y_high = multiply_round_sse2(y_high, y_coefficient);
+        // 色度分量 每个值对应两个像素
+        __m128i r = pack_channel(_mm_adds_epi16(y_low, _mm_unpacklo_epi16(r_value, r_value)),
+                                 _mm_adds_epi16(y_high, _mm_unpackhi_epi16(r_value, r_value)));
+        __m128i g = pack_channel(_mm_subs_epi16(y_low, _mm_unpacklo_epi16(g_value, g_value)),
+                                 _mm_subs_epi16(y_high, _mm_unpackhi_epi16(g_value, g_value)));
+        __m128i b = pack_channel(_mm_adds_epi16(y_low, _mm_unpacklo_epi16(b_value, b_value)),
+                                 _mm_adds_epi16(y_high, _mm_unpackhi_epi16(b_value, b_value)));
+        // 交织成 RGBA
+        __m128i rg_low = _mm_unpacklo_epi8(r, g);
+        __m128i rg_high = _mm_unpackhi_epi8(r, g);
+        __m128i ba_low = _mm_unpacklo_epi8(b, alpha);
+        __m128i ba_high = _mm_unpackhi_epi8(b, alpha);
+        __m128i *out = (__m128i *) (dst + x * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_high, ba_high));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_high, ba_high));
+    }
+    return x;
+}
+
+#endif
+
+#if defined(COLOR_CONVERT_AVX2)
+
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+
+/**
+ * 加载 16 个色度值并扩展到 16 位
+ * @param chroma
+ * @param plane
+ * @param x
+ * @return
+ */
+static inline AVX2_FUNCTION __m256i load_chroma_avx2(ChromaRow* chroma, const uint8_t* plane, int x) {
+    if (chroma->step == 1) {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (plane + x / 2)));
+    }
+    return _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (plane + x)), _mm256_set1_epi16(0x00FF));
+}
+
+/**
+ * 定点结果转换到 8 位 输出按像素顺序排列
+ * @param low 前 16 个像素
+ * @param high 后 16 个像素
+ * @return
+ */
+static inline AVX2_FUNCTION __m256i pack_channel_avx2(__m256i low, __m256i high) {
+    const __m256i round = _mm256_set1_epi16(1 << (COLOR_FRACTION_BITS - 1));
+    low = _mm256_srai_epi16(_mm256_adds_epi16(low, round), COLOR_FRACTION_BITS);
+    high = _mm256_srai_epi16(_mm256_adds_epi16(high, round), COLOR_FRACTION_BITS);
+    // packus 按 128 位分别打包 再把 64 位块换回顺序
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+}
+
+/**
+ * AVX2 转换一行 每次 32 个像素
+ * @return 已经处理的像素数
+ */
+static AVX2_FUNCTION int convert_row_avx2(ColorConverter* converter, const uint8_t* y_row, ChromaRow* chroma, uint8_t* dst, int width) {
+    const __m256i y_offset = _mm256_set1_epi16(converter->y_offset);
+    const __m256i y_coefficient = _mm256_set1_epi16(converter->y_coefficient);
+    const __m256i r_v = _mm256_set1_epi16(converter->r_v);
+    const __m256i g_u = _mm256_set1_epi16(converter->g_u);
+    const __m256i g_v = _mm256_set1_epi16(converter->g_v);
+    const __m256i b_u = _mm256_set1_epi16(converter->b_u);
+    const __m256i chroma_offset = _mm256_set1_epi16(128);
+    const __m256i alpha = _mm256_set1_epi8((char) 0xFF);
+    int x = 0;
+    // 半平面格式一次读取 32 字节色度 要保证不越界
+    int limit = chroma->step == 1 ? width : width - 1;
+    for (; x + 32 <= limit; x += 32) {
+        __m256i u = _mm256_slli_epi16(_mm256_sub_epi16(load_chroma_avx2(chroma, chroma->u, x), chroma_offset), C_INPUT_SHIFT);
+        __m256i v = _mm256_slli_epi16(_mm256_sub_epi16(load_chroma_avx2(chroma, chroma->v, x), chroma_offset), C_INPUT_SHIFT);
+        __m256i r_value = _mm256_mulhrs_epi16(v, r_v);
+        __m256i g_value = _mm256_add_epi16(_mm256_mulhrs_epi16(u, g_u), _mm256_mulhrs_epi16(v, g_v));
+        __m256i b_value = _mm256_mulhrs_epi16(u, b_u);
+        // 色度分量 每个值对应两个像素 unpack 在 128 位内进行 需要再交换一次
+        __m256i r_low = _mm256_unpacklo_epi16(r_value, r_value);
+        __m256i r_high = _mm256_unpackhi_epi16(r_value, r_value);
+        __m256i g_low = _mm256_unpacklo_epi16(g_value, g_value);
+        __m256i g_high = _mm256_unpackhi_epi16(g_value, g_value);
+        __m256i b_low = _mm256_unpacklo_epi16(b_value, b_value);
+        __m256i b_high = _mm256_unpackhi_epi16(b_value, b_value);
+        __m256i r_first = _mm256_permute2x128_si256(r_low, r_high, 0x20);
+        __m256i r_second = _mm256_permute2x128_si256(r_low, r_high, 0x31);
+        __m256i g_first = _mm256_permute2x128_si256(g_low, g_high, 0x20);
+        __m256i g_second = _mm256_permute2x128_si256(g_low, g_high, 0x31);
+        __m256i b_first = _mm256_permute2x128_si256(b_low, b_high, 0x20);
+        __m256i b_second = _mm256_permute2x128_si256(b_low, b_high, 0x31);
+        __m256i y_first = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (y_row + x)));
+        __m256i y_second = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (y_row + x + 16)));
+        y_first = _mm256_mulhrs_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y_first, y_offset), Y_INPUT_SHIFT), y_coefficient);
+        y_second = _mm256_mulhrs_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y_second, y_offset), Y_INPUT_SHIFT), y_coefficient);
+        __m256i r = pack_channel_avx2(_mm256_adds_epi16(y_first, r_first), _mm256_adds_epi16(y_second, r_second));
+        __m256i g = pack_channel_avx2(_mm256_subs_epi16(y_first, g_first), _mm256_subs_epi16(y_second, g_second));
+        __m256i b = pack_channel_avx2(_mm256_adds_epi16(y_first, b_first), _mm256_adds_epi16(y_second, b_second));
+        // 交织成 RGBA 同样在 128 位内进行 最后按像素顺序写出
+        __m256i rg_low = _mm256_unpacklo_epi8(r, g);
+        __m256i rg_high = _mm256_unpackhi_epi8(r, g);
+        __m256i ba_low = _mm256_unpacklo_epi8(b, alpha);
+        __m256i ba_high = _mm256_unpackhi_epi8(b, alpha);
+        __m256i rgba0 = _mm256_unpacklo_epi16(rg_low, ba_low);
+        __m256i rgba1 = _mm256_unpackhi_epi16(rg_low, ba_low);
+        __m256i rgba2 = _mm256_unpacklo_epi16(rg_high, ba_high);
+        __m256i rgba3 = _mm256_unpackhi_epi16(rg_high, ba_high);
+        __m256i *out = (__m256i *) (dst + x * 4);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(rgba0, rgba1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(rgba2, rgba3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(rgba0, rgba1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(rgba2, rgba3, 0x31));
+    }
+    return x;
+}
+
+#endif
+
+/**
+ * 按选中的指令集转换一行
+ * @return 已经处理的像素数
+ */
+static int convert_row_simd(ColorConverter* converter, const uint8_t* y_row, ChromaRow* chroma, uint8_t* dst, int width) {
+    switch (converter->simd) {
+#if defined(COLOR_CONVERT_NEON)
+        case COLOR_SIMD_NEON:
+            return convert_row_neon(converter, y_row, chroma, dst, width);
+#endif
+#if defined(COLOR_CONVERT_AVX2)
+        case COLOR_SIMD_AVX2:
+            return convert_row_avx2(converter, y_row, chroma, dst, width);
+#endif
+#if defined(COLOR_CONVERT_SSE2)
+        case COLOR_SIMD_SSE2:
+            return convert_row_sse2(converter, y_row, chroma, dst, width);
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * 按 CPU 支持的指令集选择 SIMD 实现
+ * @return COLOR_SIMD_*
+ */
+static int select_simd() {
+    int flags = av_get_cpu_flags();
+#if defined(COLOR_CONVERT_NEON)
+    if (flags & AV_CPU_FLAG_NEON) {
+        return COLOR_SIMD_NEON;
+    }
+#endif
+#if defined(COLOR_CONVERT_AVX2)
+    if (flags & AV_CPU_FLAG_AVX2) {
+        return COLOR_SIMD_AVX2;
+    }
+#endif
+#if defined(COLOR_CONVERT_SSE2)
+    if (flags & AV_CPU_FLAG_SSE2) {
+        return COLOR_SIMD_SSE2;
+    }
+#endif
+    return COLOR_SIMD_NONE;
+}
+
+/**
+ * 转换 [y_start, y_end) 的行
+ * @param converter
+ * @param frame
+ * @param dst
+ * @param dst_linesize
+ * @param y_start
+ * @param y_end
+ */
+static void convert_rows(ColorConverter* converter, AVFrame* frame, uint8_t* dst, int dst_linesize, int y_start, int y_end) {
+    ChromaRow chroma;
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t *y_row = frame->data[0] + y * frame->linesize[0];
+        if (frame->format == AV_PIX_FMT_NV12 || frame->format == AV_PIX_FMT_NV21) {
+            const uint8_t *uv_row = frame->data[1] + (y >> 1) * frame->linesize[1];
+            chroma.u = frame->format == AV_PIX_FMT_NV12 ? uv_row : uv_row + 1;
+            chroma.v = frame->format == AV_PIX_FMT_NV12 ? uv_row + 1 : uv_row;
+            chroma.step = 2;
+        } else {
+            chroma.u = frame->data[1] + (y >> 1) * frame->linesize[1];
+            chroma.v = frame->data[2] + (y >> 1) * frame->linesize[2];
+            chroma.step = 1;
+        }
+        uint8_t *dst_row = dst + y * dst_linesize;
+        int done = convert_row_simd(converter, y_row, &chroma, dst_row, frame->width);
+        convert_row_scalar(converter, y_row, &chroma, dst_row, done, frame->width);
+    }
+}
+
+/**
+ * 分片转换任务
+ * @param arg
+ */
+static void convert_slice_task(void* arg) {
+    ConvertSlice *slice = (ConvertSlice*) arg;
+    convert_rows(slice->converter, slice->frame, slice->dst, slice->dst_linesize, slice->y_start, slice->y_end);
+}
+
+/**
+ * 是否支持 SIMD 转换
+ * 只处理 BT.601 / BT.709 的 8 位 4:2:0 数据 BT.2020 等其他矩阵交给 swscale
+ * @param frame
+ * @return
+ */
+static bool is_simd_frame(AVFrame* frame) {
+    bool format = frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P ||
+                  frame->format == AV_PIX_FMT_NV12 || frame->format == AV_PIX_FMT_NV21;
+    bool colorspace = frame->colorspace == AVCOL_SPC_BT709 || frame->colorspace == AVCOL_SPC_BT470BG ||
+                      frame->colorspace == AVCOL_SPC_SMPTE170M || frame->colorspace == AVCOL_SPC_UNSPECIFIED;
+    return format && colorspace;
+}
+
+/**
+ * 帧使用的颜色矩阵
+ * @param frame
+ * @return AVCOL_SPC_*
+ */
+static int frame_colorspace(AVFrame* frame) {
+    if (frame->colorspace == AVCOL_SPC_UNSPECIFIED) {
+        // 没有标注时按分辨率推断 高清内容一般是 BT.709
+        return frame->height >= 720 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG;
+    }
+    return frame->colorspace;
+}
+
+/**
+ * 按帧属性计算定点系数
+ * @param converter
+ * @param frame
+ */
+static void update_coefficients(ColorConverter* converter, AVFrame* frame) {
+    int matrix = frame_colorspace(frame) == AVCOL_SPC_BT709 ? COLOR_MATRIX_BT709 : COLOR_MATRIX_BT601;
+    bool full_range = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P;
+    if (converter->format == frame->format && converter->matrix == matrix && converter->full_range == full_range) {
+        return;
+    }
+    converter->format = frame->format;
+    converter->matrix = matrix;
+    converter->full_range = full_range;
+    double kr = matrix == COLOR_MATRIX_BT709 ? 0.2126 : 0.299;
+    double kb = matrix == COLOR_MATRIX_BT709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+    double c_scale = (full_range ? 1.0 : 255.0 / 224.0) * (1 << COLOR_C_COEFFICIENT_BITS);
+    converter->y_offset = (int16_t) (full_range ? 0 : 16);
+    converter->y_coefficient = (int16_t) lrint(y_scale * (1 << COLOR_Y_COEFFICIENT_BITS));
+    converter->r_v = (int16_t) lrint(2.0 * (1.0 - kr) * c_scale);
+    converter->g_u = (int16_t) lrint(2.0 * kb * (1.0 - kb) / kg * c_scale);
+    converter->g_v = (int16_t) lrint(2.0 * kr * (1.0 - kr) / kg * c_scale);
+    converter->b_u = (int16_t) lrint(2.0 * (1.0 - kb) * c_scale);
+}
+
+/**
+ * 把帧的颜色矩阵和范围设置到 swscale
+ * swscale 默认按 BT.601 转换 不设置时 BT.709 / BT.2020 的颜色会偏
+ * @param converter
+ * @param frame
+ */
+static void update_sws_colorspace(ColorConverter* converter, AVFrame* frame) {
+    int colorspace = frame_colorspace(frame);
+    int range = frame->color_range;
+    if (converter->sws_colorspace == colorspace && converter->sws_range == range) {
+        return;
+    }
+    int *inv_table, *table;
+    int src_range, dst_range, brightness, contrast, saturation;
+    if (sws_getColorspaceDetails(converter->sws_context, &inv_table, &src_range, &table, &dst_range,
+                                 &brightness, &contrast, &saturation) < 0) {
+        return;
+    }
+    // 没有标注范围时保留 swscale 按像素格式判断的结果 (YUVJ 为全范围)
+    if (range != AVCOL_RANGE_UNSPECIFIED) {
+        src_range = range == AVCOL_RANGE_JPEG ? 1 : 0;
+    }
+    sws_setColorspaceDetails(converter->sws_context, sws_getCoefficients(colorspace), src_range,
+                             table, dst_range, brightness, contrast, saturation);
+    converter->sws_colorspace = colorspace;
+    converter->sws_range = range;
+}
+
+/**
+ * 初始化颜色转换器
+ * @param converter
+ */
+void color_converter_init(ColorConverter* converter) {
+    converter->format = AV_PIX_FMT_NONE;
+    converter->matrix = -1;
+    converter->full_range = false;
+    converter->simd = select_simd();
+    converter->sws_context = NULL;
+    converter->sws_colorspace = -1;
+    converter->sws_range = -1;
+    converter->pool = NULL;
+    converter->slice_count = 1;
+    converter->priority = THREAD_POOL_PRIORITY_NORMAL;
+    task_group_init(&(converter->group));
+}
+
+/**
+ * 设置并行转换的线程池
+ * @param converter
+ * @param pool
+ * @param slice_count
+ * @param priority
+ */
+void color_converter_set_pool(ColorConverter* converter, ThreadPool* pool, int slice_count, int priority) {
+    converter->pool = pool;
+    converter->priority = priority;
+    converter->slice_count = FFMAX(1, FFMIN(slice_count, COLOR_CONVERT_MAX_SLICES));
+}
+
+/**
+ * 转换一帧到 RGBA
+ * @param converter
+ * @param frame
+ * @param dst
+ * @param dst_linesize
+ * @param dst_width
+ * @param dst_height
+ * @return
+ */
+int color_convert(ColorConverter* converter, AVFrame* frame, uint8_t* dst, int dst_linesize, int dst_width, int dst_height) {
+    if (!is_simd_frame(frame) || frame->width != dst_width || frame->height != dst_height) {
+        struct SwsContext *sws_context = sws_getCachedContext(
+                converter->sws_context,
+                frame->width, frame->height, (AVPixelFormat) frame->format,
+                dst_width, dst_height, AV_PIX_FMT_RGBA,
+                SWS_BICUBIC, NULL, NULL, NULL);
+        if (sws_context == NULL) {
+            converter->sws_context = NULL;
+            return FAIL_CODE;
+        }
+        if (sws_context != converter->sws_context) {
+            // 新建的上下文需要重新设置颜色矩阵
+            converter->sws_context = sws_context;
+            converter->sws_colorspace = -1;
+            converter->sws_range = -1;
+        }
+        update_sws_colorspace(converter, frame);
+        uint8_t *dst_data[4] = {dst, NULL, NULL, NULL};
+        int dst_linesizes[4] = {dst_linesize, 0, 0, 0};
+        int result = sws_scale(
+                converter->sws_context,
+                (const uint8_t* const*) frame->data, frame->linesize,
+                0, frame->height,
+                dst_data, dst_linesizes);
+        return result > 0 ? SUCCESS_CODE : FAIL_CODE;
+    }
+    update_coefficients(converter, frame);
+    int slice_count = converter->slice_count;
+    if (converter->pool == NULL || frame->width * frame->height < COLOR_CONVERT_SLICE_MIN_PIXELS) {
+        slice_count = 1;
+    }
+    // 按偶数行切分 最后一片由调用线程自己转换
+    int slice_height = FFALIGN((frame->height + slice_count - 1) / slice_count, 2);
+    for (int i = 0; i < slice_count; i++) {
+        ConvertSlice *slice = &(converter->slices[i]);
+        slice->converter = converter;
+        slice->frame = frame;
+        slice->dst = dst;
+        slice->dst_linesize = dst_linesize;
+        slice->y_start = FFMIN(i * slice_height, frame->height);
+        slice->y_end = FFMIN(slice->y_start + slice_height, frame->height);
+        if (i < slice_count - 1) {
+            thread_pool_submit(converter->pool, convert_slice_task, slice, &(converter->group), converter->priority);
+        } else {
+            convert_slice_task(slice);
+        }
+    }
+    if (slice_count > 1) {
+        task_group_wait(&(converter->group));
+    }
+    return SUCCESS_CODE;
+}
+
+/**
+ * 销毁颜色转换器
+ * @param converter
+ */
+void color_converter_destroy(ColorConverter* converter) {
+    sws_freeContext(converter->sws_context);
+    converter->sws_context = NULL;
+    task_group_destroy(&(converter->group));
+}
@@ -0,0 +1,591 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "decoder.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/cpu.h"
+#include "libavcodec/mediacodec.h"
+}
+
+/**
+ * 去掉首尾空白
+ * @param value 会被修改
+ * @return
+ */
+static char* trim(char* value) {
+    while (isspace((unsigned char) *value)) {
+        value++;
+    }
+    char *end = value + strlen(value);
+    while (end > value && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return value;
+}
+
+/**
+ * 解析一项覆盖配置 格式 "name=type[:count]" type 为 frame / slice / auto
+ * @param item 会被修改
+ * @param name
+ * @param thread_type
+ * @param thread_count
+ * @return 解析失败返回 false
+ */
+static bool parse_threading_override(char* item, char** name, int* thread_type, int* thread_count) {
+    char *value = strchr(item, '=');
+    if (value == NULL) {
+        return false;
+    }
+    *value++ = '\0';
+    *name = trim(item);
+    char *count = strchr(value, ':');
+    if (count != NULL) {
+        *count++ = '\0';
+        count = trim(count);
+        char *count_end;
+        long parsed = strtol(count, &count_end, 10);
+        if (*count == '\0' || *count_end != '\0' || parsed < 0 || parsed > DECODER_MAX_THREADS) {
+            return false;
+        }
+        *thread_count = (int) parsed;
+    } else {
+        *thread_count = 0;
+    }
+    value = trim(value);
+    if (strcmp(value, "frame") == 0) {
+        *thread_type = DECODER_THREAD_FRAME;
+    } else if (strcmp(value, "slice") == 0) {
+        *thread_type = DECODER_THREAD_SLICE;
+    } else if (strcmp(value, "auto") == 0) {
+        *thread_type = DECODER_THREAD_AUTO;
+    } else {
+        return false;
+    }
+    return **name != '\0';
+}
+
+/**
+ * 查找解码器的覆盖配置
+ * 逗号分隔 每项前后可以有空白 无法解析的项打印出来并忽略
+ * @param overrides
+ * @param name
+ * @param thread_type
+ * @param thread_count
+ * @return 找到返回 true
+ */
+static bool find_threading_override(const char* overrides, const char* name, int* thread_type, int* thread_count) {
+    const char *item = overrides;
+    bool found = false;
+    while (item != NULL && *item != '\0') {
+        const char *next = strchr(item, ',');
+        size_t length = next == NULL ? strlen(item) : (size_t) (next - item);
+        char buffer[64];
+        if (length >= sizeof(buffer)) {
+            LOGE("Player Error : decoder thread override too long : %.*s", (int) length, item);
+        } else {
+            memcpy(buffer, item, length);
+            buffer[length] = '\0';
+            char *item_name;
+            int item_type, item_count;
+            if (trim(buffer)[0] == '\0') {
+                // 空项 (例如末尾多一个逗号)
+            } else if (!parse_threading_override(buffer, &item_name, &item_type, &item_count)) {
+                LOGE("Player Error : invalid decoder thread override : %.*s", (int) length, item);
+            } else if (!found && strcmp(item_name, name) == 0) {
+                *thread_type = item_type;
+                *thread_count = item_count;
+                found = true;
+            }
+        }
+        item = next == NULL ? NULL : next + 1;
+    }
+    return found;
+}
+
+/**
+ * 设置解码线程
+ * @param threading
+ * @param codec_context
+ * @param codec
+ */
+void decoder_threading_apply(DecoderThreading* threading, AVCodecContext* codec_context, AVCodec* codec) {
+    int thread_type = threading->thread_type;
+    int thread_count = threading->thread_count;
+    find_threading_override(threading->overrides, codec->name, &thread_type, &thread_count);
+    if (thread_count <= 0) {
+        thread_count = FFMIN(av_cpu_count(), DECODER_MAX_THREADS);
+    }
+    bool support_frame = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+    bool support_slice = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+    if (thread_type == DECODER_THREAD_AUTO) {
+        // 帧线程吞吐最高 低延迟模式下改用不增加延迟的切片线程
+        thread_type = threading->low_latency && support_slice ? DECODER_THREAD_SLICE : DECODER_THREAD_FRAME;
+    }
+    if (thread_type == DECODER_THREAD_FRAME && !support_frame) {
+        thread_type = DECODER_THREAD_SLICE;
+    } else if (thread_type == DECODER_THREAD_SLICE && !support_slice) {
+        thread_type = DECODER_THREAD_FRAME;
+    }
+    if ((thread_type == DECODER_THREAD_FRAME && !support_frame) || (thread_type == DECODER_THREAD_SLICE && !support_slice)) {
+        // 解码器不支持多线程
+        thread_count = 1;
+    }
+    codec_context->thread_count = thread_count;
+    codec_context->thread_type = thread_type == DECODER_THREAD_FRAME ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+}
+
+/**
+ * 查找 MediaCodec 硬件解码器
+ * @param codec_id
+ * @return 不支持返回 NULL
+ */
+static AVCodec* find_hardware_decoder(AVCodecID codec_id) {
+    switch (codec_id) {
+        case AV_CODEC_ID_H264:
+            return avcodec_find_decoder_by_name("h264_mediacodec");
+        case AV_CODEC_ID_HEVC:
+            return avcodec_find_decoder_by_name("hevc_mediacodec");
+        case AV_CODEC_ID_MPEG4:
+            return avcodec_find_decoder_by_name("mpeg4_mediacodec");
+        case AV_CODEC_ID_VP8:
+            return avcodec_find_decoder_by_name("vp8_mediacodec");
+        case AV_CODEC_ID_VP9:
+            return avcodec_find_decoder_by_name("vp9_mediacodec");
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * 释放解码器上下文
+ * @param codec_context
+ */
+static void free_codec_context(AVCodecContext** codec_context) {
+    if (*codec_context == NULL) {
+        return;
+    }
+    if ((*codec_context)->hwaccel_context != NULL) {
+        av_mediacodec_default_free(*codec_context);
+    }
+    avcodec_free_context(codec_context);
+}
+
+/**
+ * 用指定的解码器打开上下文
+ * @param codec
+ * @param codecpar
+ * @param threading
+ * @param surface
+ * @return 失败返回 NULL
+ */
+static AVCodecContext* open_codec_context(AVCodec* codec, AVCodecParameters* codecpar, DecoderThreading* threading, void* surface) {
+    AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codec_context, codecpar);
+    if (threading != NULL) {
+        decoder_threading_apply(threading, codec_context, codec);
+    }
+    if (surface != NULL) {
+        AVMediaCodecContext *mediacodec_context = av_mediacodec_alloc_context();
+        if (av_mediacodec_default_init(codec_context, mediacodec_context, surface) < 0) {
+            av_free(mediacodec_context);
+            avcodec_free_context(&codec_context);
+            return NULL;
+        }
+    }
+    int result = avcodec_open2(codec_context, codec, NULL);
+    if (result < 0) {
+        print_error(result);
+        free_codec_context(&codec_context);
+        return NULL;
+    }
+    LOGE("Player Log : %s decode with %d threads, thread type %d",
+         codec->name, codec_context->thread_count, codec_context->active_thread_type);
+    return codec_context;
+}
+
+/**
+ * MediaCodec 后端 打开硬件解码器
+ * @param opaque
+ * @param codecpar
+ * @param surface
+ * @return
+ */
+static AVCodecContext* mediacodec_open(void* opaque, AVCodecParameters* codecpar, void* surface) {
+    AVCodec *codec = find_hardware_decoder(codecpar->codec_id);
+    if (codec == NULL) {
+        return NULL;
+    }
+    return open_codec_context(codec, codecpar, NULL, surface);
+}
+
+static int mediacodec_send_packet(void* opaque, AVCodecContext* codec_context, const AVPacket* packet) {
+    return avcodec_send_packet(codec_context, packet);
+}
+
+static int mediacodec_receive_frame(void* opaque, AVCodecContext* codec_context, AVFrame* frame) {
+    return avcodec_receive_frame(codec_context, frame);
+}
+
+static void mediacodec_flush(void* opaque, AVCodecContext* codec_context) {
+    avcodec_flush_buffers(codec_context);
+}
+
+static void mediacodec_close(void* opaque, AVCodecContext** codec_context) {
+    free_codec_context(codec_context);
+}
+
+// MediaCodec 后端
+static HardwareBackend mediacodec_backend = {
+    NULL,
+    mediacodec_open,
+    mediacodec_send_packet,
+    mediacodec_receive_frame,
+    mediacodec_flush,
+    mediacodec_close
+};
+
+// 当前的硬件解码后端
+static HardwareBackend* hardware_backend = &mediacodec_backend;
+
+/**
+ * 设置硬件解码后端
+ * @param backend
+ */
+void decoder_set_hardware_backend(HardwareBackend* backend) {
+    hardware_backend = backend != NULL ? backend : &mediacodec_backend;
+}
+
+/**
+ * 送入数据 硬件解码时交给后端
+ * @param decoder
+ * @param packet 为 NULL 时进入冲刷阶段
+ * @return
+ */
+static int decoder_send(Decoder* decoder, const AVPacket* packet) {
+    if (decoder->is_hardware) {
+        return decoder->backend->send_packet(decoder->backend->opaque, decoder->codec_context, packet);
+    }
+    return avcodec_send_packet(decoder->codec_context, packet);
+}
+
+/**
+ * 取出解好的帧 硬件解码时交给后端
+ * @param decoder
+ * @param frame
+ * @return
+ */
+static int decoder_receive(Decoder* decoder, AVFrame* frame) {
+    if (decoder->is_hardware) {
+        return decoder->backend->receive_frame(decoder->backend->opaque, decoder->codec_context, frame);
+    }
+    return avcodec_receive_frame(decoder->codec_context, frame);
+}
+
+/**
+ * 清空解码器内部缓存的帧
+ * @param decoder
+ */
+static void decoder_flush(Decoder* decoder) {
+    if (decoder->is_hardware) {
+        decoder->backend->flush(decoder->backend->opaque, decoder->codec_context);
+    } else {
+        avcodec_flush_buffers(decoder->codec_context);
+    }
+}
+
+/**
+ * 关闭解码器上下文
+ * @param decoder
+ */
+static void decoder_close(Decoder* decoder) {
+    if (decoder->codec_context == NULL) {
+        return;
+    }
+    if (decoder->is_hardware) {
+        decoder->backend->close(decoder->backend->opaque, &(decoder->codec_context));
+    } else {
+        free_codec_context(&(decoder->codec_context));
+    }
+    decoder->codec_context = NULL;
+}
+
+/**
+ * 把跳过解码的级别设置到解码器上下文
+ * @param decoder
+ */
+static void apply_skip_level(Decoder* decoder) {
+    AVCodecContext *codec_context = decoder->codec_context;
+    if (codec_context == NULL) {
+        return;
+    }
+    int level = decoder->skip_level;
+    if (level >= DECODER_SKIP_PREVIEW) {
+        codec_context->skip_frame = AVDISCARD_NONKEY;
+    } else {
+        codec_context->skip_frame = level >= DECODER_SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
+    codec_context->skip_loop_filter = level >= DECODER_SKIP_LOOP_FILTER ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    codec_context->skip_idct = level >= DECODER_SKIP_IDCT ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+}
+
+/**
+ * 打开软件解码器
+ * @param decoder
+ * @return
+ */
+static int open_software_decoder(Decoder* decoder) {
+    AVCodec *codec = avcodec_find_decoder(decoder->codecpar->codec_id);
+    if (codec == NULL) {
+        LOGE("Player Error : Can not find codec");
+        return FAIL_CODE;
+    }
+    decoder->codec_context = open_codec_context(codec, decoder->codecpar, decoder->threading, NULL);
+    if (decoder->codec_context == NULL) {
+        LOGE("Player Error : Can not open codec");
+        return FAIL_CODE;
+    }
+    decoder->is_hardware = false;
+    apply_skip_level(decoder);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 打开解码器
+ * @param decoder
+ * @param codecpar
+ * @param threading
+ * @param hardware
+ * @param surface
+ * @return
+ */
+int decoder_open(Decoder* decoder, AVCodecParameters* codecpar, DecoderThreading* threading, bool hardware, void* surface) {
+    decoder->codec_context = NULL;
+    decoder->queue = NULL;
+    decoder->pending_packet = NULL;
+    decoder->is_draining = false;
+    decoder->codecpar = codecpar;
+    decoder->threading = threading;
+    decoder->is_hardware = false;
+    decoder->backend = hardware_backend;
+    decoder->hardware_errors = 0;
+    decoder->wait_keyframe = false;
+    decoder->skip_level = DECODER_SKIP_NONE;
+    decoder->packet_serial = 0;
+    decoder->pending_serial = 0;
+    if (hardware) {
+        decoder->codec_context = decoder->backend->open(decoder->backend->opaque, codecpar, surface);
+        if (decoder->codec_context != NULL) {
+            decoder->is_hardware = true;
+            return SUCCESS_CODE;
+        }
+        LOGE("Player Log : hardware decoder unavailable, fall back to software");
+    }
+    return open_software_decoder(decoder);
+}
+
+/**
+ * 硬件解码出错 回退到软件解码
+ * 已经送进硬件解码器的数据丢弃 从下一个关键帧开始用软件解码
+ * @param decoder
+ * @return
+ */
+static int decoder_fallback(Decoder* decoder) {
+    LOGE("Player Log : hardware decode fail, fall back to software");
+    decoder_close(decoder);
+    if (decoder->pending_packet != NULL) {
+        packet_pool_release(decoder->queue->pool, &(decoder->pending_packet));
+    }
+    decoder->wait_keyframe = true;
+    return open_software_decoder(decoder);
+}
+
+/**
+ * 记录解码错误 硬件解码连续出错达到上限时回退到软件解码
+ * @param decoder
+ * @return 回退失败返回 FAIL_CODE
+ */
+static int decoder_on_error(Decoder* decoder) {
+    if (!decoder->is_hardware) {
+        return SUCCESS_CODE;
+    }
+    decoder->hardware_errors += 1;
+    if (decoder->hardware_errors < DECODER_MAX_HARDWARE_ERRORS) {
+        return SUCCESS_CODE;
+    }
+    return decoder_fallback(decoder);
+}
+
+/**
+ * 解码一帧
+ * @param decoder
+ * @param frame
+ * @param block 队列为空时是否等待
+ * @return 不等待并且队列暂时没有数据时返回 AVERROR(EAGAIN)
+ */
+static int decoder_decode(Decoder* decoder, AVFrame* frame, bool block) {
+    int result;
+    for (;;) {
+        // 快进/快退之后 解码器里剩下的帧已经过期 不再取出
+        if (decoder->packet_serial == decoder->queue->serial.load()) {
+            // 先把解码器里已经解好的帧取完
+            result = decoder_receive(decoder, frame);
+            if (result >= 0) {
+                decoder->hardware_errors = 0;
+                return 1;
+            }
+            if (result == AVERROR_EOF) {
+                decoder_flush(decoder);
+                return 0;
+            }
+            if (result != AVERROR(EAGAIN)) {
+                print_error(result);
+                LOGE("Player Error : codec receive frame fail");
+                if (decoder_on_error(decoder) < 0) {
+                    return 0;
+                }
+            }
+            if (decoder->is_draining) {
+                // 已经冲刷过 解码器不会再有输出
+                return 0;
+            }
+        }
+        // 解码器需要更多数据
+        AVPacket *packet = decoder->pending_packet;
+        int serial = decoder->pending_serial;
+        decoder->pending_packet = NULL;
+        if (packet == NULL && block) {
+            packet = queue_out(decoder->queue, &serial);
+        } else if (packet == NULL) {
+            bool is_end;
+            packet = queue_try_out(decoder->queue, &serial, &is_end);
+            if (packet == NULL && !is_end) {
+                return AVERROR(EAGAIN);
+            }
+        }
+        if (packet != NULL && serial != decoder->queue->serial.load()) {
+            // 快进/快退之前的数据 直接丢弃
+            packet_pool_release(decoder->queue->pool, &packet);
+            continue;
+        }
+        if (packet != NULL && serial != decoder->packet_serial) {
+            // 新序号的第一个数据 清空解码器内部缓存的帧
+            decoder_flush(decoder);
+            decoder->packet_serial = serial;
+            decoder->is_draining = false;
+        }
+        if (packet != NULL && decoder->wait_keyframe) {
+            if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+                packet_pool_release(decoder->queue->pool, &packet);
+                continue;
+            }
+            decoder->wait_keyframe = false;
+        }
+        if (packet == NULL) {
+            if (decoder->is_draining || decoder->packet_serial != decoder->queue->serial.load()) {
+                return 0;
+            }
+            // 队列结束 送入空数据进入冲刷阶段
+            decoder_send(decoder, NULL);
+            decoder->is_draining = true;
+            continue;
+        }
+        result = decoder_send(decoder, packet);
+        if (result == AVERROR(EAGAIN)) {
+            // 按照 API 约定不会出现 出现了就留到下次再送
+            LOGE("Player Error : codec receive frame and send packet both return EAGAIN");
+            decoder->pending_packet = packet;
+            decoder->pending_serial = serial;
+            continue;
+        }
+        packet_pool_release(decoder->queue->pool, &packet);
+        if (result < 0) {
+            print_error(result);
+            LOGE("Player Error : codec send packet fail");
+            if (decoder_on_error(decoder) < 0) {
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+ * 解码一帧
+ * @param decoder
+ * @param frame
+ * @return
+ */
+int decoder_decode_frame(Decoder* decoder, AVFrame* frame) {
+    return decoder_decode(decoder, frame, true);
+}
+
+/**
+ * 解码一帧 (不阻塞)
+ * @param decoder
+ * @param frame
+ * @return
+ */
+int decoder_poll_frame(Decoder* decoder, AVFrame* frame) {
+    return decoder_decode(decoder, frame, false);
+}
+
+/**
+ * 直接送入一个数据并尝试取出一帧
+ * @param decoder
+ * @param packet
+ * @param frame
+ * @return
+ */
+int decoder_decode_packet(Decoder* decoder, AVPacket* packet, AVFrame* frame) {
+    int result = decoder_send(decoder, packet);
+    if (result == AVERROR(EAGAIN)) {
+        decoder->pending_packet = packet;
+        decoder->pending_serial = decoder->packet_serial;
+    } else {
+        packet_pool_release(decoder->queue->pool, &packet);
+        if (result < 0) {
+            print_error(result);
+            LOGE("Player Error : codec send packet fail");
+            return result;
+        }
+    }
+    result = decoder_receive(decoder, frame);
+    if (result >= 0) {
+        return 1;
+    }
+    if (result == AVERROR(EAGAIN)) {
+        return 0;
+    }
+    print_error(result);
+    return result;
+}
+
+/**
+ * 设置跳过解码的级别
+ * @param decoder
+ * @param level
+ */
+void decoder_set_skip_level(Decoder* decoder, int level) {
+    if (decoder->skip_level == level) {
+        return;
+    }
+    LOGE("Player Log : decoder skip level %d -> %d", decoder->skip_level, level);
+    decoder->skip_level = level;
+    if (!decoder->is_hardware) {
+        apply_skip_level(decoder);
+    }
+}
+
+/**
+ * 销毁解码器
+ * @param decoder
+ */
+void decoder_destroy(Decoder* decoder) {
+    if (decoder->pending_packet != NULL) {
+        packet_pool_release(decoder->queue->pool, &(decoder->pending_packet));
+    }
+    decoder_close(decoder);
+}
@@ -0,0 +1,90 @@
+#include "frame_drop.h"
+#include "decoder.h"
+#include "clock.h"
+
+/**
+ * 初始化丢帧策略
+ * @param dropper
+ * @param enabled
+ */
+void frame_drop_init(FrameDropper* dropper, bool enabled) {
+    dropper->enabled = enabled;
+    dropper->window_frames = 0;
+    dropper->window_drops = 0;
+    dropper->clean_windows = 0;
+    dropper->consecutive_drops = 0;
+    dropper->skip_level.store(DECODER_SKIP_NONE);
+    dropper->decoded_frames.store(0);
+    dropper->rendered_frames.store(0);
+    dropper->dropped_frames.store(0);
+}
+
+/**
+ * 判断是否丢掉这一帧
+ * 落后超过一帧 (至少 AV_SYNC_THRESHOLD_MIN) 才丢 落后太多说明时钟不连续 不丢
+ * @param dropper
+ * @param lateness
+ * @param duration
+ * @return
+ */
+bool frame_drop_should_drop(FrameDropper* dropper, double lateness, double duration) {
+    if (!dropper->enabled || dropper->consecutive_drops >= FRAME_DROP_MAX_CONSECUTIVE) {
+        return false;
+    }
+    double threshold = duration > AV_SYNC_THRESHOLD_MIN ? duration : AV_SYNC_THRESHOLD_MIN;
+    return lateness > threshold && lateness < AV_NOSYNC_THRESHOLD;
+}
+
+/**
+ * 记录一帧的处理结果
+ * @param dropper
+ * @param dropped
+ */
+void frame_drop_on_frame(FrameDropper* dropper, bool dropped) {
+    if (dropped) {
+        dropper->dropped_frames.fetch_add(1);
+        dropper->consecutive_drops += 1;
+        dropper->window_drops += 1;
+    } else {
+        dropper->rendered_frames.fetch_add(1);
+        dropper->consecutive_drops = 0;
+    }
+    dropper->window_frames += 1;
+    if (dropper->window_frames < FRAME_DROP_WINDOW) {
+        return;
+    }
+    int level = dropper->skip_level.load();
+    if (dropper->window_drops >= FRAME_DROP_ESCALATE_DROPS) {
+        dropper->clean_windows = 0;
+        if (level < DECODER_SKIP_IDCT) {
+            dropper->skip_level.store(level + 1);
+        }
+    } else if (dropper->window_drops == 0) {
+        dropper->clean_windows += 1;
+        if (dropper->clean_windows >= FRAME_DROP_RELAX_WINDOWS && level > DECODER_SKIP_NONE) {
+            dropper->skip_level.store(level - 1);
+            dropper->clean_windows = 0;
+        }
+    } else {
+        dropper->clean_windows = 0;
+    }
+    dropper->window_frames = 0;
+    dropper->window_drops = 0;
+}
+
+/**
+ * 记录解码出一帧
+ * @param dropper
+ */
+void frame_drop_on_decoded(FrameDropper* dropper) {
+    dropper->decoded_frames.fetch_add(1);
+}
+
+/**
+ * 获取跳过解码的级别
+ * @param dropper
+ * @return
+ */
+int frame_drop_get_skip_level(FrameDropper* dropper) {
+    return dropper->enabled ? dropper->skip_level.load() : DECODER_SKIP_NONE;
+}
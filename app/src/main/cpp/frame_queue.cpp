@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include "frame_queue.h"
+
+/**
+ * 初始化帧队列
+ * @param queue
+ */
+void frame_queue_init(FrameQueue* queue) {
+    for (int i = 0; i < FRAME_QUEUE_MAX_SIZE; i++) {
+        queue->frames[i] = av_frame_alloc();
+    }
+    queue->read_index = 0;
+    queue->write_index = 0;
+    queue->size = 0;
+    queue->is_block = true;
+    queue->producer_notify = NULL;
+    queue->producer_opaque = NULL;
+    queue->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(queue->mutex_id, NULL);
+    queue->not_empty_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(queue->not_empty_condition, NULL);
+    queue->not_full_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(queue->not_full_condition, NULL);
+}
+
+/**
+ * 销毁帧队列
+ * @param queue
+ */
+void frame_queue_destroy(FrameQueue* queue) {
+    for (int i = 0; i < FRAME_QUEUE_MAX_SIZE; i++) {
+        av_frame_free(&(queue->frames[i]));
+    }
+    queue->size = 0;
+    queue->is_block = false;
+    pthread_mutex_destroy(queue->mutex_id);
+    pthread_cond_destroy(queue->not_empty_condition);
+    pthread_cond_destroy(queue->not_full_condition);
+    free(queue->mutex_id);
+    free(queue->not_empty_condition);
+    free(queue->not_full_condition);
+}
+
+/**
+ * 设置生产者的通知
+ * @param queue
+ * @param notify
+ * @param opaque
+ */
+void frame_queue_set_producer_notify(FrameQueue* queue, void (*notify)(void*), void* opaque) {
+    queue->producer_notify = notify;
+    queue->producer_opaque = opaque;
+}
+
+/**
+ * 判断是否已满
+ * @param queue
+ * @return
+ */
+bool frame_queue_is_full(FrameQueue* queue) {
+    pthread_mutex_lock(queue->mutex_id);
+    bool full = queue->size >= FRAME_QUEUE_MAX_SIZE;
+    pthread_mutex_unlock(queue->mutex_id);
+    return full;
+}
+
+/**
+ * 入队 (阻塞)
+ * @param queue
+ * @param frame
+ * @param serial
+ * @return
+ */
+bool frame_queue_in(FrameQueue* queue, AVFrame* frame, int serial) {
+    pthread_mutex_lock(queue->mutex_id);
+    while (queue->size >= FRAME_QUEUE_MAX_SIZE && queue->is_block) {
+        pthread_cond_wait(queue->not_full_condition, queue->mutex_id);
+    }
+    if (queue->size >= FRAME_QUEUE_MAX_SIZE) {
+        pthread_mutex_unlock(queue->mutex_id);
+        return false;
+    }
+    av_frame_move_ref(queue->frames[queue->write_index], frame);
+    queue->serials[queue->write_index] = serial;
+    queue->write_index = (queue->write_index + 1) % FRAME_QUEUE_MAX_SIZE;
+    queue->size += 1;
+    pthread_cond_signal(queue->not_empty_condition);
+    pthread_mutex_unlock(queue->mutex_id);
+    return true;
+}
+
+/**
+ * 出队 (阻塞)
+ * @param queue
+ * @param frame
+ * @param serial
+ * @return
+ */
+bool frame_queue_out(FrameQueue* queue, AVFrame* frame, int* serial) {
+    pthread_mutex_lock(queue->mutex_id);
+    while (queue->size == 0 && queue->is_block) {
+        pthread_cond_wait(queue->not_empty_condition, queue->mutex_id);
+    }
+    if (queue->size == 0) {
+        pthread_mutex_unlock(queue->mutex_id);
+        return false;
+    }
+    av_frame_move_ref(frame, queue->frames[queue->read_index]);
+    if (serial != NULL) {
+        *serial = queue->serials[queue->read_index];
+    }
+    queue->read_index = (queue->read_index + 1) % FRAME_QUEUE_MAX_SIZE;
+    queue->size -= 1;
+    pthread_cond_signal(queue->not_full_condition);
+    pthread_mutex_unlock(queue->mutex_id);
+    if (queue->producer_notify != NULL) {
+        queue->producer_notify(queue->producer_opaque);
+    }
+    return true;
+}
+
+/**
+ * 清空帧队列
+ * @param queue
+ */
+void frame_queue_clear(FrameQueue* queue) {
+    pthread_mutex_lock(queue->mutex_id);
+    while (queue->size > 0) {
+        av_frame_unref(queue->frames[queue->read_index]);
+        queue->read_index = (queue->read_index + 1) % FRAME_QUEUE_MAX_SIZE;
+        queue->size -= 1;
+    }
+    pthread_cond_signal(queue->not_full_condition);
+    pthread_mutex_unlock(queue->mutex_id);
+    if (queue->producer_notify != NULL) {
+        queue->producer_notify(queue->producer_opaque);
+    }
+}
+
+/**
+ * 打断阻塞
+ * @param queue
+ */
+void frame_queue_break_block(FrameQueue* queue) {
+    pthread_mutex_lock(queue->mutex_id);
+    queue->is_block = false;
+    pthread_cond_signal(queue->not_empty_condition);
+    pthread_cond_signal(queue->not_full_condition);
+    pthread_mutex_unlock(queue->mutex_id);
+}
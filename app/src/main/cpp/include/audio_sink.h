@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <jni.h>
+
+#ifndef PLAYER_AUDIO_SINK_H
+#define PLAYER_AUDIO_SINK_H
+
+// 音频输出类型 与 Java 层 Player.Options 一致
+// OPENSL 回调从环形缓冲区拉取数据 不经过 JNI
+// AUDIO_TRACK 攒够 AudioTrack 缓冲区大小的数据 再通过 JNI 调用一次 Java AudioTrack.write
+// NULL 不输出声音 按实时速度消耗数据 可以写到文件 用于没有音频设备的环境
+#define AUDIO_SINK_OPENSL 0
+#define AUDIO_SINK_AUDIO_TRACK 1
+#define AUDIO_SINK_NULL 2
+
+// 环形缓冲区时长 (毫秒)
+#define AUDIO_SINK_BUFFER_MS 200
+// 每次回调拉取的时长 (毫秒)
+#define AUDIO_SINK_PERIOD_MS 10
+// OpenSL 缓冲队列数量
+#define AUDIO_SINK_OPENSL_BUFFERS 2
+
+// PCM 环形缓冲区
+// 单生产者 (解码线程写) 单消费者 (输出回调读) 无锁
+// 只有写满时写线程才等待 回调线程永远不阻塞
+typedef struct _AudioRing {
+    uint8_t* data;
+    // 容量 (字节 2 的幂)
+    unsigned int capacity;
+    // 累计读写的字节数
+    std::atomic<unsigned int> read_position;
+    std::atomic<unsigned int> write_position;
+    // 写线程是否在等待
+    std::atomic<bool> writer_waiting;
+    // 是否需要丢弃缓冲的数据 由读线程处理
+    std::atomic<bool> flush_requested;
+    // 是否阻塞
+    std::atomic<bool> is_block;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+    // 线程条件变量
+    pthread_cond_t* not_full_condition;
+} AudioRing;
+
+// 音频输出
+// 输出格式固定为 16 位交织 PCM
+typedef struct _AudioSink {
+    // 输出类型
+    int type;
+    // 输出格式
+    int sample_rate;
+    int channels;
+    int bytes_per_frame;
+    // 每次回调的帧数 0 表示按 AUDIO_SINK_PERIOD_MS 计算
+    // 设置为设备的 frames per burst (的整数倍) 可以减少延迟
+    int frames_per_burst;
+    // 每次回调的字节数
+    int period_bytes;
+    // 拉模式 (OPENSL / NULL) 的缓冲区
+    AudioRing ring;
+    // 是否正在运行
+    std::atomic<bool> is_running;
+    // 写入的帧数和输出消耗的帧数 (拉模式)
+    std::atomic<int64_t> frames_written;
+    std::atomic<int64_t> frames_consumed;
+    // 最近一次更新的播放位置 (帧) 更新时间 (微秒) 和到下次更新前最多前进的帧数
+    // 由输出线程更新 序号为奇数表示正在更新
+    std::atomic<unsigned int> position_sequence;
+    std::atomic<int64_t> position_frames;
+    std::atomic<int64_t> position_time;
+    std::atomic<int64_t> position_advance;
+    // 后端私有数据
+    void* backend;
+    // AUDIO_TRACK 使用的 Java 对象
+    JavaVM* java_vm;
+    jobject instance;
+    // NULL 输出写入的文件 为空不写
+    char dump_path[256];
+} AudioSink;
+
+/**
+ * 初始化音频输出
+ * @param sink
+ * @param type
+ * @param java_vm AUDIO_TRACK 需要 其他可以为 NULL
+ * @param instance Java Player 实例
+ */
+void audio_sink_init(AudioSink* sink, int type, JavaVM* java_vm, jobject instance);
+
+/**
+ * 打开音频输出
+ * @param sink
+ * @param sample_rate
+ * @param channels
+ * @return 成功返回 SUCCESS_CODE
+ */
+int audio_sink_open(AudioSink* sink, int sample_rate, int channels);
+
+/**
+ * 写入 PCM 数据 (阻塞)
+ * 缓冲区满时等待输出消耗
+ * @param sink
+ * @param data
+ * @param size
+ */
+void audio_sink_write(AudioSink* sink, const uint8_t* data, int size);
+
+/**
+ * 丢弃还没有播放的数据 (快进/快退)
+ * @param sink
+ */
+void audio_sink_flush(AudioSink* sink);
+
+/**
+ * 获取已经播放的帧数
+ * 拉模式按输出回调消耗的位置 AudioTrack 按播放头位置 中间用单调时钟插值
+ * @param sink
+ * @return
+ */
+int64_t audio_sink_get_position(AudioSink* sink);
+
+/**
+ * 获取输出延迟 (秒)
+ * 已经写入但还没有播放的数据时长
+ * @param sink
+ * @return
+ */
+double audio_sink_get_delay(AudioSink* sink);
+
+/**
+ * 关闭音频输出
+ * 等待缓冲的数据播放完再停止
+ * @param sink
+ */
+void audio_sink_close(AudioSink* sink);
+
+#endif //PLAYER_AUDIO_SINK_H
@@ -0,0 +1,99 @@
+#include <pthread.h>
+#include <atomic>
+
+#ifndef PLAYER_CLOCK_H
+#define PLAYER_CLOCK_H
+
+// 主时钟类型 与 Java 层 Player.Options 一致
+#define CLOCK_MASTER_AUDIO 0
+#define CLOCK_MASTER_VIDEO 1
+#define CLOCK_MASTER_EXTERNAL 2
+
+/* no AV sync correction is done if below the minimum AV sync threshold */
+#define AV_SYNC_THRESHOLD_MIN 0.04
+/* AV sync correction is done if above the maximum AV sync threshold */
+#define AV_SYNC_THRESHOLD_MAX 0.1
+/* If a frame duration is longer than this, it will not be duplicated to compensate AV sync */
+#define AV_SYNC_FRAMEDUP_THRESHOLD 0.1
+/* no AV correction is done if too big error */
+#define AV_NOSYNC_THRESHOLD 10.0
+
+// 时钟
+// 记录某个时刻的 pts 读取时按单调时钟推算当前值
+typedef struct _Clock {
+    // 最近设置的 pts (秒)
+    double pts;
+    // pts 与设置时刻的差值
+    double pts_drift;
+    // 设置时刻 (秒)
+    double last_updated;
+    // 播放速度
+    double speed;
+    // 快进/快退序号 与数据队列的序号不一致时时钟无效
+    int serial;
+    std::atomic<int>* queue_serial;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+} Clock;
+
+/**
+ * 单调时钟 (秒)
+ * @return
+ */
+double clock_now();
+
+/**
+ * 初始化时钟
+ * @param clock
+ * @param queue_serial 数据队列的序号 为 NULL 时不检查
+ */
+void clock_init(Clock* clock, std::atomic<int>* queue_serial);
+
+/**
+ * 获取时钟当前值
+ * 没有设置过或者已经过期 (快进/快退) 返回 NAN
+ * @param clock
+ * @return
+ */
+double clock_get(Clock* clock);
+
+/**
+ * 设置时钟
+ * @param clock
+ * @param pts
+ * @param serial
+ */
+void clock_set(Clock* clock, double pts, int serial);
+
+/**
+ * 按指定时刻设置时钟
+ * @param clock
+ * @param pts
+ * @param serial
+ * @param time
+ */
+void clock_set_at(Clock* clock, double pts, int serial, double time);
+
+/**
+ * 把时钟同步到另一个时钟 相差超过 AV_NOSYNC_THRESHOLD 才同步
+ * @param clock
+ * @param slave
+ */
+void clock_sync_to_slave(Clock* clock, Clock* slave);
+
+/**
+ * 计算下一帧距上一帧的显示间隔
+ * 视频落后主时钟时缩短间隔 超前时延长间隔
+ * @param delay 正常的帧间隔
+ * @param diff 视频时钟减主时钟
+ * @return
+ */
+double clock_compute_delay(double delay, double diff);
+
+/**
+ * 销毁时钟
+ * @param clock
+ */
+void clock_destroy(Clock* clock);
+
+#endif //PLAYER_CLOCK_H
@@ -0,0 +1,112 @@
+#include <stdint.h>
+#include "thread_pool.h"
+
+extern "C" {
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+#ifndef PLAYER_COLOR_CONVERT_H
+#define PLAYER_COLOR_CONVERT_H
+
+// 颜色矩阵
+#define COLOR_MATRIX_BT601 0
+#define COLOR_MATRIX_BT709 1
+
+// 定点运算使用 Q15 取整乘法 (pmulhrsw / vqrdmulh)
+// 亮度系数保留 14 位小数 色度系数保留 13 位小数 (BT.709 的 b_u 大于 2)
+#define COLOR_Y_COEFFICIENT_BITS 14
+#define COLOR_C_COEFFICIENT_BITS 13
+// 中间结果保留的小数位数
+#define COLOR_FRACTION_BITS 6
+
+// SIMD 实现 初始化时按 av_get_cpu_flags 选择
+#define COLOR_SIMD_NONE 0
+#define COLOR_SIMD_SSE2 1
+#define COLOR_SIMD_AVX2 2
+#define COLOR_SIMD_NEON 3
+
+// 分片并行转换的最小像素数 低于这个分辨率单线程更快
+#define COLOR_CONVERT_SLICE_MIN_PIXELS (1280 * 720)
+// 最大分片数
+#define COLOR_CONVERT_MAX_SLICES 8
+
+struct _ColorConverter;
+
+// 转换分片 (一段连续的行)
+typedef struct _ConvertSlice {
+    struct _ColorConverter* converter;
+    AVFrame* frame;
+    uint8_t* dst;
+    int dst_linesize;
+    int y_start;
+    int y_end;
+} ConvertSlice;
+
+// 颜色转换器
+// BT.601 / BT.709 的 YUV420P / NV12 / NV21 -> RGBA 使用 SIMD (NEON / SSE2 / AVX2) 转换
+// 其他格式 其他颜色矩阵 (BT.2020 等) 或需要缩放时回退到 swscale
+typedef struct _ColorConverter {
+    // 当前系数对应的帧属性 变化时重新计算
+    int format;
+    int matrix;
+    bool full_range;
+    // 定点系数
+    int16_t y_offset;
+    int16_t y_coefficient;
+    int16_t r_v;
+    int16_t g_u;
+    int16_t g_v;
+    int16_t b_u;
+    // COLOR_SIMD_*
+    int simd;
+    // swscale 回退 记录已经设置的颜色矩阵和范围
+    struct SwsContext* sws_context;
+    int sws_colorspace;
+    int sws_range;
+    // 高分辨率帧按行分片 在线程池中并行转换
+    ThreadPool* pool;
+    int slice_count;
+    // 分片任务的优先级 THREAD_POOL_PRIORITY_*
+    int priority;
+    ConvertSlice slices[COLOR_CONVERT_MAX_SLICES];
+    TaskGroup group;
+} ColorConverter;
+
+/**
+ * 初始化颜色转换器
+ * @param converter
+ */
+void color_converter_init(ColorConverter* converter);
+
+/**
+ * 设置并行转换的线程池
+ * 调用线程自己也会处理一个分片 所以线程池的线程数可以是 slice_count - 1
+ * @param converter
+ * @param pool
+ * @param slice_count
+ * @param priority THREAD_POOL_PRIORITY_*
+ */
+void color_converter_set_pool(ColorConverter* converter, ThreadPool* pool, int slice_count, int priority);
+
+/**
+ * 转换一帧到 RGBA
+ * 按帧的 colorspace 和 color_range 选择 BT.601 / BT.709 和全范围 / 有限范围
+ * 其他颜色矩阵按帧的 colorspace 设置 swscale 转换
+ * @param converter
+ * @param frame
+ * @param dst RGBA 缓冲区
+ * @param dst_linesize 一行的字节数
+ * @param dst_width
+ * @param dst_height
+ * @return 成功返回 SUCCESS_CODE
+ */
+int color_convert(ColorConverter* converter, AVFrame* frame, uint8_t* dst, int dst_linesize, int dst_width, int dst_height);
+
+/**
+ * 销毁颜色转换器
+ * @param converter
+ */
+void color_converter_destroy(ColorConverter* converter);
+
+#endif //PLAYER_COLOR_CONVERT_H
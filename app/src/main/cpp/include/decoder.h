@@ -0,0 +1,161 @@
+#include "queue.h"
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+#ifndef PLAYER_DECODER_H
+#define PLAYER_DECODER_H
+
+// 解码线程类型 与 Java 层 Player.Options 一致
+#define DECODER_THREAD_AUTO 0
+#define DECODER_THREAD_FRAME 1
+#define DECODER_THREAD_SLICE 2
+
+// 解码线程数上限 (FFmpeg 帧线程最多 16 个)
+#define DECODER_MAX_THREADS 16
+
+// 解码线程策略
+typedef struct _DecoderThreading {
+    // 线程数 0 表示按 CPU 核数自动选择
+    int thread_count;
+    // 线程类型
+    int thread_type;
+    // 低延迟模式 优先使用切片线程 (帧线程每个线程会多缓存一帧)
+    bool low_latency;
+    // 按解码器名称覆盖 格式 "hevc=frame:8,h264=slice:0"
+    char overrides[256];
+} DecoderThreading;
+
+// 跳过解码的级别 逐级增加 CPU 跟不上时用画质换速度
+// NONREF 不解码非参考帧
+// LOOP_FILTER 再跳过环路滤波
+// IDCT 再跳过非关键帧的 IDCT
+// PREVIEW 拖动预览 只解码关键帧
+#define DECODER_SKIP_NONE 0
+#define DECODER_SKIP_NONREF 1
+#define DECODER_SKIP_LOOP_FILTER 2
+#define DECODER_SKIP_IDCT 3
+#define DECODER_SKIP_PREVIEW 4
+
+// 硬件解码连续出错多少次后回退到软件解码
+#define DECODER_MAX_HARDWARE_ERRORS 3
+
+// 硬件解码后端
+// 默认使用 FFmpeg 的 MediaCodec 解码器 在 Linux 上测试时可以换成模拟的后端 (模拟打开失败 解码出错和延迟)
+typedef struct _HardwareBackend {
+    // 后端自己的数据
+    void* opaque;
+    // 打开硬件解码器 不支持或失败返回 NULL
+    AVCodecContext* (*open)(void* opaque, AVCodecParameters* codecpar, void* surface);
+    int (*send_packet)(void* opaque, AVCodecContext* codec_context, const AVPacket* packet);
+    int (*receive_frame)(void* opaque, AVCodecContext* codec_context, AVFrame* frame);
+    void (*flush)(void* opaque, AVCodecContext* codec_context);
+    void (*close)(void* opaque, AVCodecContext** codec_context);
+} HardwareBackend;
+
+// 解码器
+// 按 send/receive 模型驱动 AVCodecContext
+typedef struct _Decoder {
+    // 解码器上下文
+    AVCodecContext* codec_context;
+    // 数据来源
+    Queue* queue;
+    // 解码器暂时不接收的数据 下次再送
+    AVPacket* pending_packet;
+    // 是否已经送入空数据冲刷解码器
+    bool is_draining;
+    // 流参数和线程策略 回退到软件解码时用来重新打开
+    AVCodecParameters* codecpar;
+    DecoderThreading* threading;
+    // 是否正在使用硬件解码 (MediaCodec)
+    bool is_hardware;
+    // 打开时使用的硬件解码后端
+    HardwareBackend* backend;
+    // 硬件解码连续出错次数
+    int hardware_errors;
+    // 切换解码器后 需要等到关键帧才能继续送数据
+    bool wait_keyframe;
+    // 跳过解码的级别 DECODER_SKIP_*
+    int skip_level;
+    // 最近送入解码器的数据的序号 也是解出的帧的序号
+    int packet_serial;
+    int pending_serial;
+} Decoder;
+
+/**
+ * 设置解码线程
+ * 需要在 avcodec_open2 之前调用
+ * @param threading
+ * @param codec_context
+ * @param codec
+ */
+void decoder_threading_apply(DecoderThreading* threading, AVCodecContext* codec_context, AVCodec* codec);
+
+/**
+ * 设置硬件解码后端
+ * 只影响之后打开的解码器 需要在打开解码器之前调用
+ * @param backend 为 NULL 时恢复 MediaCodec
+ */
+void decoder_set_hardware_backend(HardwareBackend* backend);
+
+/**
+ * 打开解码器
+ * hardware 为 true 时优先使用 MediaCodec 硬件解码 打开失败自动回退到软件解码
+ * surface 不为 NULL 时硬件解码直接渲染到 Surface 解出的帧格式为 AV_PIX_FMT_MEDIACODEC
+ * @param decoder
+ * @param codecpar
+ * @param threading 软件解码线程策略 可以为 NULL
+ * @param hardware
+ * @param surface Java Surface 全局引用
+ * @return
+ */
+int decoder_open(Decoder* decoder, AVCodecParameters* codecpar, DecoderThreading* threading, bool hardware, void* surface);
+
+/**
+ * 解码一帧
+ * 先取出解码器中已有的帧 取不到 (EAGAIN) 才从队列送入新的数据
+ * 一个数据可能解出 0 帧或多帧 队列结束后送入空数据冲刷 取出剩余的帧
+ * 数据的序号变化时 (快进/快退) 丢弃过期的数据并清空解码器 帧的序号为 decoder->packet_serial
+ * @param decoder
+ * @param frame
+ * @return 取到一帧返回 1 解码结束返回 0
+ */
+int decoder_decode_frame(Decoder* decoder, AVFrame* frame);
+
+/**
+ * 解码一帧 (不阻塞)
+ * 和 decoder_decode_frame 相同 但队列为空时不等待 用于在线程池中执行的解码
+ * 队列需要设置 consumer_notify 有新数据时重新调用
+ * @param decoder
+ * @param frame
+ * @return 取到一帧返回 1 解码结束返回 0 队列暂时没有数据返回 AVERROR(EAGAIN)
+ */
+int decoder_poll_frame(Decoder* decoder, AVFrame* frame);
+
+/**
+ * 直接送入一个数据并尝试取出一帧 (不经过队列)
+ * 预加载时用来提前解出第一帧 之后的数据照常从队列送入
+ * 数据回收到队列的数据池 解码器暂时不接收时留到下次再送
+ * @param decoder
+ * @param packet
+ * @param frame
+ * @return 取到一帧返回 1 需要更多数据返回 0 出错返回负数
+ */
+int decoder_decode_packet(Decoder* decoder, AVPacket* packet, AVFrame* frame);
+
+/**
+ * 设置跳过解码的级别
+ * 只能在解码的线程 (任务) 中调用 对硬件解码无效
+ * @param decoder
+ * @param level DECODER_SKIP_*
+ */
+void decoder_set_skip_level(Decoder* decoder, int level);
+
+/**
+ * 销毁解码器
+ * @param decoder
+ */
+void decoder_destroy(Decoder* decoder);
+
+#endif //PLAYER_DECODER_H
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <atomic>
+
+#ifndef PLAYER_FRAME_DROP_H
+#define PLAYER_FRAME_DROP_H
+
+// 统计窗口的帧数
+#define FRAME_DROP_WINDOW 30
+// 一个窗口内丢帧达到这个数量 提高跳过解码的级别
+#define FRAME_DROP_ESCALATE_DROPS 5
+// 连续多少个窗口没有丢帧 降低跳过解码的级别
+#define FRAME_DROP_RELAX_WINDOWS 4
+// 最多连续丢帧数 保证画面还在更新
+#define FRAME_DROP_MAX_CONSECUTIVE 10
+
+// 丢帧策略
+// 显示线程发现帧已经落后主时钟时直接丢掉 不做颜色转换和渲染
+// 丢帧持续出现时逐级让解码器跳过部分解码工作 恢复后逐级还原
+typedef struct _FrameDropper {
+    // 是否允许丢帧
+    bool enabled;
+    // 当前窗口的帧数和丢帧数 (显示线程使用)
+    int window_frames;
+    int window_drops;
+    // 连续没有丢帧的窗口数
+    int clean_windows;
+    // 连续丢帧数
+    int consecutive_drops;
+    // 跳过解码的级别 显示线程修改 解码线程读取
+    std::atomic<int> skip_level;
+    // 统计
+    std::atomic<int64_t> decoded_frames;
+    std::atomic<int64_t> rendered_frames;
+    std::atomic<int64_t> dropped_frames;
+} FrameDropper;
+
+/**
+ * 初始化丢帧策略
+ * @param dropper
+ * @param enabled
+ */
+void frame_drop_init(FrameDropper* dropper, bool enabled);
+
+/**
+ * 判断是否丢掉这一帧
+ * @param dropper
+ * @param lateness 主时钟减帧的 pts (秒)
+ * @param duration 帧时长 (秒)
+ * @return
+ */
+bool frame_drop_should_drop(FrameDropper* dropper, double lateness, double duration);
+
+/**
+ * 记录一帧的处理结果 按丢帧情况调整跳过解码的级别
+ * @param dropper
+ * @param dropped
+ */
+void frame_drop_on_frame(FrameDropper* dropper, bool dropped);
+
+/**
+ * 记录解码出一帧
+ * @param dropper
+ */
+void frame_drop_on_decoded(FrameDropper* dropper);
+
+/**
+ * 获取跳过解码的级别
+ * @param dropper
+ * @return DECODER_SKIP_*
+ */
+int frame_drop_get_skip_level(FrameDropper* dropper);
+
+#endif //PLAYER_FRAME_DROP_H
@@ -0,0 +1,98 @@
+#include <pthread.h>
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+#ifndef PLAYER_FRAME_QUEUE_H
+#define PLAYER_FRAME_QUEUE_H
+
+// 解码后帧队列最大值
+// 只需要很小的容量 让解码可以领先显示几帧 吸收解码耗时的抖动
+#define FRAME_QUEUE_MAX_SIZE 3
+
+// 解码后帧队列
+// 帧预先分配 入队/出队只移动引用 不拷贝像素数据
+typedef struct _FrameQueue {
+    // 帧
+    AVFrame* frames[FRAME_QUEUE_MAX_SIZE];
+    // 帧的序号 (快进/快退)
+    int serials[FRAME_QUEUE_MAX_SIZE];
+    // 读写位置
+    int read_index;
+    int write_index;
+    // 大小
+    int size;
+    // 是否阻塞
+    bool is_block;
+    // 生产者在线程池中执行时 出队和清空之后的通知 (有空位了)
+    void (*producer_notify)(void* opaque);
+    void* producer_opaque;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+    // 线程条件变量
+    pthread_cond_t* not_empty_condition;
+    pthread_cond_t* not_full_condition;
+} FrameQueue;
+
+/**
+ * 初始化帧队列
+ * @param queue
+ */
+void frame_queue_init(FrameQueue* queue);
+
+/**
+ * 销毁帧队列
+ * @param queue
+ */
+void frame_queue_destroy(FrameQueue* queue);
+
+/**
+ * 设置生产者的通知
+ * 每次出队和清空之后调用 生产者先用 frame_queue_is_full 检查 满了就停下等通知 不阻塞工作线程
+ * @param queue
+ * @param notify
+ * @param opaque
+ */
+void frame_queue_set_producer_notify(FrameQueue* queue, void (*notify)(void*), void* opaque);
+
+/**
+ * 判断是否已满
+ * @param queue
+ * @return
+ */
+bool frame_queue_is_full(FrameQueue* queue);
+
+/**
+ * 入队 (阻塞)
+ * frame 的引用会被移动到队列中
+ * @param queue
+ * @param frame
+ * @param serial
+ * @return 被打断返回 false
+ */
+bool frame_queue_in(FrameQueue* queue, AVFrame* frame, int serial);
+
+/**
+ * 出队 (阻塞)
+ * 队列中的引用会被移动到 frame 中 使用完需要 av_frame_unref
+ * @param queue
+ * @param frame
+ * @param serial 帧的序号 可以为 NULL
+ * @return 被打断并且队列为空返回 false
+ */
+bool frame_queue_out(FrameQueue* queue, AVFrame* frame, int* serial);
+
+/**
+ * 清空帧队列
+ * @param queue
+ */
+void frame_queue_clear(FrameQueue* queue);
+
+/**
+ * 打断阻塞
+ * @param queue
+ */
+void frame_queue_break_block(FrameQueue* queue);
+
+#endif //PLAYER_FRAME_QUEUE_H
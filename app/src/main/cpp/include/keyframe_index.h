@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#ifndef PLAYER_KEYFRAME_INDEX_H
+#define PLAYER_KEYFRAME_INDEX_H
+
+// 索引文件魔数和版本
+#define KEYFRAME_INDEX_MAGIC "KFI1"
+#define KEYFRAME_INDEX_VERSION 1
+// 初始容量
+#define KEYFRAME_INDEX_INIT_CAPACITY 1024
+// 需要索引的容器 (自己没有索引 seek 要二分查找或扫描文件)
+#define KEYFRAME_INDEX_FORMATS "mpegts,mpeg,flv,h264,hevc,mpegvideo,m4v,cavsvideo"
+// 索引文件后缀
+#define KEYFRAME_INDEX_SUFFIX ".kfi"
+// 记录和前一个记录之间没有漏掉的关键帧 (同一次顺序读取中相邻)
+#define KEYFRAME_ENTRY_CONTIGUOUS 1
+
+// 关键帧
+typedef struct _KeyframeEntry {
+    // 时间 (AV_TIME_BASE 包含 start_time)
+    int64_t pts;
+    // 数据在文件中的字节偏移
+    int64_t pos;
+    // 数据大小
+    int32_t size;
+    // KEYFRAME_ENTRY_* 旧版本索引文件中为 0
+    int32_t flags;
+} KeyframeEntry;
+
+// 索引文件头 后面紧跟 count 个 KeyframeEntry
+// 用文件大小和修改时间识别视频文件 视频文件变了索引自动失效
+typedef struct _KeyframeIndexHeader {
+    char magic[4];
+    int32_t version;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t count;
+    // 是否扫描完整个文件
+    int32_t complete;
+    int32_t reserved;
+} KeyframeIndexHeader;
+
+// 关键帧索引
+// 对 MPEG-TS / FLV / 裸流这类自己没有索引的容器 记录关键帧的位置 快进/快退时二分查找后按字节 seek
+// 播放时边读边记录 也可以在后台扫描整个文件 结果保存为可以直接 mmap 的索引文件
+// 播放时的记录在每次快进/快退处断开 不完整的索引只信任连续记录覆盖的范围
+typedef struct _KeyframeIndex {
+    // 按 pts 升序
+    KeyframeEntry* entries;
+    int64_t count;
+    int64_t capacity;
+    // 完整的索引直接 mmap 只读使用 不再记录
+    void* mapped;
+    size_t mapped_size;
+    bool complete;
+    // 有没有需要保存的新记录
+    bool dirty;
+    // 视频文件和索引文件
+    char* path;
+    char* index_path;
+    int64_t file_size;
+    int64_t file_mtime;
+    // 后台扫描
+    pthread_t scan_id;
+    bool is_scanning;
+    std::atomic<bool> scan_abort;
+    // 线程锁 (生产线程和扫描线程)
+    pthread_mutex_t* mutex_id;
+} KeyframeIndex;
+
+/**
+ * 容器是否需要关键帧索引
+ * @param format_context
+ * @return
+ */
+bool keyframe_index_is_needed(AVFormatContext* format_context);
+
+/**
+ * 初始化索引 并尝试加载已经保存的索引文件
+ * @param index
+ * @param path 视频文件
+ * @param directory 索引文件目录
+ * @return 视频文件不是本地文件等无法建立索引时返回 FAIL_CODE
+ */
+int keyframe_index_init(KeyframeIndex* index, const char* path, const char* directory);
+
+/**
+ * 记录一个关键帧
+ * 不是关键帧 没有位置或时间 以及索引已经完整时忽略
+ * @param index
+ * @param packet
+ * @param stream packet 所在的流
+ * @param previous_pts 这个读取者上一次记录的关键帧 (AV_TIME_BASE) 读取位置跳变 (seek) 后设为 AV_NOPTS_VALUE
+ */
+void keyframe_index_add_packet(KeyframeIndex* index, AVPacket* packet, AVStream* stream, int64_t* previous_pts);
+
+/**
+ * 查找不晚于 target 的最后一个关键帧
+ * 索引不完整时 只有找到的记录和下一个记录连续 (中间没有漏掉关键帧) 才算找到
+ * @param index
+ * @param target AV_TIME_BASE
+ * @param entry
+ * @return 找到返回 true
+ */
+bool keyframe_index_lookup(KeyframeIndex* index, int64_t target, KeyframeEntry* entry);
+
+/**
+ * 开始后台扫描整个文件
+ * 扫描使用独立的 AVFormatContext 索引已经完整时不扫描
+ * @param index
+ */
+void keyframe_index_start_scan(KeyframeIndex* index);
+
+/**
+ * 保存索引文件
+ * 先写临时文件再重命名 不会留下写了一半的索引
+ * @param index
+ * @return
+ */
+int keyframe_index_save(KeyframeIndex* index);
+
+/**
+ * 销毁索引
+ * 停止后台扫描 保存新的记录
+ * @param index
+ */
+void keyframe_index_destroy(KeyframeIndex* index);
+
+#endif //PLAYER_KEYFRAME_INDEX_H
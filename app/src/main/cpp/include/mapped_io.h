@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <stddef.h>
+
+extern "C" {
+#include "libavformat/avio.h"
+}
+
+#ifndef PLAYER_MAPPED_IO_H
+#define PLAYER_MAPPED_IO_H
+
+// AVIOContext 的缓冲区大小 大块读取时 direct 模式直接拷贝到调用者的缓冲区 不经过它
+#define MAPPED_IO_AVIO_BUFFER_SIZE (32 * 1024)
+// 提前通知内核预读的范围
+#define MAPPED_IO_READ_AHEAD (8 * 1024 * 1024)
+// 已经读过的数据保留多少 超过后让内核回收
+#define MAPPED_IO_KEEP_BEHIND (16 * 1024 * 1024)
+
+// 内存映射 IO (本地文件)
+// 整个文件 mmap 读取只是从映射区拷贝 没有 read 系统调用 也少了一次内核到 AVIO 缓冲区的拷贝
+// 随读取位置和 seek 用 madvise 提示内核预读前面的数据 回收后面的数据
+typedef struct _MappedIO {
+    // 映射区
+    uint8_t* data;
+    int64_t size;
+    // 读取位置
+    int64_t position;
+    // 已经提示预读到的位置 和已经回收到的位置
+    int64_t advised_end;
+    int64_t released_end;
+    size_t page_size;
+    // 交给 AVFormatContext 的 IO
+    AVIOContext* avio;
+} MappedIO;
+
+/**
+ * 映射本地文件
+ * 不是本地普通文件或者映射失败 (32 位进程地址空间不够) 时返回 FAIL_CODE
+ * @param io
+ * @param path 文件路径 可以带 file: 前缀
+ * @return
+ */
+int mapped_io_open(MappedIO* io, const char* path);
+
+/**
+ * 解除映射并释放
+ * 需要在 avformat_close_input 之后调用
+ * @param io
+ */
+void mapped_io_close(MappedIO* io);
+
+#endif //PLAYER_MAPPED_IO_H
@@ -0,0 +1,79 @@
+#include <jni.h>
+#include "queue.h"
+#include "decoder.h"
+#include "audio_sink.h"
+#include "clock.h"
+#include "thread_pool.h"
+
+#ifndef PLAYER_OPTIONS_H
+#define PLAYER_OPTIONS_H
+
+// Java 层的调度优先级
+#define PLAYER_PRIORITY_FOREGROUND 0
+#define PLAYER_PRIORITY_BACKGROUND 1
+
+// 播放器配置
+// 对应 Java 层 Player.Options
+typedef struct _PlayerOptions {
+    // 视频队列水位
+    QueueLimit video_queue_limit;
+    // 音频队列水位
+    QueueLimit audio_queue_limit;
+    // 视频解码线程策略
+    DecoderThreading video_threading;
+    // 优先使用 MediaCodec 硬件解码
+    bool hardware_decode;
+    // 硬件解码直接渲染到 Surface
+    bool hardware_render;
+    // 窗口支持时直接渲染 YUV 跳过 RGBA 转换
+    bool yuv_render;
+    // 高分辨率颜色转换的并行线程数 0 表示自动 1 表示不并行
+    int convert_threads;
+    // 音频输出类型 AUDIO_SINK_*
+    int audio_sink;
+    // 空输出时把 PCM 写到这个文件 为空不写
+    char audio_dump_path[256];
+    // 音频输出采样率 0 表示使用设备原生采样率
+    int audio_sample_rate;
+    // 设备每次混音的帧数 (AudioManager.PROPERTY_OUTPUT_FRAMES_PER_BUFFER) 0 表示未知
+    int audio_frames_per_burst;
+    // 主时钟 CLOCK_MASTER_*
+    int sync_master;
+    // 视频落后时丢帧 并逐级跳过部分解码
+    bool frame_drop;
+    // 关键帧索引文件目录 为空不使用索引
+    char keyframe_index_dir[256];
+    // 是否在后台扫描整个文件建立索引
+    bool keyframe_index_scan;
+    // 预读缓冲区字节数 0 表示不预读 解封装线程直接读源
+    int io_prefetch_bytes;
+    // 本地文件使用内存映射读取 优先于预读
+    bool io_mmap;
+    // 快速启动 限制探测读取的数据量和时长
+    bool fast_start;
+    // 探测结果缓存目录 为空不缓存
+    char stream_info_cache_dir[256];
+    // 共享线程池中的任务 (视频解码 颜色转换) 优先级 THREAD_POOL_PRIORITY_* 也决定专用线程的 nice
+    int priority;
+    // 预加载时缓冲的字节数
+    int preload_bytes;
+    // 预加载时提前解出第一帧
+    bool preload_first_frame;
+} PlayerOptions;
+
+/**
+ * 初始化为默认配置
+ * @param options
+ */
+void options_init(PlayerOptions* options);
+
+/**
+ * 读取 Java 层配置
+ * options 为 NULL 时使用默认配置
+ * @param options
+ * @param env
+ * @param java_options
+ */
+void options_from_java(PlayerOptions* options, JNIEnv* env, jobject java_options);
+
+#endif //PLAYER_OPTIONS_H
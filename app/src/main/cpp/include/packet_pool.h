@@ -0,0 +1,54 @@
+#include <pthread.h>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+#ifndef PLAYER_PACKET_POOL_H
+#define PLAYER_PACKET_POOL_H
+
+// 预先分配的数据数量
+#define PACKET_POOL_INIT_SIZE 256
+// 最多缓存的空闲数据数量 (两个队列的容量) 超过的直接释放
+#define PACKET_POOL_MAX_SIZE 8192
+
+// 数据池
+// 缓存 AVPacket 结构体 回收时只 av_packet_unref 释放数据引用 结构体留给下次使用
+// 稳定播放时不再有 AVPacket 结构体的分配和释放
+typedef struct _PacketPool {
+    // 空闲数据 (栈)
+    AVPacket* packets[PACKET_POOL_MAX_SIZE];
+    int size;
+    // 线程锁 (生产线程取 解码线程还)
+    pthread_mutex_t* mutex_id;
+} PacketPool;
+
+/**
+ * 初始化数据池
+ * @param pool
+ */
+void packet_pool_init(PacketPool* pool);
+
+/**
+ * 取出一个空的数据 池为空时重新分配
+ * @param pool
+ * @return
+ */
+AVPacket* packet_pool_get(PacketPool* pool);
+
+/**
+ * 回收数据 并置为 NULL
+ * pool 为 NULL 时直接释放
+ * @param pool
+ * @param packet
+ */
+void packet_pool_release(PacketPool* pool, AVPacket** packet);
+
+/**
+ * 销毁数据池
+ * 需要在所有数据回收之后调用
+ * @param pool
+ */
+void packet_pool_destroy(PacketPool* pool);
+
+#endif //PLAYER_PACKET_POOL_H
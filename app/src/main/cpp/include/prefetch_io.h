@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <pthread.h>
+
+extern "C" {
+#include "libavformat/avio.h"
+}
+
+#ifndef PLAYER_PREFETCH_IO_H
+#define PLAYER_PREFETCH_IO_H
+
+// 每次从源读取的大小
+#define PREFETCH_IO_CHUNK_SIZE (256 * 1024)
+// 交给 AVIOContext 的缓冲区大小
+#define PREFETCH_IO_AVIO_BUFFER_SIZE (64 * 1024)
+
+// 预读 IO
+// 独立的 IO 线程按大块顺序读取源数据 放入环形缓冲区 解封装线程只从内存拷贝
+// 缓冲区范围内的 seek 直接跳过 范围外的 seek 丢弃预读数据 让 IO 线程从新位置开始读
+typedef struct _PrefetchIO {
+    // 源 (avio_open2 打开 支持文件和网络协议)
+    AVIOContext* source;
+    int64_t source_size;
+    // 交给 AVFormatContext 的 IO
+    AVIOContext* avio;
+    // 环形缓冲区
+    uint8_t* buffer;
+    int buffer_size;
+    // 解封装线程下一次读取的文件位置 和它在缓冲区中的下标
+    int64_t read_pos;
+    int read_index;
+    // read_pos 之后已经预读的字节数
+    int data_size;
+    // seek 时增加 IO 线程据此丢弃 seek 之前发出的读取结果
+    int generation;
+    bool seek_requested;
+    // 读到文件结束或者出错 (error 为错误码)
+    bool eof;
+    int error;
+    bool is_running;
+    // IO 线程
+    pthread_t thread_id;
+    uint8_t* chunk;
+    // 统计
+    int64_t bytes_read;
+    // 源读取耗时 (微秒)
+    int64_t read_time;
+    // 解封装线程等待数据的次数和耗时 (微秒)
+    int64_t stall_count;
+    int64_t stall_time;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+    // 线程条件变量
+    pthread_cond_t* not_empty_condition;
+    pthread_cond_t* not_full_condition;
+} PrefetchIO;
+
+/**
+ * 打开预读 IO 并启动 IO 线程
+ * 把 io->avio 设置为 AVFormatContext 的 pb 使用
+ * @param io
+ * @param path
+ * @param buffer_size 环形缓冲区大小
+ * @return
+ */
+int prefetch_io_open(PrefetchIO* io, const char* path, int buffer_size);
+
+/**
+ * 获取统计
+ * @param io
+ * @param bytes_read 从源读取的字节数
+ * @param read_time 源读取耗时 (微秒)
+ * @param stall_count 解封装线程等待数据的次数
+ * @param stall_time 解封装线程等待数据的耗时 (微秒)
+ */
+void prefetch_io_get_stats(PrefetchIO* io, int64_t* bytes_read, int64_t* read_time, int64_t* stall_count, int64_t* stall_time);
+
+/**
+ * 停止 IO 线程 关闭源并释放
+ * 需要在 avformat_close_input 之后调用
+ * @param io
+ */
+void prefetch_io_close(PrefetchIO* io);
+
+#endif //PLAYER_PREFETCH_IO_H
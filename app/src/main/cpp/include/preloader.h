@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+#ifndef PLAYER_PRELOADER_H
+#define PLAYER_PRELOADER_H
+
+// 预加载状态
+// QUEUED 等待加载线程 LOADING 正在打开和缓冲 READY 可以交给播放器 FAILED 打开失败
+#define PRELOAD_STATE_QUEUED 0
+#define PRELOAD_STATE_LOADING 1
+#define PRELOAD_STATE_READY 2
+#define PRELOAD_STATE_FAILED 3
+
+/**
+ * 加载会话 在预加载器自己的加载线程中执行
+ * cancel 变为 true 时尽快停止缓冲 (已经打开的部分保留)
+ * @return 成功返回 SUCCESS_CODE
+ */
+typedef int (*PreloadLoadFunction)(void* session, const char* path, std::atomic<bool>* cancel);
+
+/**
+ * 释放没有交给播放器的会话
+ */
+typedef void (*PreloadReleaseFunction)(void* session);
+
+struct _Preloader;
+
+// 预加载项
+typedef struct _PreloadEntry {
+    struct _Preloader* preloader;
+    char* path;
+    // 会话 (还没有开始播放的播放器)
+    void* session;
+    int state;
+    // 停止缓冲 被淘汰或者交给播放器时设置
+    std::atomic<bool> cancel;
+    // 正在加载时已经从预加载器移除 加载结束后由加载线程释放
+    bool detached;
+    // LRU 链表 (头部最近使用)
+    struct _PreloadEntry* prev;
+    struct _PreloadEntry* next;
+} PreloadEntry;
+
+// 预加载器
+// 在后台打开 探测 缓冲接下来要播放的文件 播放时直接接管 跳过冷启动
+// 最多保留 capacity 项 超过时淘汰最久没有使用的 每项的缓冲量由播放器配置限制
+// 打开 探测和缓冲都是阻塞 I/O 由一个加载线程依次执行 (最近添加的先加载) 不占用共享线程池
+typedef struct _Preloader {
+    int capacity;
+    int count;
+    PreloadEntry* head;
+    PreloadEntry* tail;
+    PreloadLoadFunction load;
+    PreloadReleaseFunction release;
+    // 加载线程
+    pthread_t thread_id;
+    bool is_running;
+    pthread_mutex_t* mutex_id;
+    // 添加预加载 加载结束和销毁时通知
+    pthread_cond_t* state_condition;
+} Preloader;
+
+/**
+ * 初始化预加载器
+ * @param preloader
+ * @param capacity 最多保留的项数
+ * @param load
+ * @param release
+ */
+void preloader_init(Preloader* preloader, int capacity, PreloadLoadFunction load, PreloadReleaseFunction release);
+
+/**
+ * 添加预加载
+ * 会话的所有权交给预加载器 已经在预加载的文件只更新使用顺序 新会话直接释放
+ * @param preloader
+ * @param path
+ * @param session
+ */
+void preloader_add(Preloader* preloader, const char* path, void* session);
+
+/**
+ * 取出预加载的会话
+ * 正在加载时停止缓冲并等待打开完成 还没开始加载或者加载失败返回 NULL
+ * @param preloader
+ * @param path
+ * @return 会话的所有权交给调用者
+ */
+void* preloader_take(Preloader* preloader, const char* path);
+
+/**
+ * 取消预加载
+ * @param preloader
+ * @param path
+ */
+void preloader_remove(Preloader* preloader, const char* path);
+
+/**
+ * 销毁预加载器
+ * 释放所有会话 停止并等待加载线程
+ * @param preloader
+ */
+void preloader_destroy(Preloader* preloader);
+
+#endif //PLAYER_PRELOADER_H
@@ -1,5 +1,7 @@
 #include <sys/types.h>
 #include <pthread.h>
+#include <atomic>
+#include "packet_pool.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -8,30 +10,74 @@ extern "C" {
 #ifndef PLAYER_QUEUE_H
 #define PLAYER_QUEUE_H
 
-// 队列最大值
-#define QUEUE_MAX_SIZE 50
+// 队列最大值 (环形缓冲区容量 必须是 2 的幂)
+// 只是硬上限 实际缓冲量由 QueueLimit 的字节数和时长控制
+#define QUEUE_MAX_SIZE 4096
+#define QUEUE_MASK (QUEUE_MAX_SIZE - 1)
+
+// 缓存行大小 用于隔开生产者和消费者的游标 避免伪共享
+#define CACHE_LINE_SIZE 64
 
 // 节点数据类型
 typedef AVPacket* NodeElement;
 
-// 节点
-typedef struct _Node {
-    // 数据
-    NodeElement data;
-    // 下一个
-    struct _Node* next;
-} Node;
+// 队列水位
+// 超过高水位 (max) 时生产者阻塞 直到低于低水位 (min) 才继续
+// 值为 0 表示不限制
+typedef struct _QueueLimit {
+    // 缓冲字节数
+    int64_t max_bytes;
+    int64_t min_bytes;
+    // 缓冲时长 (毫秒)
+    int64_t max_duration;
+    int64_t min_duration;
+} QueueLimit;
 
 // 队列
+// 单生产者单消费者无锁环形队列
+// 只有队列为空或已满需要等待时才会用到锁和条件变量
 typedef struct _Queue {
-    // 大小
-    int size;
-    // 队列头
-    Node* head;
-    // 队列尾
-    Node* tail;
+    // 队列头 (消费者写)
+    std::atomic<unsigned int> head;
+    char head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<unsigned int>)];
+    // 队列尾 (生产者写)
+    std::atomic<unsigned int> tail;
+    char tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<unsigned int>)];
+    // 数据
+    NodeElement data[QUEUE_MAX_SIZE];
+    // 每个数据的时长 (微秒)
+    int64_t durations[QUEUE_MAX_SIZE];
+    // 每个数据的字节数 清空时统计用 不需要访问可能已经被消费者回收的数据
+    int sizes[QUEUE_MAX_SIZE];
+    // 每个数据入队时的序号
+    int serials[QUEUE_MAX_SIZE];
+    // 当前序号 每次快进/快退加一 序号不同的数据已经过期
+    std::atomic<int> serial;
+    // 已缓冲的字节数和时长 (微秒)
+    std::atomic<int64_t> bytes;
+    std::atomic<int64_t> duration;
+    // 水位
+    QueueLimit limit;
+    // 流的时间基
+    AVRational time_base;
+    // 上一个入队数据的 pts (生产者使用 用于估算没有 duration 的数据)
+    int64_t last_pts;
+    // last_pts 对应的序号 (生产者使用) 序号变化时 last_pts 失效
+    int last_serial;
+    // 另一条流的队列 对方饿死时不再阻塞生产者
+    struct _Queue* peer;
+    // 数据池 清空或丢弃的数据回收到这里
+    PacketPool* pool;
     // 是否阻塞
-    bool is_block;
+    std::atomic<bool> is_block;
+    // 消费者已经取到结束 (被打断且没有数据) 之后不会再取数据 不能再恢复阻塞
+    std::atomic<bool> is_end;
+    // 是否有线程在等待
+    std::atomic<bool> producer_waiting;
+    std::atomic<bool> consumer_waiting;
+    // 消费者在线程池中执行时 (queue_try_out) 入队和打断之后的通知 代替条件变量
+    void (*consumer_notify)(void* opaque);
+    void* consumer_opaque;
     // 线程锁
     pthread_mutex_t* mutex_id;
     // 线程条件变量
@@ -45,8 +91,41 @@ typedef struct _Queue {
  */
 void queue_init(Queue* queue);
 
+/**
+ * 设置水位
+ * @param queue
+ * @param limit
+ * @param time_base
+ */
+void queue_set_limit(Queue* queue, QueueLimit* limit, AVRational time_base);
+
+/**
+ * 设置另一条流的队列
+ * 生产者在本队列超过水位阻塞时 如果对方队列已经空了 会被唤醒继续生产 避免对方饿死
+ * @param queue
+ * @param peer
+ */
+void queue_set_peer(Queue* queue, Queue* peer);
+
+/**
+ * 设置数据池
+ * @param queue
+ * @param pool
+ */
+void queue_set_pool(Queue* queue, PacketPool* pool);
+
+/**
+ * 设置消费者的通知
+ * 每次入队和打断之后调用 (在入队或打断的线程) 消费者用 queue_try_out 取数据时需要设置
+ * @param queue
+ * @param notify
+ * @param opaque
+ */
+void queue_set_consumer_notify(Queue* queue, void (*notify)(void*), void* opaque);
+
 /**
  * 销毁队列
+ * 剩下的数据回收到数据池
  * @param queue
  */
 void queue_destroy(Queue* queue);
@@ -65,34 +144,67 @@ bool queue_is_empty(Queue* queue);
  */
 bool queue_is_full(Queue* queue);
 
+/**
+ * 判断是否超过高水位
+ * 超过时入队会阻塞到消费者取走数据 没有消费者时 (预加载) 需要先检查
+ * @param queue
+ * @return
+ */
+bool queue_is_over_max(Queue* queue);
+
 /**
  * 入队 (阻塞)
+ * 只能由生产者线程调用
  * @param queue
  * @param element
- * @param tid
- * @param cid
  */
 void queue_in(Queue* queue, NodeElement element);
 
 /**
  * 出队 (阻塞)
+ * 只能由消费者线程调用
+ * @param queue
+ * @param serial 数据入队时的序号 可以为 NULL
+ * @return
+ */
+NodeElement queue_out(Queue* queue, int* serial);
+
+/**
+ * 出队 (不阻塞)
+ * 只能由消费者调用 队列为空时返回 NULL 之后有数据或者被打断时通过 consumer_notify 通知
  * @param queue
- * @param tid
- * @param cid
+ * @param serial 数据入队时的序号 可以为 NULL
+ * @param is_end 被打断并且没有数据 消费者结束 和 queue_out 返回 NULL 相同
  * @return
  */
-NodeElement queue_out(Queue* queue);
+NodeElement queue_try_out(Queue* queue, int* serial, bool* is_end);
 
 /**
  * 清空队列
+ * 清掉的数据回收到数据池 不改变是否阻塞
  * @param queue
  */
 void queue_clear(Queue* queue);
 
+/**
+ * 清空队列并增加序号 (快进/快退)
+ * 只能由生产者线程调用 之后入队的数据使用新序号
+ * @param queue
+ */
+void queue_flush(Queue* queue);
+
 /**
  * 打断阻塞
+ * 消费者取完剩下的数据后出队返回 NULL
  * @param queue
  */
 void break_block(Queue* queue);
 
+/**
+ * 恢复阻塞 (读到结束后又快进/快退)
+ * @param queue
+ * @return 消费者已经结束时返回 false 队列保持打断
+ */
+bool queue_resume(Queue* queue);
+
 #endif //PLAYER_QUEUE_H
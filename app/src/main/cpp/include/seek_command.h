@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+#ifndef PLAYER_SEEK_COMMAND_H
+#define PLAYER_SEEK_COMMAND_H
+
+// 精确定位 丢掉目标之前的帧
+#define SEEK_FLAG_ACCURATE 1
+// 拖动预览 只解码关键帧 显示一帧后停下等待下一个命令
+#define SEEK_FLAG_PREVIEW 2
+
+// 快进/快退请求
+typedef struct _SeekRequest {
+    // 目标位置 (AV_TIME_BASE)
+    int64_t target;
+    // SEEK_FLAG_*
+    int flags;
+    // 发出请求的时间 (av_gettime_relative 微秒)
+    int64_t request_time;
+} SeekRequest;
+
+// 快进/快退命令通道
+// Java 线程投递 生产线程消费 只保存最新的请求 还没处理的旧请求直接被覆盖
+typedef struct _SeekCommand {
+    SeekRequest request;
+    bool pending;
+    // 解码线程都已经结束 不会再有人处理请求
+    bool is_closed;
+    // 投递次数和被覆盖 (合并) 的次数
+    std::atomic<int64_t> posted;
+    std::atomic<int64_t> coalesced;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+    // 线程条件变量
+    pthread_cond_t* condition;
+} SeekCommand;
+
+/**
+ * 初始化命令通道
+ * @param command
+ */
+void seek_command_init(SeekCommand* command);
+
+/**
+ * 投递请求 (不阻塞)
+ * @param command
+ * @param target 目标位置 (AV_TIME_BASE)
+ * @param flags SEEK_FLAG_*
+ */
+void seek_command_post(SeekCommand* command, int64_t target, int flags);
+
+/**
+ * 取出最新的请求 (不阻塞)
+ * @param command
+ * @param request
+ * @return 没有请求返回 false
+ */
+bool seek_command_take(SeekCommand* command, SeekRequest* request);
+
+/**
+ * 等待并取出最新的请求 (阻塞)
+ * 通道关闭时不再等待
+ * @param command
+ * @param request
+ * @return 通道已经关闭并且没有请求返回 false
+ */
+bool seek_command_wait(SeekCommand* command, SeekRequest* request);
+
+/**
+ * 关闭通道 唤醒等待的线程
+ * @param command
+ */
+void seek_command_close(SeekCommand* command);
+
+/**
+ * 销毁命令通道
+ * @param command
+ */
+void seek_command_destroy(SeekCommand* command);
+
+#endif //PLAYER_SEEK_COMMAND_H
@@ -0,0 +1,143 @@
+#include <stdint.h>
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#ifndef PLAYER_STREAM_INFO_CACHE_H
+#define PLAYER_STREAM_INFO_CACHE_H
+
+// 缓存文件魔数和版本
+#define STREAM_INFO_CACHE_MAGIC "SIC1"
+#define STREAM_INFO_CACHE_VERSION 1
+// 缓存文件后缀
+#define STREAM_INFO_CACHE_SUFFIX ".sic"
+// 最多缓存的流数量 超过的文件不缓存
+#define STREAM_INFO_CACHE_MAX_STREAMS 32
+// extradata 最大字节数
+#define STREAM_INFO_CACHE_MAX_EXTRADATA (1024 * 1024)
+
+// 快速启动的探测限制
+#define FAST_START_PROBE_SIZE (256 * 1024)
+#define FAST_START_ANALYZE_DURATION (500 * 1000)
+
+// 缓存文件头
+// 用文件大小和修改时间识别视频文件 视频文件变了缓存自动失效
+typedef struct _StreamInfoHeader {
+    char magic[4];
+    int32_t version;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t duration;
+    int64_t start_time;
+    int64_t bit_rate;
+    int32_t stream_count;
+    int32_t reserved;
+} StreamInfoHeader;
+
+// 一条流探测出的参数 后面紧跟 extradata_size 字节的 extradata
+typedef struct _StreamInfoRecord {
+    int32_t codec_type;
+    int32_t codec_id;
+    uint32_t codec_tag;
+    int32_t format;
+    int64_t bit_rate;
+    int32_t bits_per_coded_sample;
+    int32_t bits_per_raw_sample;
+    int32_t profile;
+    int32_t level;
+    int32_t width;
+    int32_t height;
+    AVRational sample_aspect_ratio;
+    int32_t field_order;
+    int32_t color_range;
+    int32_t color_primaries;
+    int32_t color_trc;
+    int32_t color_space;
+    int32_t chroma_location;
+    int32_t video_delay;
+    int32_t sample_rate;
+    uint64_t channel_layout;
+    int32_t channels;
+    int32_t block_align;
+    int32_t frame_size;
+    int32_t initial_padding;
+    int32_t seek_preroll;
+    int32_t extradata_size;
+    AVRational avg_frame_rate;
+    AVRational r_frame_rate;
+    int64_t duration;
+    int64_t start_time;
+} StreamInfoRecord;
+
+/**
+ * 用缓存的参数代替 avformat_find_stream_info
+ * avformat_open_input 之后调用 文件没变并且打开后的流和缓存一致时才使用
+ * @param format_context
+ * @param path
+ * @param directory 缓存目录
+ * @return 使用了缓存返回 SUCCESS_CODE 需要正常探测返回 FAIL_CODE
+ */
+int stream_info_cache_load(AVFormatContext* format_context, const char* path, const char* directory);
+
+/**
+ * 保存 avformat_find_stream_info 探测出的参数
+ * 先写临时文件再重命名
+ * @param format_context
+ * @param path
+ * @param directory 缓存目录
+ * @return
+ */
+int stream_info_cache_save(AVFormatContext* format_context, const char* path, const char* directory);
+
+// 内存中的流参数
+// 一次探测的结果给同一个文件的多个解封装器使用 (缩略图的每个任务) 头部只使用流数量和时长等 不使用文件标识
+typedef struct _StreamInfo {
+    StreamInfoHeader header;
+    StreamInfoRecord records[STREAM_INFO_CACHE_MAX_STREAMS];
+    uint8_t* extradatas[STREAM_INFO_CACHE_MAX_STREAMS];
+} StreamInfo;
+
+/**
+ * 初始化内存中的流参数 (还没有参数)
+ * @param info
+ */
+void stream_info_init(StreamInfo* info);
+
+/**
+ * 从探测过的解封装器复制流参数
+ * @param format_context
+ * @param info
+ * @return 流太多不能保存返回 FAIL_CODE
+ */
+int stream_info_capture(AVFormatContext* format_context, StreamInfo* info);
+
+/**
+ * 用复制的流参数代替 avformat_find_stream_info
+ * avformat_open_input 之后调用 打开后的流和复制时一致才使用
+ * @param format_context
+ * @param info
+ * @return
+ */
+int stream_info_apply(AVFormatContext* format_context, StreamInfo* info);
+
+/**
+ * 释放内存中的流参数
+ * @param info
+ */
+void stream_info_destroy(StreamInfo* info);
+
+/**
+ * 打开文件并得到流参数 播放器和缩略图服务共用
+ * 流参数依次来自 shared (同一个文件已经探测过) 缓存目录 完整探测 快速启动时限制探测的数据量和时长
+ * 探测之后保存到缓存目录 shared 不为 NULL 时也复制到 shared
+ * @param format_context 为 NULL 时创建 需要自定义 IO 时调用者先创建并设置 pb 失败时由调用者关闭
+ * @param path
+ * @param fast_start
+ * @param directory 缓存目录 为 NULL 或者空字符串时不使用缓存
+ * @param shared 可以为 NULL
+ * @return
+ */
+int stream_info_open(AVFormatContext** format_context, const char* path, bool fast_start, const char* directory, StreamInfo* shared);
+
+#endif //PLAYER_STREAM_INFO_CACHE_H
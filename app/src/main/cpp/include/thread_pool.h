@@ -0,0 +1,191 @@
+#include <pthread.h>
+#include <atomic>
+
+#ifndef PLAYER_THREAD_POOL_H
+#define PLAYER_THREAD_POOL_H
+
+// 每个工作线程每个优先级的任务队列容量 (必须是 2 的幂)
+#define THREAD_POOL_DEQUE_SIZE 64
+
+// 任务优先级 先执行高优先级的任务
+// HIGH 前台播放器 NORMAL 后台 (预览) 播放器 LOW 缩略图等后台工作
+#define THREAD_POOL_PRIORITY_HIGH 0
+#define THREAD_POOL_PRIORITY_NORMAL 1
+#define THREAD_POOL_PRIORITY_LOW 2
+#define THREAD_POOL_PRIORITIES 3
+
+// 不在线程池中的专用线程 (解封装 渲染 音频) 按优先级对应的 nice 值
+#define THREAD_NICE_NORMAL 4
+#define THREAD_NICE_LOW 10
+
+// 循环任务每一步的结果
+// CONTINUE 还有事可做 重新提交 (先让高优先级的任务执行) IDLE 没有事可做 等待唤醒 FINISH 结束
+#define TASK_LOOP_CONTINUE 0
+#define TASK_LOOP_IDLE 1
+#define TASK_LOOP_FINISH 2
+
+struct _ThreadPool;
+
+// 任务组
+// 用于等待一批任务全部完成
+typedef struct _TaskGroup {
+    // 未完成的任务数
+    int pending;
+    // 提交到的线程池 等待时从中取出本组还没开始的任务自己执行
+    struct _ThreadPool* pool;
+    pthread_mutex_t mutex_id;
+    pthread_cond_t done_condition;
+} TaskGroup;
+
+// 任务
+typedef struct _Task {
+    void (*function)(void* arg);
+    void* arg;
+    TaskGroup* group;
+} Task;
+
+// 双端任务队列
+// 所属的工作线程从底部存取 (后进先出 数据还在缓存中) 其他工作线程从顶部窃取
+typedef struct _TaskDeque {
+    Task tasks[THREAD_POOL_DEQUE_SIZE];
+    unsigned int top;
+    unsigned int bottom;
+} TaskDeque;
+
+// 工作线程
+typedef struct _ThreadWorker {
+    struct _ThreadPool* pool;
+    int index;
+    pthread_t thread_id;
+    // 每个优先级一个队列
+    TaskDeque deques[THREAD_POOL_PRIORITIES];
+    pthread_mutex_t mutex_id;
+} ThreadWorker;
+
+// 线程池
+// 工作窃取 每个工作线程有自己的任务队列 自己的做完了从其他线程的队列窃取
+// 所有线程先找高优先级的任务 每个任务执行完才会调度下一个 不抢占
+// 在池中执行的有 视频解码 (循环任务 每步解几帧) 颜色转换分片 缩略图
+// 解封装 渲染和音频 (解码后直接阻塞写入输出) 仍是每个播放器的专用线程 后台播放器的专用线程调低 nice
+typedef struct _ThreadPool {
+    // 工作线程
+    ThreadWorker* workers;
+    int thread_count;
+    // 外部线程提交任务时轮流放入的工作线程
+    std::atomic<unsigned int> next_worker;
+    // 还没开始执行的任务数
+    int pending;
+    // 是否运行
+    bool is_running;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+    // 线程条件变量
+    pthread_cond_t* not_empty_condition;
+} ThreadPool;
+
+/**
+ * 初始化线程池
+ * @param pool
+ * @param thread_count
+ */
+void thread_pool_init(ThreadPool* pool, int thread_count);
+
+/**
+ * 获取进程共享的线程池
+ * 第一次调用时创建 线程数等于 CPU 核数 所有播放器和缩略图服务共用 不需要销毁
+ * @return
+ */
+ThreadPool* thread_pool_shared();
+
+/**
+ * 提交任务
+ * 在工作线程中提交时放入自己的队列 否则轮流放入各工作线程的队列
+ * 队列都满时由调用线程直接执行
+ * @param pool
+ * @param function
+ * @param arg
+ * @param group 可以为 NULL
+ * @param priority THREAD_POOL_PRIORITY_*
+ */
+void thread_pool_submit(ThreadPool* pool, void (*function)(void*), void* arg, TaskGroup* group, int priority);
+
+/**
+ * 销毁线程池
+ * 等待已提交的任务执行完
+ * @param pool
+ */
+void thread_pool_destroy(ThreadPool* pool);
+
+/**
+ * 初始化任务组
+ * @param group
+ */
+void task_group_init(TaskGroup* group);
+
+/**
+ * 等待任务组的任务全部完成
+ * 本组还在队列中的任务由调用线程取出执行 工作线程都被其他任务占用时也不会一直等待
+ * @param group
+ */
+void task_group_wait(TaskGroup* group);
+
+/**
+ * 销毁任务组
+ * @param group
+ */
+void task_group_destroy(TaskGroup* group);
+
+// 循环任务
+// 每次提交只执行一步 步与步之间工作线程可以先执行优先级更高的任务
+// 没有事可做时不占用工作线程 由数据的另一端调用 task_loop_wake 重新提交 同一时刻最多在一个工作线程中执行
+typedef struct _TaskLoop {
+    ThreadPool* pool;
+    int priority;
+    // 执行一步 返回 TASK_LOOP_*
+    int (*step)(void* arg);
+    void* arg;
+    // 调度状态
+    std::atomic<int> state;
+    pthread_mutex_t mutex_id;
+    pthread_cond_t finish_condition;
+} TaskLoop;
+
+/**
+ * 初始化循环任务
+ * @param loop
+ * @param pool
+ * @param step
+ * @param arg
+ * @param priority THREAD_POOL_PRIORITY_*
+ */
+void task_loop_init(TaskLoop* loop, ThreadPool* pool, int (*step)(void*), void* arg, int priority);
+
+/**
+ * 唤醒循环任务
+ * 没有在执行时提交下一步 正在执行时这一步结束后再执行一次 可以在任意线程调用
+ * 第一次调用开始执行
+ * @param loop
+ */
+void task_loop_wake(TaskLoop* loop);
+
+/**
+ * 等待循环任务结束 (某一步返回 TASK_LOOP_FINISH)
+ * @param loop
+ */
+void task_loop_wait(TaskLoop* loop);
+
+/**
+ * 销毁循环任务
+ * 需要已经结束
+ * @param loop
+ */
+void task_loop_destroy(TaskLoop* loop);
+
+/**
+ * 按任务优先级调整当前线程的 nice 值
+ * 用于不在线程池中的专用线程 HIGH 不调整
+ * @param priority THREAD_POOL_PRIORITY_*
+ */
+void thread_set_priority(int priority);
+
+#endif //PLAYER_THREAD_POOL_H
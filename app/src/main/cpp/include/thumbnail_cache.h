@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <pthread.h>
+
+#ifndef PLAYER_THUMBNAIL_CACHE_H
+#define PLAYER_THUMBNAIL_CACHE_H
+
+// 哈希桶数量 (必须是 2 的幂)
+#define THUMBNAIL_CACHE_BUCKETS 256
+
+// 缩略图 (RGBA 紧密排列)
+typedef struct _Thumbnail {
+    // 键 (文件, 时间, 尺寸)
+    char* path;
+    int64_t time;
+    int width;
+    int height;
+    uint64_t hash;
+    // 像素
+    uint8_t* pixels;
+    int size;
+    // LRU 链表 (头部最近使用)
+    struct _Thumbnail* prev;
+    struct _Thumbnail* next;
+    // 哈希桶链表
+    struct _Thumbnail* bucket_next;
+} Thumbnail;
+
+// 缩略图 LRU 缓存
+// 按像素字节数限制大小 超过时淘汰最久没有使用的
+typedef struct _ThumbnailCache {
+    Thumbnail* buckets[THUMBNAIL_CACHE_BUCKETS];
+    Thumbnail* head;
+    Thumbnail* tail;
+    int64_t bytes;
+    int64_t max_bytes;
+    // 命中和未命中次数
+    int64_t hits;
+    int64_t misses;
+    // 线程锁
+    pthread_mutex_t* mutex_id;
+} ThumbnailCache;
+
+/**
+ * 初始化缓存
+ * @param cache
+ * @param max_bytes 最多缓存的像素字节数
+ */
+void thumbnail_cache_init(ThumbnailCache* cache, int64_t max_bytes);
+
+/**
+ * 查找缩略图 找到时把像素拷贝到 dst
+ * @param cache
+ * @param path
+ * @param time 毫秒
+ * @param width
+ * @param height
+ * @param dst
+ * @param dst_linesize
+ * @return 找到返回 true
+ */
+bool thumbnail_cache_get(ThumbnailCache* cache, const char* path, int64_t time, int width, int height, uint8_t* dst, int dst_linesize);
+
+/**
+ * 放入缩略图 像素会被拷贝
+ * @param cache
+ * @param path
+ * @param time 毫秒
+ * @param width
+ * @param height
+ * @param pixels RGBA 紧密排列
+ */
+void thumbnail_cache_put(ThumbnailCache* cache, const char* path, int64_t time, int width, int height, const uint8_t* pixels);
+
+/**
+ * 清空缓存
+ * @param cache
+ */
+void thumbnail_cache_clear(ThumbnailCache* cache);
+
+/**
+ * 销毁缓存
+ * @param cache
+ */
+void thumbnail_cache_destroy(ThumbnailCache* cache);
+
+#endif //PLAYER_THUMBNAIL_CACHE_H
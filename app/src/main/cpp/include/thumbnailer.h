@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include "thread_pool.h"
+#include "thumbnail_cache.h"
+#include "stream_info_cache.h"
+
+#ifndef PLAYER_THUMBNAILER_H
+#define PLAYER_THUMBNAILER_H
+
+// 送入关键帧之后 最多再送多少个数据等待解码器输出 (解码器有重排序延迟时)
+#define THUMBNAIL_MAX_PACKETS 256
+// 一段最多处理的请求数 每段完成后工作线程可以去执行优先级更高的任务
+#define THUMBNAIL_JOB_MAX_REQUESTS 8
+
+// 缩略图请求
+typedef struct _ThumbnailRequest {
+    // 时间 (毫秒)
+    int64_t time;
+    // 输出 RGBA
+    uint8_t* dst;
+    int dst_linesize;
+    int width;
+    int height;
+    // 是否成功
+    bool done;
+} ThumbnailRequest;
+
+struct _Thumbnailer;
+
+// 一个批次中时间连续的一段 由一个工作线程处理 共用一个解封装器和解码器
+typedef struct _ThumbnailJob {
+    struct _Thumbnailer* thumbnailer;
+    const char* path;
+    // 批次开始时已经打开的解封装器 只交给第一段 其他段用 stream_info 打开 不再探测
+    AVFormatContext* format_context;
+    StreamInfo* stream_info;
+    // 按时间升序
+    ThumbnailRequest** requests;
+    int count;
+} ThumbnailJob;
+
+// 缩略图服务
+// 独立于播放器 每个任务打开自己的解封装器 只解码关键帧 (skip_frame + lowres) 缩放到请求的尺寸
+// 和播放器一样用 stream_info_open 打开 (快速启动的探测限制和探测结果缓存) 一批请求只探测一次
+// 在进程共享的线程池中以低优先级并行生成 结果放入 LRU 缓存
+typedef struct _Thumbnailer {
+    // 一批请求最少分成的段数
+    int thread_count;
+    ThumbnailCache cache;
+    // 探测结果缓存目录 空字符串不缓存
+    char stream_info_cache_dir[256];
+} Thumbnailer;
+
+/**
+ * 初始化缩略图服务
+ * @param thumbnailer
+ * @param thread_count 并行的段数 0 表示共享线程池的线程数
+ * @param cache_bytes 缓存的像素字节数
+ * @param stream_info_cache_dir 探测结果缓存目录 可以为 NULL
+ */
+void thumbnailer_init(Thumbnailer* thumbnailer, int thread_count, int64_t cache_bytes, const char* stream_info_cache_dir);
+
+/**
+ * 生成一批缩略图 (阻塞)
+ * 先查缓存 没有命中的按时间排序后分段并行生成 文件只探测一次
+ * @param thumbnailer
+ * @param path
+ * @param requests
+ * @param count
+ * @return 成功的数量
+ */
+int thumbnailer_get(Thumbnailer* thumbnailer, const char* path, ThumbnailRequest* requests, int count);
+
+/**
+ * 销毁缩略图服务
+ * @param thumbnailer
+ */
+void thumbnailer_destroy(Thumbnailer* thumbnailer);
+
+#endif //PLAYER_THUMBNAILER_H
@@ -0,0 +1,42 @@
+#ifdef __ANDROID__
+#include <android/log.h>
+#else
+#include <stdio.h>
+#endif
+
+#include <stdint.h>
+
+#ifndef PLAYER_UTIL_H
+#define PLAYER_UTIL_H
+
+#ifdef __ANDROID__
+// Android 打印 Log
+#define LOGE(FORMAT,...) __android_log_print(ANDROID_LOG_ERROR, "player", FORMAT, ##__VA_ARGS__);
+#else
+// 没有 Android 环境时打印到标准错误
+#define LOGE(FORMAT,...) fprintf(stderr, "player: " FORMAT "\n", ##__VA_ARGS__);
+#endif
+
+// 状态码
+#define SUCCESS_CODE 1
+#define FAIL_CODE -1
+
+// FNV-1a 哈希
+#define HASH_OFFSET_BASIS 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+/**
+ * 错误打印
+ * @param err
+ */
+void print_error(int err);
+
+/**
+ * 字符串哈希 (FNV-1a)
+ * 用于由文件路径生成缓存文件名和缓存的键
+ * @param value
+ * @return
+ */
+uint64_t string_hash(const char* value);
+
+#endif //PLAYER_UTIL_H
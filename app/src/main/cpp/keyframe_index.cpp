@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "keyframe_index.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/avstring.h"
+}
+
+/**
+ * 容器是否需要关键帧索引
+ * @param format_context
+ * @return
+ */
+bool keyframe_index_is_needed(AVFormatContext* format_context) {
+    AVInputFormat *format = format_context->iformat;
+    if (format == NULL || (format->flags & AVFMT_NO_BYTE_SEEK)) {
+        return false;
+    }
+    return av_match_name(format->name, KEYFRAME_INDEX_FORMATS) != 0;
+}
+
+/**
+ * 加载索引文件
+ * 完整的索引直接 mmap 使用 不完整的拷贝出来继续记录
+ * @param index
+ */
+static void keyframe_index_load(KeyframeIndex* index) {
+    int fd = open(index->index_path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t) sizeof(KeyframeIndexHeader)) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t) info.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+    KeyframeIndexHeader *header = (KeyframeIndexHeader*) mapped;
+    if (memcmp(header->magic, KEYFRAME_INDEX_MAGIC, 4) != 0 || header->version != KEYFRAME_INDEX_VERSION
+        || header->file_size != index->file_size || header->file_mtime != index->file_mtime
+        || header->count < 0 || size != sizeof(KeyframeIndexHeader) + header->count * sizeof(KeyframeEntry)) {
+        // 视频文件已经变了或者索引损坏 重新建立
+        LOGE("Player Log : keyframe index %s is stale", index->index_path);
+        munmap(mapped, size);
+        return;
+    }
+    KeyframeEntry *entries = (KeyframeEntry*) ((uint8_t*) mapped + sizeof(KeyframeIndexHeader));
+    if (header->complete) {
+        index->mapped = mapped;
+        index->mapped_size = size;
+        index->entries = entries;
+        index->count = header->count;
+        index->capacity = header->count;
+        index->complete = true;
+    } else if (header->count > 0) {
+        index->capacity = FFMAX(header->count * 2, KEYFRAME_INDEX_INIT_CAPACITY);
+        index->entries = (KeyframeEntry*) malloc(index->capacity * sizeof(KeyframeEntry));
+        memcpy(index->entries, entries, header->count * sizeof(KeyframeEntry));
+        index->count = header->count;
+        munmap(mapped, size);
+    } else {
+        munmap(mapped, size);
+    }
+    LOGE("Player Log : keyframe index loaded %lld entries complete %d", (long long) index->count, index->complete);
+}
+
+/**
+ * 初始化索引
+ * @param index
+ * @param path
+ * @param directory
+ * @return
+ */
+int keyframe_index_init(KeyframeIndex* index, const char* path, const char* directory) {
+    memset((void*) index, 0, sizeof(KeyframeIndex));
+    struct stat info;
+    if (stat(path, &info) < 0 || !S_ISREG(info.st_mode)) {
+        return FAIL_CODE;
+    }
+    index->path = strdup(path);
+    index->index_path = (char*) malloc(strlen(directory) + 32);
+    sprintf(index->index_path, "%s/%016llx%s", directory, (unsigned long long) string_hash(path), KEYFRAME_INDEX_SUFFIX);
+    index->file_size = info.st_size;
+    index->file_mtime = info.st_mtime;
+    index->scan_abort.store(false);
+    index->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(index->mutex_id, NULL);
+    keyframe_index_load(index);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 插入一个关键帧 保持按 pts 升序
+ * 播放时顺序读取 大多数情况直接追加在末尾
+ * 前一个记录是同一个读取者上一次记录的关键帧时 标记为连续
+ * @param index
+ * @param entry
+ * @param previous_pts
+ */
+static void keyframe_index_insert(KeyframeIndex* index, KeyframeEntry* entry, int64_t previous_pts) {
+    int64_t low = 0, high = index->count;
+    if (high > 0 && index->entries[high - 1].pts < entry->pts) {
+        low = high;
+    }
+    while (low < high) {
+        int64_t middle = (low + high) / 2;
+        if (index->entries[middle].pts < entry->pts) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    bool contiguous = previous_pts != AV_NOPTS_VALUE && low > 0 && index->entries[low - 1].pts == previous_pts;
+    if (low < index->count && index->entries[low].pts == entry->pts) {
+        // 快进/快退后重复读到的关键帧 连续读到这里时把两段记录连起来
+        if (contiguous && !(index->entries[low].flags & KEYFRAME_ENTRY_CONTIGUOUS)) {
+            index->entries[low].flags |= KEYFRAME_ENTRY_CONTIGUOUS;
+            index->dirty = true;
+        }
+        return;
+    }
+    entry->flags = contiguous ? KEYFRAME_ENTRY_CONTIGUOUS : 0;
+    if (index->count == index->capacity) {
+        index->capacity = index->capacity > 0 ? index->capacity * 2 : KEYFRAME_INDEX_INIT_CAPACITY;
+        index->entries = (KeyframeEntry*) realloc(index->entries, index->capacity * sizeof(KeyframeEntry));
+    }
+    memmove(index->entries + low + 1, index->entries + low, (index->count - low) * sizeof(KeyframeEntry));
+    index->entries[low] = *entry;
+    index->count += 1;
+    index->dirty = true;
+}
+
+/**
+ * 记录一个关键帧
+ * @param index
+ * @param packet
+ * @param stream
+ * @param previous_pts
+ */
+void keyframe_index_add_packet(KeyframeIndex* index, AVPacket* packet, AVStream* stream, int64_t* previous_pts) {
+    if (!(packet->flags & AV_PKT_FLAG_KEY) || packet->pos < 0) {
+        return;
+    }
+    int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (pts == AV_NOPTS_VALUE) {
+        return;
+    }
+    KeyframeEntry entry;
+    entry.pts = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+    entry.pos = packet->pos;
+    entry.size = packet->size;
+    entry.flags = 0;
+    pthread_mutex_lock(index->mutex_id);
+    if (!index->complete) {
+        keyframe_index_insert(index, &entry, *previous_pts);
+    }
+    pthread_mutex_unlock(index->mutex_id);
+    *previous_pts = entry.pts;
+}
+
+/**
+ * 查找不晚于 target 的最后一个关键帧
+ * @param index
+ * @param target
+ * @param entry
+ * @return
+ */
+bool keyframe_index_lookup(KeyframeIndex* index, int64_t target, KeyframeEntry* entry) {
+    pthread_mutex_lock(index->mutex_id);
+    // 第一个晚于 target 的关键帧
+    int64_t low = 0, high = index->count;
+    while (low < high) {
+        int64_t middle = (low + high) / 2;
+        if (index->entries[middle].pts <= target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    // 不完整的索引 找到的记录和下一个记录之间可能还有没记录的关键帧 (播放时跳过的部分)
+    // 下一个记录和它连续时才能确定它是 target 之前最后一个关键帧
+    bool found = low > 0 && (index->complete ||
+                             (low < index->count && (index->entries[low].flags & KEYFRAME_ENTRY_CONTIGUOUS)));
+    if (found) {
+        *entry = index->entries[low - 1];
+    }
+    pthread_mutex_unlock(index->mutex_id);
+    return found;
+}
+
+/**
+ * 扫描的中断回调
+ * @param opaque
+ * @return
+ */
+static int keyframe_index_interrupt(void* opaque) {
+    KeyframeIndex *index = (KeyframeIndex*) opaque;
+    return index->scan_abort.load() ? 1 : 0;
+}
+
+/**
+ * 后台扫描函数
+ * 只读取视频流 其他流全部丢弃
+ * @param arg
+ * @return
+ */
+static void* keyframe_index_scan(void* arg) {
+    KeyframeIndex *index = (KeyframeIndex*) arg;
+    AVFormatContext *format_context = avformat_alloc_context();
+    format_context->interrupt_callback.callback = keyframe_index_interrupt;
+    format_context->interrupt_callback.opaque = index;
+    if (avformat_open_input(&format_context, index->path, NULL, NULL) < 0) {
+        LOGE("Player Error : Keyframe index can not open %s", index->path);
+        return NULL;
+    }
+    int stream_index = -1;
+    if (avformat_find_stream_info(format_context, NULL) >= 0) {
+        stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    }
+    if (stream_index >= 0) {
+        for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+            if ((int) i != stream_index) {
+                format_context->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        AVStream *stream = format_context->streams[stream_index];
+        AVPacket *packet = av_packet_alloc();
+        int64_t previous_pts = AV_NOPTS_VALUE;
+        int result;
+        while ((result = av_read_frame(format_context, packet)) >= 0) {
+            if (packet->stream_index == stream_index) {
+                keyframe_index_add_packet(index, packet, stream, &previous_pts);
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        if (result == AVERROR_EOF) {
+            pthread_mutex_lock(index->mutex_id);
+            index->complete = true;
+            index->dirty = true;
+            pthread_mutex_unlock(index->mutex_id);
+            LOGE("Player Log : keyframe index scan finish %lld entries", (long long) index->count);
+            keyframe_index_save(index);
+        }
+    }
+    avformat_close_input(&format_context);
+    return NULL;
+}
+
+/**
+ * 开始后台扫描整个文件
+ * @param index
+ */
+void keyframe_index_start_scan(KeyframeIndex* index) {
+    if (index->complete || index->is_scanning) {
+        return;
+    }
+    index->is_scanning = pthread_create(&(index->scan_id), NULL, keyframe_index_scan, index) == 0;
+}
+
+/**
+ * 保存索引文件
+ * @param index
+ * @return
+ */
+int keyframe_index_save(KeyframeIndex* index) {
+    pthread_mutex_lock(index->mutex_id);
+    if (!index->dirty) {
+        pthread_mutex_unlock(index->mutex_id);
+        return SUCCESS_CODE;
+    }
+    size_t length = strlen(index->index_path);
+    char *temp_path = (char*) malloc(length + 5);
+    memcpy(temp_path, index->index_path, length);
+    memcpy(temp_path + length, ".tmp", 5);
+    int result = FAIL_CODE;
+    FILE *file = fopen(temp_path, "wb");
+    if (file != NULL) {
+        KeyframeIndexHeader header;
+        memset(&header, 0, sizeof(KeyframeIndexHeader));
+        memcpy(header.magic, KEYFRAME_INDEX_MAGIC, 4);
+        header.version = KEYFRAME_INDEX_VERSION;
+        header.file_size = index->file_size;
+        header.file_mtime = index->file_mtime;
+        header.count = index->count;
+        header.complete = index->complete ? 1 : 0;
+        bool written = fwrite(&header, sizeof(KeyframeIndexHeader), 1, file) == 1
+                       && fwrite(index->entries, sizeof(KeyframeEntry), (size_t) index->count, file) == (size_t) index->count;
+        if (fclose(file) == 0 && written && rename(temp_path, index->index_path) == 0) {
+            index->dirty = false;
+            result = SUCCESS_CODE;
+        } else {
+            unlink(temp_path);
+        }
+    }
+    if (result != SUCCESS_CODE) {
+        LOGE("Player Error : Can not save keyframe index %s", index->index_path);
+    }
+    free(temp_path);
+    pthread_mutex_unlock(index->mutex_id);
+    return result;
+}
+
+/**
+ * 销毁索引
+ * @param index
+ */
+void keyframe_index_destroy(KeyframeIndex* index) {
+    if (index->mutex_id == NULL) {
+        return;
+    }
+    index->scan_abort.store(true);
+    if (index->is_scanning) {
+        pthread_join(index->scan_id, NULL);
+        index->is_scanning = false;
+    }
+    keyframe_index_save(index);
+    if (index->mapped != NULL) {
+        munmap(index->mapped, index->mapped_size);
+    } else {
+        free(index->entries);
+    }
+    index->entries = NULL;
+    free(index->path);
+    free(index->index_path);
+    pthread_mutex_destroy(index->mutex_id);
+    free(index->mutex_id);
+    index->mutex_id = NULL;
+}
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "mapped_io.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/mem.h"
+#include "libavutil/common.h"
+}
+
+/**
+ * 按读取位置提示内核
+ * 前面 MAPPED_IO_READ_AHEAD 预读 (WILLNEED) 后面超过 MAPPED_IO_KEEP_BEHIND 的回收 (DONTNEED)
+ * @param io
+ */
+static void mapped_io_advise(MappedIO* io) {
+    int64_t page_mask = (int64_t) io->page_size - 1;
+    if (io->position + MAPPED_IO_READ_AHEAD / 2 > io->advised_end) {
+        int64_t start = io->position & ~page_mask;
+        int64_t end = FFMIN(io->position + MAPPED_IO_READ_AHEAD, io->size);
+        if (end > start) {
+            madvise(io->data + start, (size_t) (end - start), MADV_WILLNEED);
+        }
+        io->advised_end = end;
+    }
+    int64_t release_end = (io->position - MAPPED_IO_KEEP_BEHIND) & ~page_mask;
+    if (release_end > io->released_end + MAPPED_IO_KEEP_BEHIND) {
+        madvise(io->data + io->released_end, (size_t) (release_end - io->released_end), MADV_DONTNEED);
+        io->released_end = release_end;
+    }
+}
+
+/**
+ * AVIOContext 读取回调
+ * @param opaque
+ * @param buf
+ * @param buf_size
+ * @return
+ */
+static int mapped_io_read(void* opaque, uint8_t* buf, int buf_size) {
+    MappedIO *io = (MappedIO*) opaque;
+    if (io->position >= io->size) {
+        return AVERROR_EOF;
+    }
+    int size = (int) FFMIN((int64_t) buf_size, io->size - io->position);
+    memcpy(buf, io->data + io->position, (size_t) size);
+    io->position += size;
+    mapped_io_advise(io);
+    return size;
+}
+
+/**
+ * AVIOContext seek 回调
+ * @param opaque
+ * @param offset
+ * @param whence
+ * @return
+ */
+static int64_t mapped_io_seek(void* opaque, int64_t offset, int whence) {
+    MappedIO *io = (MappedIO*) opaque;
+    whence &= ~AVSEEK_FORCE;
+    int64_t position;
+    if (whence == AVSEEK_SIZE) {
+        return io->size;
+    } else if (whence == SEEK_SET) {
+        position = offset;
+    } else if (whence == SEEK_CUR) {
+        position = io->position + offset;
+    } else if (whence == SEEK_END) {
+        position = io->size + offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+    if (position < 0) {
+        return AVERROR(EINVAL);
+    }
+    if (position < io->released_end || position > io->advised_end) {
+        // 跳出了预读范围 从新位置重新提示
+        io->advised_end = position;
+        io->released_end = FFMIN(io->released_end, position & ~((int64_t) io->page_size - 1));
+    }
+    io->position = position;
+    mapped_io_advise(io);
+    return position;
+}
+
+/**
+ * 映射本地文件
+ * @param io
+ * @param path
+ * @return
+ */
+int mapped_io_open(MappedIO* io, const char* path) {
+    memset((void*) io, 0, sizeof(MappedIO));
+    if (strncmp(path, "file:", 5) == 0) {
+        path += 5;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return FAIL_CODE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size <= 0 || (uint64_t) info.st_size > SIZE_MAX) {
+        close(fd);
+        return FAIL_CODE;
+    }
+    void *data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // 映射建立后可以关闭文件
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOGE("Player Log : Can not mmap %s, size %lld", path, (long long) info.st_size);
+        return FAIL_CODE;
+    }
+    io->data = (uint8_t*) data;
+    io->size = info.st_size;
+    io->page_size = (size_t) sysconf(_SC_PAGESIZE);
+    madvise(io->data, (size_t) io->size, MADV_SEQUENTIAL);
+    mapped_io_advise(io);
+    uint8_t *avio_buffer = (uint8_t*) av_malloc(MAPPED_IO_AVIO_BUFFER_SIZE);
+    io->avio = avio_alloc_context(avio_buffer, MAPPED_IO_AVIO_BUFFER_SIZE, 0, io, mapped_io_read, NULL, mapped_io_seek);
+    io->avio->seekable = AVIO_SEEKABLE_NORMAL;
+    // 大块读取 (数据包) 绕过 AVIO 缓冲区 直接从映射区拷贝到数据包
+    io->avio->direct = 1;
+    return SUCCESS_CODE;
+}
+
+/**
+ * 解除映射并释放
+ * @param io
+ */
+void mapped_io_close(MappedIO* io) {
+    if (io->avio != NULL) {
+        av_freep(&(io->avio->buffer));
+        av_freep(&(io->avio));
+    }
+    if (io->data != NULL) {
+        munmap(io->data, (size_t) io->size);
+        io->data = NULL;
+    }
+}
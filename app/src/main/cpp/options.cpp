@@ -0,0 +1,159 @@
+#include <string.h>
+#include "options.h"
+
+/**
+ * 初始化为默认配置
+ * @param options
+ */
+void options_init(PlayerOptions* options) {
+    // 视频按字节限制内存 4K 也不会无限增长
+    options->video_queue_limit.max_bytes = 16 * 1024 * 1024;
+    options->video_queue_limit.min_bytes = 8 * 1024 * 1024;
+    options->video_queue_limit.max_duration = 5000;
+    options->video_queue_limit.min_duration = 2500;
+    // 音频按时长保证足够的预读 扛住 IO 卡顿
+    options->audio_queue_limit.max_bytes = 2 * 1024 * 1024;
+    options->audio_queue_limit.min_bytes = 1024 * 1024;
+    options->audio_queue_limit.max_duration = 10000;
+    options->audio_queue_limit.min_duration = 5000;
+    options->video_threading.thread_count = 0;
+    options->video_threading.thread_type = DECODER_THREAD_AUTO;
+    options->video_threading.low_latency = false;
+    options->video_threading.overrides[0] = '\0';
+    options->hardware_decode = true;
+    options->hardware_render = false;
+    options->yuv_render = true;
+    options->convert_threads = 0;
+    options->audio_sink = AUDIO_SINK_OPENSL;
+    options->audio_dump_path[0] = '\0';
+    options->audio_sample_rate = 0;
+    options->audio_frames_per_burst = 0;
+    options->sync_master = CLOCK_MASTER_AUDIO;
+    options->frame_drop = true;
+    options->keyframe_index_dir[0] = '\0';
+    options->keyframe_index_scan = false;
+    options->io_prefetch_bytes = 4 * 1024 * 1024;
+    options->io_mmap = true;
+    options->fast_start = false;
+    options->stream_info_cache_dir[0] = '\0';
+    options->priority = THREAD_POOL_PRIORITY_HIGH;
+    options->preload_bytes = 2 * 1024 * 1024;
+    options->preload_first_frame = true;
+}
+
+/**
+ * 读取 Java long 字段
+ * @param env
+ * @param object
+ * @param name
+ * @return
+ */
+static int64_t get_long_field(JNIEnv* env, jobject object, const char* name) {
+    jclass clazz = env->GetObjectClass(object);
+    jfieldID field_id = env->GetFieldID(clazz, name, "J");
+    env->DeleteLocalRef(clazz);
+    return env->GetLongField(object, field_id);
+}
+
+/**
+ * 读取 Java int 字段
+ * @param env
+ * @param object
+ * @param name
+ * @return
+ */
+static int get_int_field(JNIEnv* env, jobject object, const char* name) {
+    jclass clazz = env->GetObjectClass(object);
+    jfieldID field_id = env->GetFieldID(clazz, name, "I");
+    env->DeleteLocalRef(clazz);
+    return env->GetIntField(object, field_id);
+}
+
+/**
+ * 读取 Java boolean 字段
+ * @param env
+ * @param object
+ * @param name
+ * @return
+ */
+static bool get_boolean_field(JNIEnv* env, jobject object, const char* name) {
+    jclass clazz = env->GetObjectClass(object);
+    jfieldID field_id = env->GetFieldID(clazz, name, "Z");
+    env->DeleteLocalRef(clazz);
+    return env->GetBooleanField(object, field_id) == JNI_TRUE;
+}
+
+/**
+ * 读取 Java String 字段 拷贝到 buffer 中
+ * @param env
+ * @param object
+ * @param name
+ * @param buffer
+ * @param size
+ */
+static void get_string_field(JNIEnv* env, jobject object, const char* name, char* buffer, size_t size) {
+    jclass clazz = env->GetObjectClass(object);
+    jfieldID field_id = env->GetFieldID(clazz, name, "Ljava/lang/String;");
+    env->DeleteLocalRef(clazz);
+    jstring value = (jstring) env->GetObjectField(object, field_id);
+    buffer[0] = '\0';
+    if (value == NULL) {
+        return;
+    }
+    const char *chars = env->GetStringUTFChars(value, 0);
+    strncpy(buffer, chars, size - 1);
+    buffer[size - 1] = '\0';
+    env->ReleaseStringUTFChars(value, chars);
+    env->DeleteLocalRef(value);
+}
+
+/**
+ * 读取 Java 层配置
+ * @param options
+ * @param env
+ * @param java_options
+ */
+void options_from_java(PlayerOptions* options, JNIEnv* env, jobject java_options) {
+    options_init(options);
+    if (java_options == NULL) {
+        return;
+    }
+    options->video_queue_limit.max_bytes = get_long_field(env, java_options, "videoQueueMaxBytes");
+    options->video_queue_limit.min_bytes = get_long_field(env, java_options, "videoQueueMinBytes");
+    options->video_queue_limit.max_duration = get_long_field(env, java_options, "videoQueueMaxMs");
+    options->video_queue_limit.min_duration = get_long_field(env, java_options, "videoQueueMinMs");
+    options->audio_queue_limit.max_bytes = get_long_field(env, java_options, "audioQueueMaxBytes");
+    options->audio_queue_limit.min_bytes = get_long_field(env, java_options, "audioQueueMinBytes");
+    options->audio_queue_limit.max_duration = get_long_field(env, java_options, "audioQueueMaxMs");
+    options->audio_queue_limit.min_duration = get_long_field(env, java_options, "audioQueueMinMs");
+    options->video_threading.thread_count = get_int_field(env, java_options, "decoderThreads");
+    options->video_threading.thread_type = get_int_field(env, java_options, "decoderThreadType");
+    options->video_threading.low_latency = get_boolean_field(env, java_options, "lowLatency");
+    get_string_field(env, java_options, "decoderThreadOverrides",
+                     options->video_threading.overrides, sizeof(options->video_threading.overrides));
+    options->hardware_decode = get_boolean_field(env, java_options, "hardwareDecode");
+    options->hardware_render = get_boolean_field(env, java_options, "hardwareRender");
+    options->yuv_render = get_boolean_field(env, java_options, "yuvRender");
+    options->convert_threads = get_int_field(env, java_options, "convertThreads");
+    options->audio_sink = get_int_field(env, java_options, "audioSink");
+    get_string_field(env, java_options, "audioDumpPath", options->audio_dump_path, sizeof(options->audio_dump_path));
+    options->audio_sample_rate = get_int_field(env, java_options, "audioSampleRate");
+    options->audio_frames_per_burst = get_int_field(env, java_options, "audioFramesPerBurst");
+    options->sync_master = get_int_field(env, java_options, "syncMaster");
+    options->frame_drop = get_boolean_field(env, java_options, "frameDrop");
+    get_string_field(env, java_options, "keyframeIndexDir", options->keyframe_index_dir, sizeof(options->keyframe_index_dir));
+    options->keyframe_index_scan = get_boolean_field(env, java_options, "keyframeIndexScan");
+    options->io_prefetch_bytes = get_int_field(env, java_options, "ioPrefetchBytes");
+    options->io_mmap = get_boolean_field(env, java_options, "ioMmap");
+    options->fast_start = get_boolean_field(env, java_options, "fastStart");
+    get_string_field(env, java_options, "streamInfoCacheDir", options->stream_info_cache_dir, sizeof(options->stream_info_cache_dir));
+    options->preload_bytes = get_int_field(env, java_options, "preloadBytes");
+    options->preload_first_frame = get_boolean_field(env, java_options, "preloadFirstFrame");
+    if (get_int_field(env, java_options, "priority") == PLAYER_PRIORITY_BACKGROUND) {
+        options->priority = THREAD_POOL_PRIORITY_NORMAL;
+        // 后台播放器 (多路预览) 默认单线程解码 避免 FFmpeg 内部线程过多
+        if (options->video_threading.thread_count <= 0) {
+            options->video_threading.thread_count = 1;
+        }
+    }
+}
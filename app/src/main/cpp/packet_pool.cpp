@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include "packet_pool.h"
+
+/**
+ * 初始化数据池
+ * @param pool
+ */
+void packet_pool_init(PacketPool* pool) {
+    for (int i = 0; i < PACKET_POOL_INIT_SIZE; i++) {
+        pool->packets[i] = av_packet_alloc();
+    }
+    pool->size = PACKET_POOL_INIT_SIZE;
+    pool->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(pool->mutex_id, NULL);
+}
+
+/**
+ * 取出一个空的数据
+ * @param pool
+ * @return
+ */
+AVPacket* packet_pool_get(PacketPool* pool) {
+    AVPacket *packet = NULL;
+    pthread_mutex_lock(pool->mutex_id);
+    if (pool->size > 0) {
+        pool->size -= 1;
+        packet = pool->packets[pool->size];
+    }
+    pthread_mutex_unlock(pool->mutex_id);
+    if (packet == NULL) {
+        packet = av_packet_alloc();
+    }
+    return packet;
+}
+
+/**
+ * 回收数据
+ * @param pool
+ * @param packet
+ */
+void packet_pool_release(PacketPool* pool, AVPacket** packet) {
+    if (*packet == NULL) {
+        return;
+    }
+    if (pool == NULL) {
+        av_packet_free(packet);
+        return;
+    }
+    // 在锁外释放数据引用 锁内只做入栈
+    av_packet_unref(*packet);
+    pthread_mutex_lock(pool->mutex_id);
+    if (pool->size < PACKET_POOL_MAX_SIZE) {
+        pool->packets[pool->size] = *packet;
+        pool->size += 1;
+        *packet = NULL;
+    }
+    pthread_mutex_unlock(pool->mutex_id);
+    if (*packet != NULL) {
+        av_packet_free(packet);
+    }
+}
+
+/**
+ * 销毁数据池
+ * @param pool
+ */
+void packet_pool_destroy(PacketPool* pool) {
+    for (int i = 0; i < pool->size; i++) {
+        av_packet_free(&(pool->packets[i]));
+    }
+    pool->size = 0;
+    pthread_mutex_destroy(pool->mutex_id);
+    free(pool->mutex_id);
+}
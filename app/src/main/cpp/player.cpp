@@ -1,10 +1,28 @@
 #include <jni.h>
 #include <android/native_window.h>
 #include <android/native_window_jni.h>
+#include <android/bitmap.h>
 #include <android/log.h>
 #include <pthread.h>
 #include <unistd.h>
 #include "queue.h"
+#include "options.h"
+#include "frame_queue.h"
+#include "decoder.h"
+#include "util.h"
+#include "color_convert.h"
+#include "thread_pool.h"
+#include "packet_pool.h"
+#include "audio_sink.h"
+#include "clock.h"
+#include "frame_drop.h"
+#include "seek_command.h"
+#include "keyframe_index.h"
+#include "thumbnailer.h"
+#include "prefetch_io.h"
+#include "mapped_io.h"
+#include "stream_info_cache.h"
+#include "preloader.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -12,23 +30,10 @@ extern "C" {
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 #include "libavutil/imgutils.h"
-}
-
-// Android 打印 Log
-#define LOGE(FORMAT,...) __android_log_print(ANDROID_LOG_ERROR, "player", FORMAT, ##__VA_ARGS__);
-
-/**
- * 错误打印
- * @param filename
- * @param err
- */
-void print_error(int err) {
-    char err_buf[128];
-    const char *err_buf_ptr = err_buf;
-    if (av_strerror(err, err_buf, sizeof(err_buf_ptr)) < 0) {
-        err_buf_ptr = strerror(AVUNERROR(err));
-    }
-    LOGE("ffmpeg error descript : %s", err_buf_ptr);
+#include "libavcodec/jni.h"
+#include "libavcodec/mediacodec.h"
+#include "libavutil/cpu.h"
+#include "libavutil/time.h"
 }
 
 /**
@@ -315,10 +320,6 @@ Java_com_johan_player_Player_playAudio(JNIEnv *env, jobject instance, jstring pa
     env->ReleaseStringUTFChars(path_, path);
 }
 
-// 状态码
-#define SUCCESS_CODE 1
-#define FAIL_CODE -1
-
 // C 层播放器结构体
 typedef struct _Player {
     // Env
@@ -327,57 +328,176 @@ typedef struct _Player {
     jobject instance;
     jobject surface;
     jobject callback;
+    // 配置
+    PlayerOptions options;
     // 上下文
     AVFormatContext *format_context;
+    // 打开文件的耗时 (微秒)
+    int64_t open_time;
+    // 内存映射 IO 和预读 IO 最多使用一个 不使用时为 NULL
+    MappedIO *mapped_io;
+    PrefetchIO *prefetch_io;
+    // 音视频队列共用的数据池
+    PacketPool *packet_pool;
     // 视频相关
     int video_stream_index;
-    AVCodecContext *video_codec_context;
     ANativeWindow *native_window;
     ANativeWindow_Buffer window_buffer;
-    uint8_t *video_out_buffer;
-    struct SwsContext *sws_context;
-    AVFrame *rgba_frame;
+    // 当前窗口缓冲区的格式和宽高 帧变化时重新设置
+    int window_format;
+    int window_width;
+    int window_height;
+    ColorConverter color_converter;
     Queue *video_queue;
+    Decoder video_decoder;
+    FrameQueue *video_frame_queue;
+    FrameDropper frame_dropper;
     // 音频相关
     int audio_stream_index;
-    AVCodecContext *audio_codec_context;
     uint8_t *audio_out_buffer;
+    unsigned int audio_out_buffer_size;
     struct SwrContext *swr_context;
     int out_channels;
-    jmethodID play_audio_track_method_id;
+    AudioSink audio_sink;
     Queue *audio_queue;
-    double audio_clock;
+    Decoder audio_decoder;
+    // 线程
+    pthread_t produce_id;
+    pthread_t video_render_id;
+    pthread_t audio_consume_id;
+    // 视频解码 在共享线程池中按播放器的优先级执行
+    TaskLoop video_decode_loop;
+    AVFrame* video_decode_frame;
+    // 还在运行的解码数 (视频解码任务和音频线程) 都结束后关闭快进/快退命令通道
+    std::atomic<int> running_decoders;
+    // 时钟
+    Clock audio_clock;
+    Clock video_clock;
+    Clock external_clock;
+    // 快进/快退命令 Java 线程投递 生产线程处理
+    SeekCommand seek_command;
+    // 关键帧索引 不需要时为 NULL
+    KeyframeIndex* keyframe_index;
+    // 生产线程上一次记录的关键帧 快进/快退后重置
+    int64_t keyframe_previous_pts;
+    // 最近一次快进/快退的序号和精确定位的目标 (AV_TIME_BASE) 不精确定位时为 AV_NOPTS_VALUE
+    std::atomic<int> seek_serial;
+    // 拖动预览的序号和已经显示预览帧的序号
+    std::atomic<int> preview_serial;
+    std::atomic<int> preview_shown_serial;
+    std::atomic<int64_t> seek_accurate_target;
+    std::atomic<int64_t> seek_start_time;
+    // 快进/快退统计 耗时为请求到第一帧显示 (微秒)
+    std::atomic<int64_t> seek_count;
+    std::atomic<int64_t> seek_latency;
+    // 队列 时钟等播放状态是否已经准备好 (预加载时提前准备)
+    bool is_prepared;
+    // 是否由预加载的会话开始播放
+    bool is_preloaded;
+    // 调用播放的时刻和到第一帧显示的耗时 (微秒)
+    int64_t play_time;
+    std::atomic<int64_t> first_frame_latency;
 } Player;
 
-// 消费载体
-typedef struct _Consumer {
-    Player* player;
-    int stream_index;
-} Consumer;
+// Native Window YV12 格式 (HAL_PIXEL_FORMAT_YV12)
+// YUV420P 的帧可以直接拷贝平面 不需要转换成 RGBA
+#define WINDOW_FORMAT_YV12 0x32315659
 
-// 播放器
-Player *cplayer;
+// 预加载解出第一帧时 最多送入解码器的数据数
+#define PRELOAD_MAX_DECODE_PACKETS 64
+
+// 视频解码任务每一步最多解出的帧数 之后让出工作线程
+#define VIDEO_DECODE_BATCH_FRAMES 4
+
+/**
+ * 获取 Java 对象中保存 C 层对象的字段 (Player / Preloader 的 nativeHandle)
+ * @param env
+ * @param instance
+ * @return
+ */
+static jfieldID get_handle_field(JNIEnv *env, jobject instance) {
+    jclass player_class = env->GetObjectClass(instance);
+    jfieldID field_id = env->GetFieldID(player_class, "nativeHandle", "J");
+    env->DeleteLocalRef(player_class);
+    return field_id;
+}
 
-// 线程相关
-pthread_t produce_id, video_consume_id, audio_consume_id;
+/**
+ * 获取 Java Player 对应的 C 层播放器
+ * 调用的 Java 方法需要是 synchronized 的 播放结束释放时会在同一个锁里清掉
+ * @param env
+ * @param instance
+ * @return 没有在播放返回 NULL
+ */
+static Player* get_player(JNIEnv *env, jobject instance) {
+    return (Player*) (intptr_t) env->GetLongField(instance, get_handle_field(env, instance));
+}
 
-// 快进/快退相关
-bool is_seek;
-pthread_mutex_t seek_mutex;
-pthread_cond_t seek_condition;
+/**
+ * 设置 Java Player 对应的 C 层播放器
+ * @param env
+ * @param instance
+ * @param player
+ */
+static void set_player(JNIEnv *env, jobject instance, Player* player) {
+    env->SetLongField(instance, get_handle_field(env, instance), (jlong) (intptr_t) player);
+}
 
 /**
  * 初始化播放器
+ * 预加载时还没有 Java 实例 开始播放时再调用 player_attach
  * @param player
  */
-void player_init(Player **player, JNIEnv *env, jobject instance, jobject surface, jobject callback) {
+void player_init(Player **player, JNIEnv *env, jobject options) {
     *player = (Player*) malloc(sizeof(Player));
+    memset((void*) *player, 0, sizeof(Player));
+    color_converter_init(&((*player)->color_converter));
+    options_from_java(&((*player)->options), env, options);
     JavaVM* java_vm;
     env->GetJavaVM(&java_vm);
+    // MediaCodec 硬件解码需要 JavaVM
+    av_jni_set_java_vm(java_vm, NULL);
     (*player)->java_vm = java_vm;
-    (*player)->instance = env->NewGlobalRef(instance);
-    (*player)->surface = env->NewGlobalRef(surface);
-    (*player)->callback = env->NewGlobalRef(callback);
+    (*player)->first_frame_latency.store(0);
+}
+
+/**
+ * 关联 Java 实例
+ * @param player
+ * @param env
+ * @param instance
+ * @param surface
+ * @param callback
+ */
+void player_attach(Player *player, JNIEnv *env, jobject instance, jobject surface, jobject callback) {
+    player->instance = env->NewGlobalRef(instance);
+    player->surface = env->NewGlobalRef(surface);
+    player->callback = env->NewGlobalRef(callback);
+    AudioSink *sink = &(player->audio_sink);
+    audio_sink_init(sink, player->options.audio_sink, player->java_vm, player->instance);
+    strncpy(sink->dump_path, player->options.audio_dump_path, sizeof(sink->dump_path) - 1);
+}
+
+/**
+ * 打开关键帧索引
+ * 只有配置了索引目录并且容器自己没有索引时才使用
+ * @param player
+ * @param path
+ */
+static void keyframe_index_open(Player *player, const char* path) {
+    if (player->options.keyframe_index_dir[0] == '\0' || !keyframe_index_is_needed(player->format_context)) {
+        return;
+    }
+    KeyframeIndex *index = (KeyframeIndex*) malloc(sizeof(KeyframeIndex));
+    if (keyframe_index_init(index, path, player->options.keyframe_index_dir) < 0) {
+        free(index);
+        return;
+    }
+    if (player->options.keyframe_index_scan) {
+        keyframe_index_start_scan(index);
+    }
+    player->keyframe_previous_pts = AV_NOPTS_VALUE;
+    player->keyframe_index = index;
 }
 
 /**
@@ -385,19 +505,37 @@ void player_init(Player **player, JNIEnv *env, jobject instance, jobject surface
  * @return
  */
 int format_init(Player *player, const char* path) {
-    int result;
+    int64_t start_time = av_gettime_relative();
     av_register_all();
     player->format_context = avformat_alloc_context();
-    result = avformat_open_input(&(player->format_context), path, NULL, NULL);
-    if (result < 0) {
-        LOGE("Player Error : Can not open video file");
-        return result;
+    if (player->options.io_mmap) {
+        MappedIO *io = (MappedIO*) malloc(sizeof(MappedIO));
+        if (mapped_io_open(io, path) > 0) {
+            player->format_context->pb = io->avio;
+            player->mapped_io = io;
+        } else {
+            mapped_io_close(io);
+            free(io);
+        }
     }
-    result = avformat_find_stream_info(player->format_context, NULL);
+    if (player->mapped_io == NULL && player->options.io_prefetch_bytes > 0) {
+        PrefetchIO *io = (PrefetchIO*) malloc(sizeof(PrefetchIO));
+        if (prefetch_io_open(io, path, player->options.io_prefetch_bytes) > 0) {
+            // 解封装只从预读缓冲区读取
+            player->format_context->pb = io->avio;
+            player->prefetch_io = io;
+        } else {
+            prefetch_io_close(io);
+            free(io);
+        }
+    }
+    int result = stream_info_open(&(player->format_context), path, player->options.fast_start,
+                                  player->options.stream_info_cache_dir, NULL);
     if (result < 0) {
-        LOGE("Player Error : Can not find video file stream info");
         return result;
     }
+    player->open_time = av_gettime_relative() - start_time;
+    keyframe_index_open(player, path);
     return SUCCESS_CODE;
 }
 
@@ -424,113 +562,226 @@ int find_stream_index(Player *player, AVMediaType type) {
  * @return
  */
 int codec_init(Player *player, AVMediaType type) {
-    int result;
+    int result = FAIL_CODE;
     AVFormatContext *format_context = player->format_context;
     int index = find_stream_index(player, type);
     if (index == -1) {
         LOGE("Player Error : Can not find stream");
         return FAIL_CODE;
     }
-    AVCodecContext *codec_context = avcodec_alloc_context3(NULL);
-    avcodec_parameters_to_context(codec_context, format_context->streams[index]->codecpar);
-    AVCodec *codec = avcodec_find_decoder(codec_context->codec_id);
-    result = avcodec_open2(codec_context, codec, NULL);
-    if (result < 0) {
-        LOGE("Player Error : Can not open codec");
-        return FAIL_CODE;
-    }
+    AVCodecParameters *codecpar = format_context->streams[index]->codecpar;
     if (type == AVMEDIA_TYPE_VIDEO) {
+        PlayerOptions *options = &(player->options);
+        void *surface = options->hardware_render ? player->surface : NULL;
+        result = decoder_open(&(player->video_decoder), codecpar, &(options->video_threading), options->hardware_decode, surface);
         player->video_stream_index = index;
-        player->video_codec_context = codec_context;
     } else if (type == AVMEDIA_TYPE_AUDIO) {
+        result = decoder_open(&(player->audio_decoder), codecpar, NULL, false, NULL);
         player->audio_stream_index = index;
-        player->audio_codec_context = codec_context;
     }
+    return result;
+}
+
+/**
+ * 按帧的格式和宽高设置 Native Window 缓冲区
+ * YUV420P 帧优先使用 YV12 省去颜色转换 其他格式使用 RGBA
+ * @param player
+ * @param frame
+ * @return
+ */
+static int video_set_geometry(Player *player, AVFrame *frame) {
+    int result = -1;
+    if (player->options.yuv_render && frame->format == AV_PIX_FMT_YUV420P) {
+        result = ANativeWindow_setBuffersGeometry(player->native_window, frame->width, frame->height, WINDOW_FORMAT_YV12);
+        player->window_format = WINDOW_FORMAT_YV12;
+    }
+    if (result < 0) {
+        result = ANativeWindow_setBuffersGeometry(player->native_window, frame->width, frame->height, WINDOW_FORMAT_RGBA_8888);
+        player->window_format = WINDOW_FORMAT_RGBA_8888;
+    }
+    if (result < 0) {
+        LOGE("Player Error : Can not set native window buffer");
+        return FAIL_CODE;
+    }
+    player->window_width = frame->width;
+    player->window_height = frame->height;
     return SUCCESS_CODE;
 }
 
+/**
+ * 窗口缓冲区和帧的格式或宽高不一致 需要重新设置
+ * @param player
+ * @param frame
+ * @return
+ */
+static bool video_geometry_changed(Player *player, AVFrame *frame) {
+    if (frame->width != player->window_width || frame->height != player->window_height) {
+        return true;
+    }
+    bool yv12 = player->options.yuv_render && frame->format == AV_PIX_FMT_YUV420P;
+    return yv12 != (player->window_format == WINDOW_FORMAT_YV12);
+}
+
 /**
  * 播放视频准备
+ * 在收到第一个软件解码的帧时调用 按帧的宽高创建 Native Window
+ * 硬件解码直接渲染到 Surface 时不能再连接 Native Window
  * @param player
+ * @param env
+ * @param frame
  */
-int video_prepare(Player *player, JNIEnv *env) {
-    AVCodecContext *codec_context = player->video_codec_context;
-    int videoWidth = codec_context->width;
-    int videoHeight = codec_context->height;
+int video_prepare(Player *player, JNIEnv *env, AVFrame *frame) {
     player->native_window = ANativeWindow_fromSurface(env, player->surface);
     if (player->native_window == NULL) {
         LOGE("Player Error : Can not create native window");
         return FAIL_CODE;
     }
-    int result = ANativeWindow_setBuffersGeometry(player->native_window, videoWidth, videoHeight,WINDOW_FORMAT_RGBA_8888);
-    if (result < 0){
-        LOGE("Player Error : Can not set native window buffer");
+    if (video_set_geometry(player, frame) < 0) {
         ANativeWindow_release(player->native_window);
+        player->native_window = NULL;
         return FAIL_CODE;
     }
-    player->rgba_frame = av_frame_alloc();
-    int buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGBA, videoWidth, videoHeight, 1);
-    player->video_out_buffer = (uint8_t *) av_malloc(buffer_size * sizeof(uint8_t));
-    av_image_fill_arrays(player->rgba_frame->data, player->rgba_frame->linesize, player->video_out_buffer, AV_PIX_FMT_RGBA, videoWidth, videoHeight, 1);
-    player->sws_context = sws_getContext(
-            videoWidth, videoHeight, codec_context->pix_fmt,
-            videoWidth, videoHeight, AV_PIX_FMT_RGBA,
-            SWS_BICUBIC, NULL, NULL, NULL);
     return SUCCESS_CODE;
 }
 
+/**
+ * 获取设备的原生输出采样率
+ * 用原生采样率输出 系统混音器不需要再重采样 可以走快速混音通道
+ * @param player
+ * @param env
+ * @return 获取失败返回 0
+ */
+static int get_native_sample_rate(Player *player, JNIEnv* env) {
+    jclass player_class = env->GetObjectClass(player->instance);
+    jmethodID method_id = env->GetMethodID(player_class, "getNativeOutputSampleRate", "()I");
+    int sample_rate = env->CallIntMethod(player->instance, method_id);
+    env->DeleteLocalRef(player_class);
+    return sample_rate > 0 ? sample_rate : 0;
+}
+
+/**
+ * 通知 Java 层实际使用的音频输出格式
+ * @param player
+ * @param env
+ */
+static void call_on_audio_format(Player *player, JNIEnv* env) {
+    AudioSink *sink = &(player->audio_sink);
+    jclass player_class = env->GetObjectClass(player->instance);
+    jmethodID method_id = env->GetMethodID(player_class, "onAudioFormat", "(III)V");
+    env->CallVoidMethod(player->instance, method_id, sink->sample_rate, sink->channels, sink->period_bytes / sink->bytes_per_frame);
+    env->DeleteLocalRef(player_class);
+}
+
 /**
  * 播放音频准备
+ * 只在 swr 中重采样一次 直接输出到设备的原生采样率
  * @param player
  * @return
  */
 int audio_prepare(Player *player, JNIEnv* env) {
-    AVCodecContext *codec_context = player->audio_codec_context;
+    AVCodecContext *codec_context = player->audio_decoder.codec_context;
     player->swr_context = swr_alloc();
-    player->audio_out_buffer = (uint8_t *) av_malloc(44100 * 2);
     uint64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
     enum AVSampleFormat out_format = AV_SAMPLE_FMT_S16;
-    int out_sample_rate = player->audio_codec_context->sample_rate;
+    int out_sample_rate = player->options.audio_sample_rate;
+    if (out_sample_rate <= 0) {
+        out_sample_rate = get_native_sample_rate(player, env);
+    }
+    if (out_sample_rate <= 0) {
+        out_sample_rate = codec_context->sample_rate;
+    }
+    uint64_t in_channel_layout = codec_context->channel_layout;
+    if (in_channel_layout == 0) {
+        in_channel_layout = (uint64_t) av_get_default_channel_layout(codec_context->channels);
+    }
     swr_alloc_set_opts(player->swr_context,
                        out_channel_layout, out_format, out_sample_rate,
-                       codec_context->channel_layout, codec_context->sample_fmt, codec_context->sample_rate,
+                       in_channel_layout, codec_context->sample_fmt, codec_context->sample_rate,
                        0, NULL);
-    swr_init(player->swr_context);
+    if (swr_init(player->swr_context) < 0) {
+        LOGE("Player Error : Can not init audio resampler");
+        return FAIL_CODE;
+    }
     player->out_channels = av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO);
-    jclass player_class = env->GetObjectClass(player->instance);
-    jmethodID create_audio_track_method_id = env->GetMethodID(player_class, "createAudioTrack", "(II)V");
-    env->CallVoidMethod(player->instance, create_audio_track_method_id, 44100, player->out_channels);
-    player->play_audio_track_method_id = env->GetMethodID(player_class, "playAudioTrack", "([BI)V");
+    player->audio_out_buffer = NULL;
+    player->audio_out_buffer_size = 0;
+    AudioSink *sink = &(player->audio_sink);
+    sink->frames_per_burst = player->options.audio_frames_per_burst;
+    if (audio_sink_open(sink, out_sample_rate, player->out_channels) < 0) {
+        LOGE("Player Error : Can not open audio sink");
+        return FAIL_CODE;
+    }
+    LOGE("Player Log : audio output %d Hz -> %d Hz, %d frames per period",
+         codec_context->sample_rate, sink->sample_rate, sink->period_bytes / sink->bytes_per_frame);
+    call_on_audio_format(player, env);
     return SUCCESS_CODE;
 }
 
+/**
+ * 拷贝 YUV420P 帧到 YV12 格式的窗口缓冲区
+ * YV12 的 Y 平面后面紧跟 V 平面 再是 U 平面 色度行宽按 16 字节对齐 色度平面只有 height / 2 行
+ * 拷贝的范围不超过缓冲区自己的宽高
+ * @param buffer
+ * @param frame
+ */
+static void copy_to_yv12_buffer(ANativeWindow_Buffer *buffer, AVFrame *frame) {
+    uint8_t *y = (uint8_t *) buffer->bits;
+    int y_stride = buffer->stride;
+    int c_stride = FFALIGN(y_stride / 2, 16);
+    uint8_t *v = y + y_stride * buffer->height;
+    uint8_t *u = v + c_stride * (buffer->height / 2);
+    int width = FFMIN(frame->width, buffer->width);
+    int height = FFMIN(frame->height, buffer->height);
+    int chroma_width = FFMIN((width + 1) / 2, c_stride);
+    int chroma_height = FFMIN((height + 1) / 2, buffer->height / 2);
+    av_image_copy_plane(y, y_stride, frame->data[0], frame->linesize[0], width, height);
+    av_image_copy_plane(u, c_stride, frame->data[1], frame->linesize[1], chroma_width, chroma_height);
+    av_image_copy_plane(v, c_stride, frame->data[2], frame->linesize[2], chroma_width, chroma_height);
+}
+
 /**
  * 视频播放
+ * 直接转换到锁定的窗口缓冲区 不经过中间缓冲
+ * 帧的格式或宽高变化时先重新设置窗口缓冲区 写入方式按锁定的缓冲区实际格式决定
  * @param frame
  */
 void video_play(Player* player, AVFrame *frame, JNIEnv *env) {
-    int video_height = player->video_codec_context->height;
-    int result = sws_scale(
-            player->sws_context,
-            (const uint8_t* const*) frame->data, frame->linesize,
-            0, video_height,
-            player->rgba_frame->data, player->rgba_frame->linesize);
-    if (result <= 0) {
-        LOGE("Player Error : video data convert fail");
+    if (frame->format == AV_PIX_FMT_MEDIACODEC) {
+        // 硬件解码直接渲染到 Surface
+        av_mediacodec_release_buffer((AVMediaCodecBuffer *) frame->data[3], 1);
         return;
     }
-    result = ANativeWindow_lock(player->native_window, &(player->window_buffer), NULL);
+    if (player->native_window == NULL) {
+        if (video_prepare(player, env, frame) < 0) {
+            return;
+        }
+    } else if (video_geometry_changed(player, frame) && video_set_geometry(player, frame) < 0) {
+        return;
+    }
+    ANativeWindow_Buffer *buffer = &(player->window_buffer);
+    int result = ANativeWindow_lock(player->native_window, buffer, NULL);
     if (result < 0) {
         LOGE("Player Error : Can not lock native window");
-    } else {
-        uint8_t *bits = (uint8_t *) player->window_buffer.bits;
-        for (int h = 0; h < video_height; h++) {
-            memcpy(bits + h * player->window_buffer.stride * 4,
-                   player->video_out_buffer + h * player->rgba_frame->linesize[0],
-                   player->rgba_frame->linesize[0]);
+        if (player->window_format == WINDOW_FORMAT_YV12) {
+            // 设备不支持 CPU 写 YV12 缓冲区 以后都用 RGBA
+            player->options.yuv_render = false;
+            video_set_geometry(player, frame);
+        }
+        return;
+    }
+    if (buffer->format == WINDOW_FORMAT_YV12 && frame->format == AV_PIX_FMT_YUV420P) {
+        copy_to_yv12_buffer(buffer, frame);
+    } else if (buffer->format == WINDOW_FORMAT_RGBA_8888 || buffer->format == WINDOW_FORMAT_RGBX_8888) {
+        result = color_convert(&(player->color_converter), frame,
+                               (uint8_t *) buffer->bits, buffer->stride * 4, buffer->width, buffer->height);
+        if (result < 0) {
+            LOGE("Player Error : video data convert fail");
         }
-        ANativeWindow_unlockAndPost(player->native_window);
+    } else {
+        // 新的设置还没有生效 缓冲区格式和帧不匹配 丢弃这一帧
+        LOGE("Player Error : native window format %d does not match frame format %d", buffer->format, frame->format);
     }
+    ANativeWindow_unlockAndPost(player->native_window);
 }
 
 /**
@@ -538,12 +789,22 @@ void video_play(Player* player, AVFrame *frame, JNIEnv *env) {
  * @param frame
  */
 void audio_play(Player* player, AVFrame *frame, JNIEnv *env) {
-    swr_convert(player->swr_context, &(player->audio_out_buffer), 44100 * 2, (const uint8_t **) frame->data, frame->nb_samples);
-    int size = av_samples_get_buffer_size(NULL, player->out_channels, frame->nb_samples, AV_SAMPLE_FMT_S16, 1);
-    jbyteArray audio_sample_array = env->NewByteArray(size);
-    env->SetByteArrayRegion(audio_sample_array, 0, size, (const jbyte *) player->audio_out_buffer);
-    env->CallVoidMethod(player->instance, player->play_audio_track_method_id, audio_sample_array, size);
-    env->DeleteLocalRef(audio_sample_array);
+    // 输出的样本数由 swr 按采样率换算 (包括内部缓存的样本) 缓冲区只在不够时扩大
+    int max_samples = swr_get_out_samples(player->swr_context, frame->nb_samples);
+    int max_size = av_samples_get_buffer_size(NULL, player->out_channels, max_samples, AV_SAMPLE_FMT_S16, 1);
+    if (max_size < 0) {
+        return;
+    }
+    av_fast_malloc(&(player->audio_out_buffer), &(player->audio_out_buffer_size), (size_t) max_size);
+    if (player->audio_out_buffer == NULL) {
+        return;
+    }
+    int samples = swr_convert(player->swr_context, &(player->audio_out_buffer), max_samples, (const uint8_t **) frame->data, frame->nb_samples);
+    if (samples <= 0) {
+        return;
+    }
+    int size = av_samples_get_buffer_size(NULL, player->out_channels, samples, AV_SAMPLE_FMT_S16, 1);
+    audio_sink_write(&(player->audio_sink), player->audio_out_buffer, size);
 }
 
 /**
@@ -551,26 +812,66 @@ void audio_play(Player* player, AVFrame *frame, JNIEnv *env) {
  * @param player
  */
 void player_release(Player* player) {
+    JNIEnv *env;
+    // 没有播放的预加载会话可能在 Java 线程释放 这时不需要 attach
+    bool attached = false;
+    if (player->java_vm->GetEnv((void**) &env, JNI_VERSION_1_6) == JNI_EDETACHED) {
+        if (player->java_vm->AttachCurrentThread(&env, NULL) != JNI_OK) {
+            LOGE("Player Error : Can not get current thread env");
+            return;
+        }
+        attached = true;
+    }
+    if (player->instance != NULL) {
+        // 先解除和 Java 实例的关联 之后 Java 线程不会再拿到这个播放器
+        env->MonitorEnter(player->instance);
+        if (get_player(env, player->instance) == player) {
+            set_player(env, player->instance, NULL);
+        }
+        env->MonitorExit(player->instance);
+    }
     avformat_close_input(&(player->format_context));
-    av_free(player->video_out_buffer);
+    if (player->mapped_io != NULL) {
+        mapped_io_close(player->mapped_io);
+        free(player->mapped_io);
+    }
+    if (player->prefetch_io != NULL) {
+        prefetch_io_close(player->prefetch_io);
+        free(player->prefetch_io);
+    }
     av_free(player->audio_out_buffer);
-    avcodec_close(player->video_codec_context);
-    ANativeWindow_release(player->native_window);
-    sws_freeContext(player->sws_context);
-    av_frame_free(&(player->rgba_frame));
-    avcodec_close(player->audio_codec_context);
+    if (player->native_window != NULL) {
+        ANativeWindow_release(player->native_window);
+    }
+    color_converter_destroy(&(player->color_converter));
     swr_free(&(player->swr_context));
-    queue_destroy(player->video_queue);
-    queue_destroy(player->audio_queue);
-    player->instance = NULL;
-    JNIEnv *env;
-    int result = player->java_vm->AttachCurrentThread(&env, NULL);
-    if (result != JNI_OK) {
-        return;
+    if (player->is_prepared) {
+        queue_destroy(player->video_queue);
+        queue_destroy(player->audio_queue);
+        frame_queue_destroy(player->video_frame_queue);
+    }
+    decoder_destroy(&(player->video_decoder));
+    decoder_destroy(&(player->audio_decoder));
+    if (player->is_prepared) {
+        // 所有数据都已经回收 最后销毁数据池
+        packet_pool_destroy(player->packet_pool);
+        free(player->packet_pool);
+        clock_destroy(&(player->audio_clock));
+        clock_destroy(&(player->video_clock));
+        clock_destroy(&(player->external_clock));
+        seek_command_destroy(&(player->seek_command));
+    }
+    if (player->keyframe_index != NULL) {
+        keyframe_index_destroy(player->keyframe_index);
+        free(player->keyframe_index);
     }
     env->DeleteGlobalRef(player->instance);
     env->DeleteGlobalRef(player->surface);
-    player->java_vm->DetachCurrentThread();
+    env->DeleteGlobalRef(player->callback);
+    if (attached) {
+        player->java_vm->DetachCurrentThread();
+    }
+    free(player);
 }
 
 /**
@@ -609,64 +910,265 @@ void call_on_progress(Player *player, JNIEnv *env, double total, double current)
     env->DeleteLocalRef(callback_class);
 }
 
+/**
+ * 执行快进/快退
+ * 只 seek 一次 成功后清空队列并增加序号 解码和播放线程根据序号丢掉旧数据 不需要停下来等待
+ * @param player
+ * @param request
+ */
+static void seek_apply(Player* player, SeekRequest* request) {
+    AVFormatContext *format_context = player->format_context;
+    int64_t target = request->target;
+    if (format_context->start_time != AV_NOPTS_VALUE) {
+        target += format_context->start_time;
+    }
+    // 落到目标之前最近的关键帧 精确定位再由解码线程丢掉目标之前的帧
+    int result = -1;
+    KeyframeEntry entry;
+    if (player->keyframe_index != NULL && keyframe_index_lookup(player->keyframe_index, target, &entry)) {
+        // 索引里有目标之前的关键帧 直接按字节定位 不需要容器二分查找
+        result = avformat_seek_file(format_context, -1, entry.pos, entry.pos, entry.pos, AVSEEK_FLAG_BYTE);
+    }
+    if (result < 0) {
+        result = avformat_seek_file(format_context, -1, INT64_MIN, target, target, 0);
+    }
+    if (result < 0) {
+        LOGE("Player Error : Can not seek to %lld", (long long) target);
+        print_error(result);
+        return;
+    }
+    // 读取位置跳变 下一个记录的关键帧和之前的不连续
+    player->keyframe_previous_pts = AV_NOPTS_VALUE;
+    // 生产线程是唯一增加序号的线程 先发布新序号对应的目标 再清空队列
+    int serial = player->video_queue->serial.load() + 1;
+    player->seek_accurate_target.store(request->flags & SEEK_FLAG_ACCURATE ? target : AV_NOPTS_VALUE);
+    player->seek_start_time.store(request->request_time);
+    player->preview_serial.store(request->flags & SEEK_FLAG_PREVIEW ? serial : -1);
+    player->seek_serial.store(serial);
+    queue_flush(player->video_queue);
+    queue_flush(player->audio_queue);
+    player->seek_count.fetch_add(1);
+}
+
+/**
+ * 是否正在拖动预览
+ * @param player
+ * @return
+ */
+static bool seek_is_preview(Player* player) {
+    return player->preview_serial.load() == player->video_queue->serial.load();
+}
+
+/**
+ * 精确快进/快退时 是否还在目标之前 (需要丢掉)
+ * @param player
+ * @param frame
+ * @param stream
+ * @param serial 帧的序号
+ * @return
+ */
+static bool seek_before_target(Player* player, AVFrame* frame, AVStream* stream, int serial) {
+    if (serial != player->seek_serial.load()) {
+        return false;
+    }
+    int64_t target = player->seek_accurate_target.load();
+    int64_t pts = av_frame_get_best_effort_timestamp(frame);
+    if (target == AV_NOPTS_VALUE || pts == AV_NOPTS_VALUE) {
+        return false;
+    }
+    int64_t duration = av_frame_get_pkt_duration(frame);
+    if (duration <= 0 && frame->sample_rate > 0) {
+        duration = av_rescale_q(frame->nb_samples, av_make_q(1, frame->sample_rate), stream->time_base);
+    }
+    return av_rescale_q(pts + FFMAX(duration, 0), stream->time_base, AV_TIME_BASE_Q) <= target;
+}
+
+/**
+ * 读到结束后又快进/快退 恢复两个队列的阻塞继续读取
+ * 有一个解码线程已经结束时不能再继续播放 两个队列都保持打断
+ * @param player
+ * @return
+ */
+static bool produce_resume(Player* player) {
+    bool video = queue_resume(player->video_queue);
+    bool audio = queue_resume(player->audio_queue);
+    if (video && audio) {
+        return true;
+    }
+    break_block(player->video_queue);
+    break_block(player->audio_queue);
+    return false;
+}
+
+/**
+ * 解码结束 (视频解码任务或者音频线程)
+ * 最后一个结束的关闭命令通道 读到结束后等待快进/快退的生产线程不再等待
+ * @param player
+ */
+static void decode_thread_finish(Player* player) {
+    if (player->running_decoders.fetch_sub(1) == 1) {
+        seek_command_close(&(player->seek_command));
+    }
+}
+
 /**
  * 生产函数
  * 循环读取帧 解码 丢到对应的队列中
+ * 读到结束后解码线程消费剩下的数据 这期间仍然处理快进/快退
  * @param arg
  * @return
  */
 void* produce(void* arg) {
     Player *player = (Player*) arg;
-    AVPacket *packet = av_packet_alloc();
+    thread_set_priority(player->options.priority);
+    AVPacket *packet = packet_pool_get(player->packet_pool);
+    SeekRequest request;
     for (;;) {
-        pthread_mutex_lock(&seek_mutex);
-        while (is_seek) {
-            LOGE("Player Log : produce waiting seek");
-            pthread_cond_wait(&seek_condition, &seek_mutex);
-            LOGE("Player Log : produce wake up seek");
+        if (seek_command_take(&(player->seek_command), &request)) {
+            seek_apply(player, &request);
+        }
+        bool preview = seek_is_preview(player);
+        if (preview && player->preview_shown_serial.load() == player->preview_serial.load()) {
+            // 预览帧已经显示 停止读取 等待下一个位置或者松手
+            if (!seek_command_wait(&(player->seek_command), &request)) {
+                break;
+            }
+            seek_apply(player, &request);
+            continue;
         }
-        pthread_mutex_unlock(&seek_mutex);
         if (av_read_frame(player->format_context, packet) < 0) {
-            break;
+            // 读到结束 打断阻塞让解码线程消费剩下的数据
+            // 解码线程都结束前收到快进/快退 重新定位后继续读取
+            break_block(player->video_queue);
+            break_block(player->audio_queue);
+            if (!seek_command_wait(&(player->seek_command), &request) || !produce_resume(player)) {
+                break;
+            }
+            seek_apply(player, &request);
+            continue;
+        }
+        if (preview && packet->stream_index != player->video_stream_index) {
+            // 预览只需要视频
+            av_packet_unref(packet);
+            continue;
         }
         if (packet->stream_index == player->video_stream_index) {
+            if (player->keyframe_index != NULL) {
+                keyframe_index_add_packet(player->keyframe_index, packet, player->format_context->streams[packet->stream_index],
+                                          &(player->keyframe_previous_pts));
+            }
             queue_in(player->video_queue, packet);
         } else if (packet->stream_index == player->audio_stream_index) {
             queue_in(player->audio_queue, packet);
+        } else {
+            // 其他流的数据不需要 直接复用
+            av_packet_unref(packet);
+            continue;
         }
-        packet = av_packet_alloc();
+        packet = packet_pool_get(player->packet_pool);
     }
+    packet_pool_release(player->packet_pool, &packet);
     break_block(player->video_queue);
     break_block(player->audio_queue);
-    for (;;) {
-        if (queue_is_empty(player->video_queue) && queue_is_empty(player->audio_queue)) {
-            break;
-        }
-        sleep(1);
-    }
+    // 等待解码和播放线程把剩下的数据消费完
+    task_loop_wait(&(player->video_decode_loop));
+    pthread_join(player->video_render_id, NULL);
+    pthread_join(player->audio_consume_id, NULL);
+    // 渲染线程取帧时还会唤醒解码任务 (已经结束 不再提交) 线程都结束后再销毁
+    task_loop_destroy(&(player->video_decode_loop));
     player_release(player);
     return NULL;
 }
 
-/* no AV sync correction is done if below the minimum AV sync threshold */
-#define AV_SYNC_THRESHOLD_MIN 0.04
-/* AV sync correction is done if above the maximum AV sync threshold */
-#define AV_SYNC_THRESHOLD_MAX 0.1
-/* If a frame duration is longer than this, it will not be duplicated to compensate AV sync */
-#define AV_SYNC_FRAMEDUP_THRESHOLD 0.1
-/* no AV correction is done if too big error */
-#define AV_NOSYNC_THRESHOLD 10.0
+/**
+ * 获取主时钟类型
+ * @param player
+ * @return
+ */
+static int get_master_sync_type(Player* player) {
+    if (player->options.sync_master == CLOCK_MASTER_VIDEO && player->video_stream_index >= 0) {
+        return CLOCK_MASTER_VIDEO;
+    }
+    if (player->options.sync_master == CLOCK_MASTER_EXTERNAL) {
+        return CLOCK_MASTER_EXTERNAL;
+    }
+    return player->audio_stream_index >= 0 ? CLOCK_MASTER_AUDIO : CLOCK_MASTER_EXTERNAL;
+}
 
 /**
- * 消费函数
- * 从队列获取解码数据 同步播放
+ * 获取主时钟
+ * @param player
+ * @return
+ */
+static double get_master_clock(Player* player) {
+    switch (get_master_sync_type(player)) {
+        case CLOCK_MASTER_VIDEO:
+            return clock_get(&(player->video_clock));
+        case CLOCK_MASTER_AUDIO:
+            return clock_get(&(player->audio_clock));
+        default:
+            return clock_get(&(player->external_clock));
+    }
+}
+
+/**
+ * 视频解码任务的一步
+ * 从队列获取视频数据解码 放入解码后帧队列 最多解出 VIDEO_DECODE_BATCH_FRAMES 帧
+ * 队列没有数据或者帧队列已满时停下 入队或者渲染取走帧之后再唤醒
+ * 解码可以领先显示 不会因为等待同步而停下来
+ * @param arg
+ * @return TASK_LOOP_*
+ */
+static int video_decode_step(void* arg) {
+    Player *player = (Player*) arg;
+    AVStream *stream = player->format_context->streams[player->video_stream_index];
+    AVFrame *frame = player->video_decode_frame;
+    for (int i = 0; i < VIDEO_DECODE_BATCH_FRAMES; i++) {
+        if (frame_queue_is_full(player->video_frame_queue)) {
+            return TASK_LOOP_IDLE;
+        }
+        // 预览只解码关键帧
+        int skip_level = seek_is_preview(player) ? DECODER_SKIP_PREVIEW : frame_drop_get_skip_level(&(player->frame_dropper));
+        decoder_set_skip_level(&(player->video_decoder), skip_level);
+        int result = decoder_poll_frame(&(player->video_decoder), frame);
+        if (result == AVERROR(EAGAIN)) {
+            return TASK_LOOP_IDLE;
+        }
+        if (result <= 0) {
+            LOGE("video decode finish");
+            frame_queue_break_block(player->video_frame_queue);
+            av_frame_free(&(player->video_decode_frame));
+            decode_thread_finish(player);
+            return TASK_LOOP_FINISH;
+        }
+        int serial = player->video_decoder.packet_serial;
+        if (seek_before_target(player, frame, stream, serial)) {
+            av_frame_unref(frame);
+            continue;
+        }
+        frame_drop_on_decoded(&(player->frame_dropper));
+        frame_queue_in(player->video_frame_queue, frame, serial);
+    }
+    return TASK_LOOP_CONTINUE;
+}
+
+/**
+ * 唤醒视频解码任务 (数据入队 打断 帧队列有空位)
+ * @param arg
+ */
+static void video_decode_wake(void* arg) {
+    task_loop_wake((TaskLoop*) arg);
+}
+
+/**
+ * 视频播放函数
+ * 从解码后帧队列获取帧 只负责同步和显示
  * @param arg
  * @return
  */
-void* consume(void* arg) {
-    Consumer *consumer = (Consumer*) arg;
-    Player *player = consumer->player;
-    int index = consumer->stream_index;
+void* video_render(void* arg) {
+    Player *player = (Player*) arg;
+    thread_set_priority(player->options.priority);
     JNIEnv *env;
     int result = player->java_vm->AttachCurrentThread(&env, NULL);
     if (result != JNI_OK) {
@@ -674,164 +1176,610 @@ void* consume(void* arg) {
         pthread_exit(NULL);
         return NULL;
     }
-    AVCodecContext *codec_context;
-    AVStream *stream;
-    Queue *queue;
-    if (index == player->video_stream_index) {
-        codec_context = player->video_codec_context;
-        stream = player->format_context->streams[player->video_stream_index];
-        queue = player->video_queue;
-        video_prepare(player, env);
-    } else if (index == player->audio_stream_index) {
-        codec_context = player->audio_codec_context;
-        stream = player->format_context->streams[player->audio_stream_index];
-        queue = player->audio_queue;
-        audio_prepare(player, env);
-    }
-    if (index == player->audio_stream_index) {
-        call_on_start(player, env);
+    AVStream *stream = player->format_context->streams[player->video_stream_index];
+    AVRational frame_rate = av_guess_frame_rate(player->format_context, stream, NULL);
+    double nominal_duration = frame_rate.num && frame_rate.den ? av_q2d(av_inv_q(frame_rate)) : 0.04;
+    // 上一帧的 pts 和应该显示的时刻
+    double last_timestamp = NAN;
+    double frame_timer = 0;
+    int last_serial = -1;
+    int serial;
+    AVFrame *frame = av_frame_alloc();
+    while (frame_queue_out(player->video_frame_queue, frame, &serial)) {
+        if (serial != player->video_queue->serial.load()) {
+            // 快进/快退之前的帧 直接丢掉
+            av_frame_unref(frame);
+            continue;
+        }
+        if (serial != last_serial) {
+            // 新序号的第一帧 从现在重新计时
+            last_serial = serial;
+            last_timestamp = NAN;
+        }
+        if (serial == player->preview_serial.load()) {
+            // 拖动预览 第一帧立即显示 不同步 之后的帧丢掉
+            if (player->preview_shown_serial.load() != serial) {
+                video_play(player, frame, env);
+                player->seek_latency.store(av_gettime_relative() - player->seek_start_time.load());
+                player->preview_shown_serial.store(serial);
+            } else if (frame->format == AV_PIX_FMT_MEDIACODEC) {
+                av_mediacodec_release_buffer((AVMediaCodecBuffer *) frame->data[3], 0);
+            }
+            av_frame_unref(frame);
+            continue;
+        }
+        double duration = nominal_duration + frame->repeat_pict * (nominal_duration * 0.5);
+        double timestamp;
+        int64_t pts = av_frame_get_best_effort_timestamp(frame);
+        if (pts == AV_NOPTS_VALUE) {
+            timestamp = isnan(last_timestamp) ? 0 : last_timestamp + duration;
+        } else {
+            timestamp = pts * av_q2d(stream->time_base);
+        }
+        // 上一帧的显示时长 优先用相邻 pts 的差值
+        double delay = duration;
+        if (!isnan(last_timestamp) && timestamp - last_timestamp > 0 && timestamp - last_timestamp < AV_NOSYNC_THRESHOLD) {
+            delay = timestamp - last_timestamp;
+        }
+        if (get_master_sync_type(player) != CLOCK_MASTER_VIDEO) {
+            // 已经落后主时钟 在颜色转换之前丢掉
+            double master_clock = get_master_clock(player);
+            if (!isnan(last_timestamp) && frame_drop_should_drop(&(player->frame_dropper), master_clock - timestamp, delay)) {
+                frame_drop_on_frame(&(player->frame_dropper), true);
+                if (frame->format == AV_PIX_FMT_MEDIACODEC) {
+                    av_mediacodec_release_buffer((AVMediaCodecBuffer *) frame->data[3], 0);
+                }
+                last_timestamp = timestamp;
+                clock_set(&(player->video_clock), timestamp, serial);
+                av_frame_unref(frame);
+                continue;
+            }
+            delay = clock_compute_delay(delay, clock_get(&(player->video_clock)) - master_clock);
+        }
+        double time = clock_now();
+        if (isnan(last_timestamp) || time - (frame_timer + delay) > AV_SYNC_THRESHOLD_MAX) {
+            // 第一帧或者已经落后太多 从现在重新计时
+            frame_timer = time;
+        } else {
+            frame_timer += delay;
+        }
+        if (frame_timer > time) {
+            usleep((unsigned long) ((frame_timer - time) * 1000000));
+        }
+        bool first_frame = isnan(last_timestamp);
+        last_timestamp = timestamp;
+        video_play(player, frame, env);
+        if (player->first_frame_latency.load() == 0) {
+            player->first_frame_latency.store(av_gettime_relative() - player->play_time);
+        }
+        frame_drop_on_frame(&(player->frame_dropper), false);
+        if (first_frame && serial == player->seek_serial.load()) {
+            // 快进/快退后显示的第一帧 记录耗时
+            player->seek_latency.store(av_gettime_relative() - player->seek_start_time.load());
+        }
+        clock_set(&(player->video_clock), timestamp, serial);
+        clock_sync_to_slave(&(player->external_clock), &(player->video_clock));
+        av_frame_unref(frame);
     }
+    av_frame_free(&frame);
+    player->java_vm->DetachCurrentThread();
+    return NULL;
+}
+
+/**
+ * 音频消费函数
+ * 从队列获取音频数据解码 播放
+ * @param arg
+ * @return
+ */
+void* audio_consume(void* arg) {
+    Player *player = (Player*) arg;
+    thread_set_priority(player->options.priority);
+    JNIEnv *env;
+    int result = player->java_vm->AttachCurrentThread(&env, NULL);
+    if (result != JNI_OK) {
+        LOGE("Player Error : Can not get current thread env");
+        pthread_exit(NULL);
+        return NULL;
+    }
+    AVStream *stream = player->format_context->streams[player->audio_stream_index];
+    audio_prepare(player, env);
+    call_on_start(player, env);
     double total = stream->duration * av_q2d(stream->time_base);
+    // 下一帧的 pts 没有 pts 的帧接着上一帧计算
+    double next_timestamp = 0;
+    int last_serial = 0;
     AVFrame *frame = av_frame_alloc();
     for (;;) {
-        pthread_mutex_lock(&seek_mutex);
-        while (is_seek) {
-            pthread_cond_wait(&seek_condition, &seek_mutex);
-        }
-        pthread_mutex_unlock(&seek_mutex);
-        AVPacket *packet = queue_out(queue);
-        if (packet == NULL) {
-            LOGE("consume packet is null");
+        if (decoder_decode_frame(&(player->audio_decoder), frame) <= 0) {
+            LOGE("audio decode finish");
             break;
         }
-        result = avcodec_send_packet(codec_context, packet);
-        if (result < 0 && result != AVERROR(EAGAIN) && result != AVERROR_EOF) {
-            print_error(result);
-            LOGE("Player Error : %d codec step 1 fail", index);
-            av_packet_free(&packet);
+        int serial = player->audio_decoder.packet_serial;
+        if (serial != player->audio_queue->serial.load() || serial == player->preview_serial.load() || seek_before_target(player, frame, stream, serial)) {
+            av_frame_unref(frame);
             continue;
         }
-        result = avcodec_receive_frame(codec_context, frame);
-        if (result < 0 && result != AVERROR_EOF) {
-            print_error(result);
-            LOGE("Player Error : %d codec step 2 fail", index);
-            av_packet_free(&packet);
-            continue;
+        if (serial != last_serial) {
+            // 快进/快退后的第一帧 丢掉输出里还没播放的旧数据
+            last_serial = serial;
+            next_timestamp = 0;
+            audio_sink_flush(&(player->audio_sink));
         }
-        if (index == player->video_stream_index) {
-            double audio_clock = player->audio_clock;
-            double timestamp;
-            if(packet->pts == AV_NOPTS_VALUE) {
-                timestamp = 0;
-            } else {
-                timestamp = av_frame_get_best_effort_timestamp(frame) * av_q2d(stream->time_base);
-            }
-            double frame_rate = av_q2d(stream->avg_frame_rate);
-            frame_rate += frame->repeat_pict * (frame_rate * 0.5);
-            if (timestamp == 0.0) {
-                usleep((unsigned long)(frame_rate * 1000));
-            } else {
-                if (fabs(timestamp - audio_clock) > AV_SYNC_THRESHOLD_MIN &&
-                    fabs(timestamp - audio_clock) < AV_NOSYNC_THRESHOLD) {
-                    if (timestamp > audio_clock) {
-                        usleep((unsigned long)((timestamp - audio_clock)*1000000));
-                    }
-                }
-            }
-            video_play(player, frame, env);
-        } else if (index == player->audio_stream_index) {
-            player->audio_clock = packet->pts * av_q2d(stream->time_base);
-            audio_play(player, frame, env);
-            call_on_progress(player, env, total, player->audio_clock);
+        int64_t pts = av_frame_get_best_effort_timestamp(frame);
+        if (pts != AV_NOPTS_VALUE) {
+            next_timestamp = pts * av_q2d(stream->time_base);
         }
-        av_packet_free(&packet);
-    }
-    if (index == player->audio_stream_index) {
-        call_on_end(player, env);
+        if (frame->sample_rate > 0) {
+            next_timestamp += (double) frame->nb_samples / frame->sample_rate;
+        }
+        audio_play(player, frame, env);
+        // 写入的数据末尾减去还没播放的部分 才是正在播放的位置
+        clock_set(&(player->audio_clock), next_timestamp - audio_sink_get_delay(&(player->audio_sink)), serial);
+        clock_sync_to_slave(&(player->external_clock), &(player->audio_clock));
+        call_on_progress(player, env, total, clock_get(&(player->audio_clock)));
+        av_frame_unref(frame);
     }
+    decode_thread_finish(player);
+    audio_sink_close(&(player->audio_sink));
+    call_on_end(player, env);
+    av_frame_free(&frame);
     player->java_vm->DetachCurrentThread();
     return NULL;
 }
 
 /**
  *  初始化线程
+ *  视频解码在共享线程池中执行 解封装 渲染和音频是专用线程
  */
 void thread_init(Player* player) {
-    pthread_create(&produce_id, NULL, produce, player);
-    Consumer* video_consumer = (Consumer*) malloc(sizeof(Consumer));
-    video_consumer->player = player;
-    video_consumer->stream_index = player->video_stream_index;
-    pthread_create(&video_consume_id, NULL, consume, video_consumer);
-    Consumer* audio_consumer = (Consumer*) malloc(sizeof(Consumer));
-    audio_consumer->player = player;
-    audio_consumer->stream_index = player->audio_stream_index;
-    pthread_create(&audio_consume_id, NULL, consume, audio_consumer);
-    pthread_mutex_init(&seek_mutex, NULL);
-    pthread_cond_init(&seek_condition, NULL);
+    player->running_decoders.store(2);
+    player->video_decode_frame = av_frame_alloc();
+    TaskLoop *decode_loop = &(player->video_decode_loop);
+    task_loop_init(decode_loop, thread_pool_shared(), video_decode_step, player, player->options.priority);
+    queue_set_consumer_notify(player->video_queue, video_decode_wake, decode_loop);
+    frame_queue_set_producer_notify(player->video_frame_queue, video_decode_wake, decode_loop);
+    task_loop_wake(decode_loop);
+    pthread_create(&(player->video_render_id), NULL, video_render, player);
+    pthread_create(&(player->audio_consume_id), NULL, audio_consume, player);
+    pthread_create(&(player->produce_id), NULL, produce, player);
+    // 生产线程最后自己释放播放器 没有线程等待它
+    pthread_detach(player->produce_id);
 }
 
 /**
- * 开始播放
+ * 准备播放状态
+ * 创建队列 时钟 之后可以往队列里缓冲数据 但还没有线程消费
  * @param player
  */
-void play_start(Player *player) {
-    player->audio_clock = 0;
+void play_prepare(Player *player) {
     player->video_queue = (Queue*) malloc(sizeof(Queue));
     player->audio_queue = (Queue*) malloc(sizeof(Queue));
+    player->video_frame_queue = (FrameQueue*) malloc(sizeof(FrameQueue));
+    player->packet_pool = (PacketPool*) malloc(sizeof(PacketPool));
+    packet_pool_init(player->packet_pool);
     queue_init(player->video_queue);
     queue_init(player->audio_queue);
+    queue_set_pool(player->video_queue, player->packet_pool);
+    queue_set_pool(player->audio_queue, player->packet_pool);
+    frame_queue_init(player->video_frame_queue);
+    // 时钟的序号和队列不一致时 (快进/快退之后) 时钟无效
+    clock_init(&(player->audio_clock), &(player->audio_queue->serial));
+    clock_init(&(player->video_clock), &(player->video_queue->serial));
+    clock_init(&(player->external_clock), NULL);
+    seek_command_init(&(player->seek_command));
+    player->seek_serial.store(-1);
+    player->preview_serial.store(-1);
+    player->preview_shown_serial.store(-1);
+    frame_drop_init(&(player->frame_dropper), player->options.frame_drop);
+    player->video_decoder.queue = player->video_queue;
+    // 颜色转换分片线程 渲染线程自己也处理一片
+    int convert_threads = player->options.convert_threads;
+    if (convert_threads <= 0) {
+        convert_threads = FFMIN(av_cpu_count(), COLOR_CONVERT_MAX_SLICES / 2);
+    }
+    if (convert_threads > 1) {
+        // 所有播放器共用进程的线程池 按优先级调度
+        color_converter_set_pool(&(player->color_converter), thread_pool_shared(), convert_threads, player->options.priority);
+    }
+    player->audio_decoder.queue = player->audio_queue;
+    AVStream **streams = player->format_context->streams;
+    queue_set_limit(player->video_queue, &(player->options.video_queue_limit), streams[player->video_stream_index]->time_base);
+    queue_set_limit(player->audio_queue, &(player->options.audio_queue_limit), streams[player->audio_stream_index]->time_base);
+    queue_set_peer(player->video_queue, player->audio_queue);
+    queue_set_peer(player->audio_queue, player->video_queue);
+    player->is_prepared = true;
+}
+
+/**
+ * 开始播放
+ * @param player
+ */
+void play_start(Player *player) {
+    if (!player->is_prepared) {
+        play_prepare(player);
+    }
     thread_init(player);
 }
 
 /**
- * 同步播放音视频
+ * 预加载时缓冲数据
+ * 读到配置的字节数或者任意一个队列到达高水位为止 这时还没有消费者 入队不能阻塞
+ * 需要时把开头的视频数据直接送进解码器 解出的第一帧放入帧队列 开始播放时立即显示
+ * @param player
+ * @param cancel
  */
-extern "C"
-JNIEXPORT void JNICALL
-Java_com_johan_player_Player_play(JNIEnv *env, jobject instance, jstring path_, jobject surface, jobject callback) {
-    const char *path = env->GetStringUTFChars(path_, 0);
-    int result = 1;
-    Player* player;
-    player_init(&player, env, instance, surface, callback);
-    if (result > 0) {
-        result = format_init(player, path);
+static void preload_buffer(Player *player, std::atomic<bool>* cancel) {
+    PlayerOptions *options = &(player->options);
+    Decoder *decoder = &(player->video_decoder);
+    // 硬件解码直接渲染时 有了 Surface 才会打开视频解码器
+    bool decode_first_frame = options->preload_first_frame && decoder->codec_context != NULL;
+    int decoded_packets = 0;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = packet_pool_get(player->packet_pool);
+    while (!cancel->load()) {
+        if (queue_is_over_max(player->video_queue) || queue_is_over_max(player->audio_queue)
+            || queue_is_full(player->video_queue) || queue_is_full(player->audio_queue)) {
+            break;
+        }
+        int64_t buffered = player->video_queue->bytes.load() + player->audio_queue->bytes.load();
+        if (buffered >= options->preload_bytes && !decode_first_frame) {
+            break;
+        }
+        if (av_read_frame(player->format_context, packet) < 0) {
+            break;
+        }
+        if (packet->stream_index == player->video_stream_index) {
+            if (player->keyframe_index != NULL) {
+                keyframe_index_add_packet(player->keyframe_index, packet, player->format_context->streams[packet->stream_index],
+                                          &(player->keyframe_previous_pts));
+            }
+            if (decode_first_frame && decoded_packets == 0 && !(packet->flags & AV_PKT_FLAG_KEY)) {
+                // 不是从关键帧开始 交给解码线程按正常流程处理
+                decode_first_frame = false;
+            }
+            if (decode_first_frame) {
+                // 送进解码器的数据不再入队
+                int result = decoder_decode_packet(decoder, packet, frame);
+                packet = packet_pool_get(player->packet_pool);
+                decoded_packets += 1;
+                if (result > 0) {
+                    frame_drop_on_decoded(&(player->frame_dropper));
+                    frame_queue_in(player->video_frame_queue, frame, player->video_queue->serial.load());
+                }
+                if (result != 0 || decoded_packets >= PRELOAD_MAX_DECODE_PACKETS) {
+                    decode_first_frame = false;
+                }
+                continue;
+            }
+            queue_in(player->video_queue, packet);
+        } else if (packet->stream_index == player->audio_stream_index) {
+            queue_in(player->audio_queue, packet);
+        } else {
+            av_packet_unref(packet);
+            continue;
+        }
+        packet = packet_pool_get(player->packet_pool);
     }
-    if (result > 0) {
+    packet_pool_release(player->packet_pool, &packet);
+    av_frame_free(&frame);
+}
+
+/**
+ * 加载预加载的会话 在预加载器的加载线程中执行
+ * 打开文件 探测 打开解码器 准备播放状态 缓冲开头的数据
+ * @param session
+ * @param path
+ * @param cancel
+ * @return
+ */
+static int preload_load(void* session, const char* path, std::atomic<bool>* cancel) {
+    Player *player = (Player*) session;
+    int result = format_init(player, path);
+    if (result > 0 && player->options.hardware_render) {
+        // 硬件解码直接渲染需要 Surface 开始播放时再打开视频解码器
+        player->video_stream_index = find_stream_index(player, AVMEDIA_TYPE_VIDEO);
+        result = player->video_stream_index >= 0 ? SUCCESS_CODE : FAIL_CODE;
+    } else if (result > 0) {
         result = codec_init(player, AVMEDIA_TYPE_VIDEO);
     }
     if (result > 0) {
         result = codec_init(player, AVMEDIA_TYPE_AUDIO);
     }
+    if (result <= 0) {
+        return FAIL_CODE;
+    }
+    play_prepare(player);
+    preload_buffer(player, cancel);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 释放没有播放的预加载会话
+ * @param session
+ */
+static void preload_release(void* session) {
+    player_release((Player*) session);
+}
+
+/**
+ * 从 Java Preloader 取出预加载的播放器
+ * @param env
+ * @param preloader Java Preloader 可以为 NULL
+ * @param path
+ * @return 没有预加载好返回 NULL
+ */
+static Player* preload_take(JNIEnv *env, jobject preloader, const char* path) {
+    if (preloader == NULL) {
+        return NULL;
+    }
+    Player *player = NULL;
+    // 和 Preloader.release 互斥
+    env->MonitorEnter(preloader);
+    Preloader *native_preloader = (Preloader*) (intptr_t) env->GetLongField(preloader, get_handle_field(env, preloader));
+    if (native_preloader != NULL) {
+        player = (Player*) preloader_take(native_preloader, path);
+    }
+    env->MonitorExit(preloader);
+    return player;
+}
+
+/**
+ * 同步播放音视频
+ * 有预加载好的会话时直接接管 跳过打开 探测和缓冲
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Player_play(JNIEnv *env, jobject instance, jstring path_, jobject surface, jobject callback, jobject options, jobject preloader) {
+    int64_t play_time = av_gettime_relative();
+    const char *path = env->GetStringUTFChars(path_, 0);
+    int result = 1;
+    Player* player = preload_take(env, preloader, path);
+    if (player != NULL) {
+        // 使用预加载时的配置
+        player->is_preloaded = true;
+        player_attach(player, env, instance, surface, callback);
+        if (player->video_decoder.codec_context == NULL) {
+            result = codec_init(player, AVMEDIA_TYPE_VIDEO);
+            player->video_decoder.queue = player->video_queue;
+        }
+    } else {
+        player_init(&player, env, options);
+        player_attach(player, env, instance, surface, callback);
+        if (result > 0) {
+            result = format_init(player, path);
+        }
+        if (result > 0) {
+            result = codec_init(player, AVMEDIA_TYPE_VIDEO);
+        }
+        if (result > 0) {
+            result = codec_init(player, AVMEDIA_TYPE_AUDIO);
+        }
+    }
+    player->play_time = play_time;
     if (result > 0) {
+        // 播放结束释放时清掉
+        set_player(env, instance, player);
         play_start(player);
+    } else {
+        // 打开失败 播放器没有交给 Java 实例 直接释放
+        player_release(player);
     }
     env->ReleaseStringUTFChars(path_, path);
-    cplayer = player;
+}
+
+/**
+ * 投递快进/快退命令
+ * 只清掉已经缓冲的数据 唤醒可能因为队列满而阻塞的生产线程和解码线程 seek 由生产线程完成
+ * 读到结束后的请求 先恢复队列阻塞 解码线程清空后等待生产线程重新定位 而不是直接结束
+ * 生产线程取到请求后 如果有解码线程已经结束 会重新打断
+ * @param player
+ * @param progress 目标位置 (秒)
+ * @param flags SEEK_FLAG_*
+ */
+static void seek_post(Player* player, jint progress, int flags) {
+    if (player == NULL) {
+        return;
+    }
+    seek_command_post(&(player->seek_command), (int64_t) progress * AV_TIME_BASE, flags);
+    queue_resume(player->video_queue);
+    queue_resume(player->audio_queue);
+    queue_clear(player->video_queue);
+    queue_clear(player->audio_queue);
+    frame_queue_clear(player->video_frame_queue);
+    audio_sink_flush(&(player->audio_sink));
 }
 
 /**
  * 快进/快退
+ * 不阻塞 连续的请求只处理最后一个
  */
 extern "C"
 JNIEXPORT void JNICALL
-Java_com_johan_player_Player_seekTo(JNIEnv *env, jobject instance, jint progress) {
-    is_seek = true;
-    pthread_mutex_lock(&seek_mutex);
-    queue_clear(cplayer->video_queue);
-    queue_clear(cplayer->audio_queue);
-    int result = av_seek_frame(cplayer->format_context, cplayer->video_stream_index, (int64_t) (progress / av_q2d(cplayer->format_context->streams[cplayer->video_stream_index]->time_base)), AVSEEK_FLAG_BACKWARD);
-    if (result < 0) {
-        LOGE("Player Error : Can not seek video to %d", progress);
+Java_com_johan_player_Player_seekTo(JNIEnv *env, jobject instance, jint progress, jboolean accurate) {
+    seek_post(get_player(env, instance), progress, accurate ? SEEK_FLAG_ACCURATE : 0);
+}
+
+/**
+ * 拖动预览
+ * 只解码目标位置之前的关键帧显示 不播放声音
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Player_scrubTo(JNIEnv *env, jobject instance, jint progress) {
+    seek_post(get_player(env, instance), progress, SEEK_FLAG_PREVIEW);
+}
+
+/**
+ * 获取播放统计
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Player_getStats(JNIEnv *env, jobject instance, jobject stats) {
+    Player *player = get_player(env, instance);
+    if (player == NULL || stats == NULL) {
         return;
     }
-    result = av_seek_frame(cplayer->format_context, cplayer->audio_stream_index, (int64_t) (progress / av_q2d(cplayer->format_context->streams[cplayer->audio_stream_index]->time_base)), AVSEEK_FLAG_BACKWARD);
-    if (result < 0) {
-        LOGE("Player Error : Can not seek audio to %d", progress);
+    FrameDropper *dropper = &(player->frame_dropper);
+    jclass stats_class = env->GetObjectClass(stats);
+    env->SetLongField(stats, env->GetFieldID(stats_class, "framesDecoded", "J"), dropper->decoded_frames.load());
+    env->SetLongField(stats, env->GetFieldID(stats_class, "framesRendered", "J"), dropper->rendered_frames.load());
+    env->SetLongField(stats, env->GetFieldID(stats_class, "framesDropped", "J"), dropper->dropped_frames.load());
+    env->SetIntField(stats, env->GetFieldID(stats_class, "skipLevel", "I"), frame_drop_get_skip_level(dropper));
+    env->SetLongField(stats, env->GetFieldID(stats_class, "seekCount", "J"), player->seek_count.load());
+    env->SetLongField(stats, env->GetFieldID(stats_class, "seekCoalesced", "J"), player->seek_command.coalesced.load());
+    env->SetLongField(stats, env->GetFieldID(stats_class, "openTimeMs", "J"), player->open_time / 1000);
+    if (player->prefetch_io != NULL) {
+        int64_t bytes_read, read_time, stall_count, stall_time;
+        prefetch_io_get_stats(player->prefetch_io, &bytes_read, &read_time, &stall_count, &stall_time);
+        env->SetLongField(stats, env->GetFieldID(stats_class, "ioBytesRead", "J"), bytes_read);
+        env->SetLongField(stats, env->GetFieldID(stats_class, "ioReadTimeMs", "J"), read_time / 1000);
+        env->SetLongField(stats, env->GetFieldID(stats_class, "ioStallCount", "J"), stall_count);
+        env->SetLongField(stats, env->GetFieldID(stats_class, "ioStallTimeMs", "J"), stall_time / 1000);
+    }
+    env->SetLongField(stats, env->GetFieldID(stats_class, "seekLatencyMs", "J"), player->seek_latency.load() / 1000);
+    env->SetLongField(stats, env->GetFieldID(stats_class, "firstFrameTimeMs", "J"), player->first_frame_latency.load() / 1000);
+    env->SetBooleanField(stats, env->GetFieldID(stats_class, "preloaded", "Z"), (jboolean) player->is_preloaded);
+    env->DeleteLocalRef(stats_class);
+}
+
+/**
+ * 创建缩略图服务
+ */
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_johan_player_Thumbnailer_nativeCreate(JNIEnv *env, jobject instance, jint threads, jlong cache_bytes, jstring stream_info_cache_dir_) {
+    Thumbnailer *thumbnailer = (Thumbnailer*) malloc(sizeof(Thumbnailer));
+    const char *stream_info_cache_dir = stream_info_cache_dir_ != NULL ? env->GetStringUTFChars(stream_info_cache_dir_, 0) : NULL;
+    thumbnailer_init(thumbnailer, threads, cache_bytes, stream_info_cache_dir);
+    if (stream_info_cache_dir != NULL) {
+        env->ReleaseStringUTFChars(stream_info_cache_dir_, stream_info_cache_dir);
+    }
+    return (jlong) (intptr_t) thumbnailer;
+}
+
+/**
+ * 生成一批缩略图 写入对应的 Bitmap (ARGB_8888 尺寸就是缩略图尺寸)
+ */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_johan_player_Thumbnailer_nativeGetThumbnails(JNIEnv *env, jobject instance, jlong handle, jstring path_, jlongArray times_, jobjectArray bitmaps) {
+    Thumbnailer *thumbnailer = (Thumbnailer*) (intptr_t) handle;
+    if (thumbnailer == NULL) {
+        return 0;
+    }
+    int count = env->GetArrayLength(times_);
+    if (env->GetArrayLength(bitmaps) < count) {
+        return 0;
+    }
+    const char *path = env->GetStringUTFChars(path_, 0);
+    jlong *times = env->GetLongArrayElements(times_, NULL);
+    ThumbnailRequest *requests = (ThumbnailRequest*) calloc((size_t) FFMAX(count, 1), sizeof(ThumbnailRequest));
+    jobject *locked = (jobject*) calloc((size_t) FFMAX(count, 1), sizeof(jobject));
+    // 先锁住所有 Bitmap 的像素 工作线程直接写入 每个 Bitmap 保留一个局部引用
+    env->EnsureLocalCapacity(count);
+    int request_count = 0;
+    for (int i = 0; i < count; i++) {
+        jobject bitmap = env->GetObjectArrayElement(bitmaps, i);
+        AndroidBitmapInfo info;
+        void *pixels;
+        if (bitmap == NULL || AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS
+            || info.format != ANDROID_BITMAP_FORMAT_RGBA_8888
+            || AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) {
+            LOGE("Player Error : Thumbnail bitmap %d is not a ARGB_8888 bitmap", i);
+            env->DeleteLocalRef(bitmap);
+            continue;
+        }
+        ThumbnailRequest *request = &(requests[request_count]);
+        request->time = times[i];
+        request->dst = (uint8_t*) pixels;
+        request->dst_linesize = info.stride;
+        request->width = info.width;
+        request->height = info.height;
+        locked[request_count++] = bitmap;
+    }
+    int result = thumbnailer_get(thumbnailer, path, requests, request_count);
+    for (int i = 0; i < request_count; i++) {
+        AndroidBitmap_unlockPixels(env, locked[i]);
+        env->DeleteLocalRef(locked[i]);
+    }
+    free(locked);
+    free(requests);
+    env->ReleaseLongArrayElements(times_, times, JNI_ABORT);
+    env->ReleaseStringUTFChars(path_, path);
+    return result;
+}
+
+/**
+ * 释放缩略图服务
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Thumbnailer_nativeRelease(JNIEnv *env, jobject instance, jlong handle) {
+    Thumbnailer *thumbnailer = (Thumbnailer*) (intptr_t) handle;
+    if (thumbnailer == NULL) {
+        return;
+    }
+    thumbnailer_destroy(thumbnailer);
+    free(thumbnailer);
+}
+
+/**
+ * 创建预加载器
+ * 加载任务在共享线程池中执行 优先级低于前台播放器
+ */
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_johan_player_Preloader_nativeCreate(JNIEnv *env, jobject instance, jint max_items) {
+    Preloader *preloader = (Preloader*) malloc(sizeof(Preloader));
+    preloader_init(preloader, max_items, preload_load, preload_release);
+    return (jlong) (intptr_t) preloader;
+}
+
+/**
+ * 预加载 不阻塞
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Preloader_nativePreload(JNIEnv *env, jobject instance, jlong handle, jstring path_, jobject options) {
+    Preloader *preloader = (Preloader*) (intptr_t) handle;
+    if (preloader == NULL) {
+        return;
+    }
+    const char *path = env->GetStringUTFChars(path_, 0);
+    Player *player;
+    player_init(&player, env, options);
+    preloader_add(preloader, path, player);
+    env->ReleaseStringUTFChars(path_, path);
+}
+
+/**
+ * 取消预加载
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Preloader_nativeCancel(JNIEnv *env, jobject instance, jlong handle, jstring path_) {
+    Preloader *preloader = (Preloader*) (intptr_t) handle;
+    if (preloader == NULL) {
+        return;
+    }
+    const char *path = env->GetStringUTFChars(path_, 0);
+    preloader_remove(preloader, path);
+    env->ReleaseStringUTFChars(path_, path);
+}
+
+/**
+ * 释放预加载器
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_johan_player_Preloader_nativeRelease(JNIEnv *env, jobject instance, jlong handle) {
+    Preloader *preloader = (Preloader*) (intptr_t) handle;
+    if (preloader == NULL) {
         return;
     }
-    is_seek = false;
-    pthread_cond_broadcast(&seek_condition);
-    pthread_mutex_unlock(&seek_mutex);
+    preloader_destroy(preloader);
+    free(preloader);
 }
 
 /** ========================= 测试生产者和消费者模式代码 =========================
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch_io.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavutil/common.h"
+}
+
+/**
+ * IO 线程
+ * 缓冲区有一块的空间就从源读取一块 有 seek 请求时先移动源的位置
+ * @param arg
+ * @return
+ */
+static void* prefetch_io_work(void* arg) {
+    PrefetchIO *io = (PrefetchIO*) arg;
+    pthread_mutex_lock(io->mutex_id);
+    for (;;) {
+        while (io->is_running && !io->seek_requested && (io->eof || io->buffer_size - io->data_size < PREFETCH_IO_CHUNK_SIZE)) {
+            pthread_cond_wait(io->not_full_condition, io->mutex_id);
+        }
+        if (!io->is_running) {
+            break;
+        }
+        int generation = io->generation;
+        if (io->seek_requested) {
+            // 缓冲区已经清空 read_pos 就是新位置
+            int64_t position = io->read_pos;
+            io->seek_requested = false;
+            pthread_mutex_unlock(io->mutex_id);
+            int64_t result = avio_seek(io->source, position, SEEK_SET);
+            pthread_mutex_lock(io->mutex_id);
+            if (generation == io->generation) {
+                io->eof = result < 0;
+                io->error = result < 0 ? (int) result : 0;
+                pthread_cond_signal(io->not_empty_condition);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(io->mutex_id);
+        int64_t start = av_gettime_relative();
+        int size = avio_read(io->source, io->chunk, PREFETCH_IO_CHUNK_SIZE);
+        int64_t time = av_gettime_relative() - start;
+        pthread_mutex_lock(io->mutex_id);
+        io->read_time += time;
+        if (size > 0) {
+            io->bytes_read += size;
+        }
+        if (generation != io->generation) {
+            // 读取期间发生了 seek 这块数据作废
+            continue;
+        }
+        if (size > 0) {
+            int write_index = (io->read_index + io->data_size) % io->buffer_size;
+            int first = FFMIN(size, io->buffer_size - write_index);
+            memcpy(io->buffer + write_index, io->chunk, (size_t) first);
+            memcpy(io->buffer, io->chunk + first, (size_t) (size - first));
+            io->data_size += size;
+        } else {
+            io->eof = true;
+            io->error = size == AVERROR_EOF || size == 0 ? 0 : size;
+        }
+        pthread_cond_signal(io->not_empty_condition);
+    }
+    pthread_mutex_unlock(io->mutex_id);
+    return NULL;
+}
+
+/**
+ * AVIOContext 读取回调 (解封装线程)
+ * @param opaque
+ * @param buf
+ * @param buf_size
+ * @return
+ */
+static int prefetch_io_read(void* opaque, uint8_t* buf, int buf_size) {
+    PrefetchIO *io = (PrefetchIO*) opaque;
+    pthread_mutex_lock(io->mutex_id);
+    if (io->data_size == 0 && !io->eof) {
+        // 预读没有跟上 记录等待
+        int64_t start = av_gettime_relative();
+        while (io->data_size == 0 && !io->eof && io->is_running) {
+            pthread_cond_wait(io->not_empty_condition, io->mutex_id);
+        }
+        io->stall_count += 1;
+        io->stall_time += av_gettime_relative() - start;
+    }
+    if (io->data_size == 0) {
+        int error = io->error != 0 ? io->error : AVERROR_EOF;
+        pthread_mutex_unlock(io->mutex_id);
+        return error;
+    }
+    int size = FFMIN(buf_size, io->data_size);
+    int first = FFMIN(size, io->buffer_size - io->read_index);
+    memcpy(buf, io->buffer + io->read_index, (size_t) first);
+    memcpy(buf + first, io->buffer, (size_t) (size - first));
+    io->read_index = (io->read_index + size) % io->buffer_size;
+    io->read_pos += size;
+    io->data_size -= size;
+    pthread_cond_signal(io->not_full_condition);
+    pthread_mutex_unlock(io->mutex_id);
+    return size;
+}
+
+/**
+ * AVIOContext seek 回调 (解封装线程)
+ * @param opaque
+ * @param offset
+ * @param whence
+ * @return
+ */
+static int64_t prefetch_io_seek(void* opaque, int64_t offset, int whence) {
+    PrefetchIO *io = (PrefetchIO*) opaque;
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+        return io->source_size >= 0 ? io->source_size : AVERROR(ENOSYS);
+    }
+    pthread_mutex_lock(io->mutex_id);
+    int64_t position;
+    if (whence == SEEK_SET) {
+        position = offset;
+    } else if (whence == SEEK_CUR) {
+        position = io->read_pos + offset;
+    } else if (whence == SEEK_END && io->source_size >= 0) {
+        position = io->source_size + offset;
+    } else {
+        pthread_mutex_unlock(io->mutex_id);
+        return AVERROR(EINVAL);
+    }
+    if (position < 0) {
+        pthread_mutex_unlock(io->mutex_id);
+        return AVERROR(EINVAL);
+    }
+    if (position >= io->read_pos && position <= io->read_pos + io->data_size) {
+        // 已经预读过 直接跳过
+        int skip = (int) (position - io->read_pos);
+        io->read_index = (io->read_index + skip) % io->buffer_size;
+        io->data_size -= skip;
+    } else {
+        // 丢掉预读的数据 让 IO 线程从新位置开始
+        io->read_index = 0;
+        io->data_size = 0;
+        io->generation += 1;
+        io->seek_requested = true;
+        io->eof = false;
+        io->error = 0;
+    }
+    io->read_pos = position;
+    pthread_cond_signal(io->not_full_condition);
+    pthread_mutex_unlock(io->mutex_id);
+    return position;
+}
+
+/**
+ * 打开预读 IO
+ * @param io
+ * @param path
+ * @param buffer_size
+ * @return
+ */
+int prefetch_io_open(PrefetchIO* io, const char* path, int buffer_size) {
+    memset((void*) io, 0, sizeof(PrefetchIO));
+    int result = avio_open2(&(io->source), path, AVIO_FLAG_READ, NULL, NULL);
+    if (result < 0) {
+        LOGE("Player Error : Prefetch io can not open %s", path);
+        return result;
+    }
+    io->source_size = avio_size(io->source);
+    io->buffer_size = FFMAX(buffer_size, PREFETCH_IO_CHUNK_SIZE * 2);
+    io->buffer = (uint8_t*) malloc((size_t) io->buffer_size);
+    io->chunk = (uint8_t*) malloc(PREFETCH_IO_CHUNK_SIZE);
+    uint8_t *avio_buffer = (uint8_t*) av_malloc(PREFETCH_IO_AVIO_BUFFER_SIZE);
+    io->avio = avio_alloc_context(avio_buffer, PREFETCH_IO_AVIO_BUFFER_SIZE, 0, io, prefetch_io_read, NULL, prefetch_io_seek);
+    io->avio->seekable = io->source->seekable;
+    io->is_running = true;
+    io->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(io->mutex_id, NULL);
+    io->not_empty_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(io->not_empty_condition, NULL);
+    io->not_full_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(io->not_full_condition, NULL);
+    pthread_create(&(io->thread_id), NULL, prefetch_io_work, io);
+    return SUCCESS_CODE;
+}
+
+/**
+ * 获取统计
+ * @param io
+ * @param bytes_read
+ * @param read_time
+ * @param stall_count
+ * @param stall_time
+ */
+void prefetch_io_get_stats(PrefetchIO* io, int64_t* bytes_read, int64_t* read_time, int64_t* stall_count, int64_t* stall_time) {
+    pthread_mutex_lock(io->mutex_id);
+    *bytes_read = io->bytes_read;
+    *read_time = io->read_time;
+    *stall_count = io->stall_count;
+    *stall_time = io->stall_time;
+    pthread_mutex_unlock(io->mutex_id);
+}
+
+/**
+ * 停止 IO 线程 关闭源并释放
+ * @param io
+ */
+void prefetch_io_close(PrefetchIO* io) {
+    if (io->mutex_id == NULL) {
+        avio_closep(&(io->source));
+        return;
+    }
+    pthread_mutex_lock(io->mutex_id);
+    io->is_running = false;
+    pthread_cond_broadcast(io->not_full_condition);
+    pthread_cond_broadcast(io->not_empty_condition);
+    pthread_mutex_unlock(io->mutex_id);
+    pthread_join(io->thread_id, NULL);
+    if (io->avio != NULL) {
+        av_freep(&(io->avio->buffer));
+        av_freep(&(io->avio));
+    }
+    avio_closep(&(io->source));
+    free(io->buffer);
+    free(io->chunk);
+    pthread_mutex_destroy(io->mutex_id);
+    pthread_cond_destroy(io->not_empty_condition);
+    pthread_cond_destroy(io->not_full_condition);
+    free(io->mutex_id);
+    free(io->not_empty_condition);
+    free(io->not_full_condition);
+    io->mutex_id = NULL;
+}
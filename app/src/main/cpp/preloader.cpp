@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include "preloader.h"
+#include "util.h"
+
+/**
+ * 查找预加载项
+ * @param preloader
+ * @param path
+ * @return
+ */
+static PreloadEntry* preloader_find(Preloader* preloader, const char* path) {
+    for (PreloadEntry *entry = preloader->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 从 LRU 链表移除
+ * @param preloader
+ * @param entry
+ */
+static void preloader_unlink(Preloader* preloader, PreloadEntry* entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        preloader->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        preloader->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+    preloader->count -= 1;
+}
+
+/**
+ * 放到 LRU 链表头部
+ * @param preloader
+ * @param entry
+ */
+static void preloader_link_head(Preloader* preloader, PreloadEntry* entry) {
+    entry->prev = NULL;
+    entry->next = preloader->head;
+    if (preloader->head != NULL) {
+        preloader->head->prev = entry;
+    }
+    preloader->head = entry;
+    if (preloader->tail == NULL) {
+        preloader->tail = entry;
+    }
+    preloader->count += 1;
+}
+
+/**
+ * 释放预加载项和它的会话
+ * @param preloader
+ * @param entry
+ */
+static void preloader_entry_free(Preloader* preloader, PreloadEntry* entry) {
+    if (entry->session != NULL) {
+        preloader->release(entry->session);
+    }
+    free(entry->path);
+    free(entry);
+}
+
+/**
+ * 从预加载器移除 (加锁调用)
+ * 正在加载时交给加载线程释放
+ * @param preloader
+ * @param entry
+ * @return 需要调用者在锁外释放返回 true
+ */
+static bool preloader_detach(Preloader* preloader, PreloadEntry* entry) {
+    preloader_unlink(preloader, entry);
+    if (entry->state == PRELOAD_STATE_LOADING) {
+        entry->detached = true;
+        entry->cancel.store(true);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 找下一个要加载的项 (加锁调用)
+ * 从头部开始 最近添加的先加载
+ * @param preloader
+ * @return 没有等待加载的项返回 NULL
+ */
+static PreloadEntry* preloader_next(Preloader* preloader) {
+    for (PreloadEntry *entry = preloader->head; entry != NULL; entry = entry->next) {
+        if (entry->state == PRELOAD_STATE_QUEUED) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 加载线程
+ * @param arg
+ * @return
+ */
+static void* preload_thread(void* arg) {
+    Preloader *preloader = (Preloader*) arg;
+    pthread_mutex_lock(preloader->mutex_id);
+    while (preloader->is_running) {
+        PreloadEntry *entry = preloader_next(preloader);
+        if (entry == NULL) {
+            pthread_cond_wait(preloader->state_condition, preloader->mutex_id);
+            continue;
+        }
+        entry->state = PRELOAD_STATE_LOADING;
+        pthread_mutex_unlock(preloader->mutex_id);
+        int result = preloader->load(entry->session, entry->path, &(entry->cancel));
+        pthread_mutex_lock(preloader->mutex_id);
+        entry->state = result > 0 ? PRELOAD_STATE_READY : PRELOAD_STATE_FAILED;
+        pthread_cond_broadcast(preloader->state_condition);
+        if (entry->detached) {
+            // 加载过程中被淘汰或者取消
+            pthread_mutex_unlock(preloader->mutex_id);
+            preloader_entry_free(preloader, entry);
+            pthread_mutex_lock(preloader->mutex_id);
+        }
+    }
+    pthread_mutex_unlock(preloader->mutex_id);
+    return NULL;
+}
+
+/**
+ * 初始化预加载器
+ * @param preloader
+ * @param capacity
+ * @param load
+ * @param release
+ */
+void preloader_init(Preloader* preloader, int capacity, PreloadLoadFunction load, PreloadReleaseFunction release) {
+    preloader->capacity = capacity > 0 ? capacity : 1;
+    preloader->count = 0;
+    preloader->head = NULL;
+    preloader->tail = NULL;
+    preloader->load = load;
+    preloader->release = release;
+    preloader->is_running = true;
+    preloader->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(preloader->mutex_id, NULL);
+    preloader->state_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(preloader->state_condition, NULL);
+    pthread_create(&(preloader->thread_id), NULL, preload_thread, preloader);
+}
+
+/**
+ * 添加预加载
+ * @param preloader
+ * @param path
+ * @param session
+ */
+void preloader_add(Preloader* preloader, const char* path, void* session) {
+    pthread_mutex_lock(preloader->mutex_id);
+    PreloadEntry *entry = preloader_find(preloader, path);
+    if (entry != NULL) {
+        preloader_unlink(preloader, entry);
+        preloader_link_head(preloader, entry);
+        pthread_mutex_unlock(preloader->mutex_id);
+        preloader->release(session);
+        return;
+    }
+    entry = (PreloadEntry*) malloc(sizeof(PreloadEntry));
+    memset((void*) entry, 0, sizeof(PreloadEntry));
+    entry->preloader = preloader;
+    entry->path = strdup(path);
+    entry->session = session;
+    entry->state = PRELOAD_STATE_QUEUED;
+    entry->cancel.store(false);
+    entry->detached = false;
+    preloader_link_head(preloader, entry);
+    // 超过容量 淘汰最久没有使用的
+    PreloadEntry *evicted = NULL;
+    while (preloader->count > preloader->capacity) {
+        PreloadEntry *tail = preloader->tail;
+        if (preloader_detach(preloader, tail)) {
+            tail->next = evicted;
+            evicted = tail;
+        }
+    }
+    pthread_cond_broadcast(preloader->state_condition);
+    pthread_mutex_unlock(preloader->mutex_id);
+    while (evicted != NULL) {
+        PreloadEntry *next = evicted->next;
+        preloader_entry_free(preloader, evicted);
+        evicted = next;
+    }
+}
+
+/**
+ * 取出预加载的会话
+ * @param preloader
+ * @param path
+ * @return
+ */
+void* preloader_take(Preloader* preloader, const char* path) {
+    pthread_mutex_lock(preloader->mutex_id);
+    PreloadEntry *entry = preloader_find(preloader, path);
+    if (entry != NULL && entry->state == PRELOAD_STATE_LOADING) {
+        // 已经缓冲的数据足够起播 不再继续缓冲
+        entry->cancel.store(true);
+        // 等待时可能被其他线程移除 每次重新查找
+        while (entry != NULL && entry->state == PRELOAD_STATE_LOADING) {
+            pthread_cond_wait(preloader->state_condition, preloader->mutex_id);
+            entry = preloader_find(preloader, path);
+        }
+    }
+    if (entry == NULL) {
+        pthread_mutex_unlock(preloader->mutex_id);
+        return NULL;
+    }
+    preloader_detach(preloader, entry);
+    pthread_mutex_unlock(preloader->mutex_id);
+    // 还没开始加载时直接冷启动更快 会话随预加载项释放
+    void *session = NULL;
+    if (entry->state == PRELOAD_STATE_READY) {
+        session = entry->session;
+        entry->session = NULL;
+    }
+    preloader_entry_free(preloader, entry);
+    return session;
+}
+
+/**
+ * 取消预加载
+ * @param preloader
+ * @param path
+ */
+void preloader_remove(Preloader* preloader, const char* path) {
+    pthread_mutex_lock(preloader->mutex_id);
+    PreloadEntry *entry = preloader_find(preloader, path);
+    bool release = entry != NULL && preloader_detach(preloader, entry);
+    pthread_mutex_unlock(preloader->mutex_id);
+    if (release) {
+        preloader_entry_free(preloader, entry);
+    }
+}
+
+/**
+ * 销毁预加载器
+ * @param preloader
+ */
+void preloader_destroy(Preloader* preloader) {
+    PreloadEntry *released = NULL;
+    pthread_mutex_lock(preloader->mutex_id);
+    preloader->is_running = false;
+    while (preloader->head != NULL) {
+        PreloadEntry *entry = preloader->head;
+        if (preloader_detach(preloader, entry)) {
+            entry->next = released;
+            released = entry;
+        }
+    }
+    pthread_cond_broadcast(preloader->state_condition);
+    pthread_mutex_unlock(preloader->mutex_id);
+    while (released != NULL) {
+        PreloadEntry *next = released->next;
+        preloader_entry_free(preloader, released);
+        released = next;
+    }
+    // 加载线程会访问预加载器 等它释放正在加载的项后退出
+    pthread_join(preloader->thread_id, NULL);
+    pthread_mutex_destroy(preloader->mutex_id);
+    pthread_cond_destroy(preloader->state_condition);
+    free(preloader->mutex_id);
+    free(preloader->state_condition);
+}
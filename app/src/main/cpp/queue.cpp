@@ -1,14 +1,30 @@
 #include "queue.h"
 
+// 微秒时间基
+static const AVRational MICROSECOND_TIME_BASE = av_make_q(1, 1000000);
+
 /**
  * 初始化队列
  * @param queue
  */
 void queue_init(Queue* queue) {
-    queue->size = 0;
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->is_block = true;
+    queue->head.store(0);
+    queue->tail.store(0);
+    queue->bytes.store(0);
+    queue->duration.store(0);
+    memset(&(queue->limit), 0, sizeof(QueueLimit));
+    queue->time_base = MICROSECOND_TIME_BASE;
+    queue->last_pts = AV_NOPTS_VALUE;
+    queue->last_serial = 0;
+    queue->peer = NULL;
+    queue->pool = NULL;
+    queue->serial.store(0);
+    queue->is_block.store(true);
+    queue->is_end.store(false);
+    queue->producer_waiting.store(false);
+    queue->consumer_waiting.store(false);
+    queue->consumer_notify = NULL;
+    queue->consumer_opaque = NULL;
     queue->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
     pthread_mutex_init(queue->mutex_id, NULL);
     queue->not_empty_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
@@ -17,21 +33,59 @@ void queue_init(Queue* queue) {
     pthread_cond_init(queue->not_full_condition, NULL);
 }
 
+/**
+ * 设置水位
+ * @param queue
+ * @param limit
+ * @param time_base
+ */
+void queue_set_limit(Queue* queue, QueueLimit* limit, AVRational time_base) {
+    queue->limit = *limit;
+    queue->time_base = time_base;
+}
+
+/**
+ * 设置另一条流的队列
+ * @param queue
+ * @param peer
+ */
+void queue_set_peer(Queue* queue, Queue* peer) {
+    queue->peer = peer;
+}
+
+/**
+ * 设置数据池
+ * @param queue
+ * @param pool
+ */
+void queue_set_pool(Queue* queue, PacketPool* pool) {
+    queue->pool = pool;
+}
+
+/**
+ * 设置消费者的通知
+ * @param queue
+ * @param notify
+ * @param opaque
+ */
+void queue_set_consumer_notify(Queue* queue, void (*notify)(void*), void* opaque) {
+    queue->consumer_notify = notify;
+    queue->consumer_opaque = opaque;
+}
+
 /**
  * 销毁队列
  * @param queue
  */
 void queue_destroy(Queue* queue) {
-    Node* node = queue->head;
-    while (node != NULL) {
-        queue->head = queue->head->next;
-        free(node);
-        node = queue->head;
-    }
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
-    queue->is_block = false;
+    unsigned int tail = queue->tail.load();
+    for (unsigned int i = queue->head.load(); i != tail; i++) {
+        packet_pool_release(queue->pool, &(queue->data[i & QUEUE_MASK]));
+    }
+    queue->head.store(tail);
+    queue->bytes.store(0);
+    queue->duration.store(0);
+    queue->is_block.store(false);
     pthread_mutex_destroy(queue->mutex_id);
     pthread_cond_destroy(queue->not_empty_condition);
     pthread_cond_destroy(queue->not_full_condition);
@@ -46,7 +100,7 @@ void queue_destroy(Queue* queue) {
  * @return
  */
 bool queue_is_empty(Queue* queue) {
-    return queue->size == 0;
+    return queue->head.load() == queue->tail.load();
 }
 
 /**
@@ -55,7 +109,69 @@ bool queue_is_empty(Queue* queue) {
  * @return
  */
 bool queue_is_full(Queue* queue) {
-    return queue->size == QUEUE_MAX_SIZE;
+    return queue->tail.load() - queue->head.load() >= QUEUE_MAX_SIZE;
+}
+
+/**
+ * 是否超过高水位
+ * @param queue
+ * @return
+ */
+bool queue_is_over_max(Queue* queue) {
+    QueueLimit *limit = &(queue->limit);
+    if (limit->max_bytes > 0 && queue->bytes.load() >= limit->max_bytes) {
+        return true;
+    }
+    return limit->max_duration > 0 && queue->duration.load() >= limit->max_duration * 1000;
+}
+
+/**
+ * 是否还在低水位之上
+ * @param queue
+ * @return
+ */
+static bool queue_is_over_min(Queue* queue) {
+    QueueLimit *limit = &(queue->limit);
+    if (limit->max_bytes > 0 && queue->bytes.load() > limit->min_bytes) {
+        return true;
+    }
+    return limit->max_duration > 0 && queue->duration.load() > limit->min_duration * 1000;
+}
+
+/**
+ * 判断是否饿死 (空了并且消费者在等待)
+ * @param queue
+ * @return
+ */
+static bool queue_is_starving(Queue* queue) {
+    return queue != NULL && queue->consumer_waiting.load() && queue_is_empty(queue);
+}
+
+/**
+ * 生产者是否需要继续等待
+ * @param queue
+ * @return
+ */
+static bool queue_should_wait(Queue* queue) {
+    if (queue_is_full(queue)) {
+        return true;
+    }
+    return queue_is_over_min(queue) && !queue_is_starving(queue->peer);
+}
+
+/**
+ * 唤醒等待的线程
+ * 只在对方确实在等待时才加锁
+ * @param queue
+ * @param waiting
+ * @param condition
+ */
+static void queue_notify(Queue* queue, std::atomic<bool>* waiting, pthread_cond_t* condition) {
+    if (waiting->load()) {
+        pthread_mutex_lock(queue->mutex_id);
+        pthread_cond_signal(condition);
+        pthread_mutex_unlock(queue->mutex_id);
+    }
 }
 
 /**
@@ -64,54 +180,143 @@ bool queue_is_full(Queue* queue) {
  * @param element
  */
 void queue_in(Queue* queue, NodeElement element) {
-    pthread_mutex_lock(queue->mutex_id);
-    while (queue_is_full(queue) && queue->is_block) {
-        pthread_cond_wait(queue->not_full_condition, queue->mutex_id);
-    }
-    if (queue->size >= QUEUE_MAX_SIZE) {
+    if (queue_is_full(queue) || (queue_is_over_max(queue) && !queue_is_starving(queue->peer))) {
+        // 超过水位 才退化为锁 + 条件变量等待 直到回落到低水位
+        pthread_mutex_lock(queue->mutex_id);
+        queue->producer_waiting.store(true);
+        while (queue_should_wait(queue) && queue->is_block) {
+            pthread_cond_wait(queue->not_full_condition, queue->mutex_id);
+        }
+        queue->producer_waiting.store(false);
         pthread_mutex_unlock(queue->mutex_id);
-        return;
-    }
-    Node* node = (Node*) malloc(sizeof(Node));
-    node->data = element;
-    node->next = NULL;
-    if (queue->tail == NULL) {
-        queue->head = node;
-        queue->tail = node;
-    } else {
-        queue->tail->next = node;
-        queue->tail = node;
-    }
-    queue->size += 1;
-    pthread_cond_signal(queue->not_empty_condition);
-    pthread_mutex_unlock(queue->mutex_id);
+        if (queue_is_full(queue)) {
+            // 被打断 数据不再入队
+            packet_pool_release(queue->pool, &element);
+            return;
+        }
+    }
+    // 快进/快退之后 上一个数据的 pts 已经没有意义 (只由生产者读写)
+    int serial = queue->serial.load();
+    if (serial != queue->last_serial) {
+        queue->last_pts = AV_NOPTS_VALUE;
+        queue->last_serial = serial;
+    }
+    // 统计缓冲的字节数和时长 没有 duration 时用相邻 pts 的差值估算
+    int64_t duration = element->duration;
+    if (duration <= 0 && element->pts != AV_NOPTS_VALUE && queue->last_pts != AV_NOPTS_VALUE) {
+        duration = element->pts - queue->last_pts;
+    }
+    if (element->pts != AV_NOPTS_VALUE) {
+        queue->last_pts = element->pts;
+    }
+    unsigned int tail = queue->tail.load(std::memory_order_relaxed);
+    int64_t *slot_duration = &(queue->durations[tail & QUEUE_MASK]);
+    *slot_duration = duration > 0 ? av_rescale_q(duration, queue->time_base, MICROSECOND_TIME_BASE) : 0;
+    queue->serials[tail & QUEUE_MASK] = serial;
+    queue->sizes[tail & QUEUE_MASK] = element->size;
+    queue->bytes.fetch_add(element->size);
+    queue->duration.fetch_add(*slot_duration);
+    queue->data[tail & QUEUE_MASK] = element;
+    queue->tail.store(tail + 1);
+    queue_notify(queue, &(queue->consumer_waiting), queue->not_empty_condition);
+    if (queue->consumer_notify != NULL) {
+        queue->consumer_notify(queue->consumer_opaque);
+    }
+}
+
+/**
+ * 取出队列头的数据 (不阻塞)
+ * @param queue
+ * @param serial
+ * @return 队列为空返回 NULL
+ */
+static NodeElement queue_pop(Queue* queue, int* serial) {
+    for (;;) {
+        unsigned int head = queue->head.load(std::memory_order_relaxed);
+        if (head == queue->tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        NodeElement element = queue->data[head & QUEUE_MASK];
+        int64_t duration = queue->durations[head & QUEUE_MASK];
+        int size = queue->sizes[head & QUEUE_MASK];
+        int element_serial = queue->serials[head & QUEUE_MASK];
+        // 用 CAS 推进队列头 queue_clear 可能在其他线程同时移动队列头
+        if (!queue->head.compare_exchange_weak(head, head + 1)) {
+            continue;
+        }
+        queue->bytes.fetch_sub(size);
+        queue->duration.fetch_sub(duration);
+        if (queue->producer_waiting.load() && !queue_should_wait(queue)) {
+            queue_notify(queue, &(queue->producer_waiting), queue->not_full_condition);
+        }
+        if (serial != NULL) {
+            *serial = element_serial;
+        }
+        return element;
+    }
 }
 
 /**
  * 出队 (阻塞)
  * @param queue
+ * @param serial
  * @return
  */
-NodeElement queue_out(Queue* queue) {
-    pthread_mutex_lock(queue->mutex_id);
-    while (queue_is_empty(queue) && queue->is_block) {
-        pthread_cond_wait(queue->not_empty_condition, queue->mutex_id);
-    }
-    if (queue->head == NULL) {
+NodeElement queue_out(Queue* queue, int* serial) {
+    for (;;) {
+        NodeElement element = queue_pop(queue, serial);
+        if (element != NULL) {
+            return element;
+        }
+        // 队列为空 才退化为锁 + 条件变量等待
+        // 先叫醒可能因为另一条流超过水位而阻塞的生产者 否则本队列会一直饿着
+        queue->consumer_waiting.store(true);
+        if (queue->peer != NULL) {
+            queue_notify(queue->peer, &(queue->peer->producer_waiting), queue->peer->not_full_condition);
+        }
+        pthread_mutex_lock(queue->mutex_id);
+        while (queue_is_empty(queue) && queue->is_block) {
+            pthread_cond_wait(queue->not_empty_condition, queue->mutex_id);
+        }
+        queue->consumer_waiting.store(false);
+        // 被打断且没有数据 消费者结束 在锁内标记 和 queue_resume 互斥
+        bool is_end = queue_is_empty(queue);
+        if (is_end) {
+            queue->is_end.store(true);
+        }
         pthread_mutex_unlock(queue->mutex_id);
-        return NULL;
+        if (is_end) {
+            return NULL;
+        }
     }
-    Node* node = queue->head;
-    queue->head = queue->head->next;
-    if (queue->head == NULL) {
-        queue->tail = NULL;
+}
+
+/**
+ * 出队 (不阻塞)
+ * @param queue
+ * @param serial
+ * @param is_end
+ * @return
+ */
+NodeElement queue_try_out(Queue* queue, int* serial, bool* is_end) {
+    *is_end = false;
+    NodeElement element = queue_pop(queue, serial);
+    if (element != NULL) {
+        queue->consumer_waiting.store(false);
+        return element;
+    }
+    // 和 queue_out 一样标记在等待并叫醒另一条流的生产者 之后入队时通过 consumer_notify 重新调度消费者
+    queue->consumer_waiting.store(true);
+    if (queue->peer != NULL) {
+        queue_notify(queue->peer, &(queue->peer->producer_waiting), queue->peer->not_full_condition);
+    }
+    pthread_mutex_lock(queue->mutex_id);
+    if (queue_is_empty(queue) && !queue->is_block) {
+        queue->is_end.store(true);
+        *is_end = true;
     }
-    NodeElement element = node->data;
-    free(node);
-    queue->size -= 1;
-    pthread_cond_signal(queue->not_full_condition);
     pthread_mutex_unlock(queue->mutex_id);
-    return element;
+    return NULL;
 }
 
 /**
@@ -119,27 +324,68 @@ NodeElement queue_out(Queue* queue) {
  * @param queue
  */
 void queue_clear(Queue* queue) {
+    NodeElement elements[QUEUE_MAX_SIZE];
+    unsigned int head, tail;
+    int64_t bytes, duration;
+    do {
+        // 移动队列头之前 [head, tail) 的数据可能被消费者取走 这里只复制指针和每个位置记录的大小
+        // 不访问数据本身 CAS 成功之后这些数据才归这里所有
+        head = queue->head.load();
+        tail = queue->tail.load();
+        bytes = 0;
+        duration = 0;
+        for (unsigned int i = head; i != tail; i++) {
+            elements[i - head] = queue->data[i & QUEUE_MASK];
+            bytes += queue->sizes[i & QUEUE_MASK];
+            duration += queue->durations[i & QUEUE_MASK];
+        }
+    } while (!queue->head.compare_exchange_weak(head, tail));
+    for (unsigned int i = 0; i != tail - head; i++) {
+        packet_pool_release(queue->pool, &(elements[i]));
+    }
+    queue->bytes.fetch_sub(bytes);
+    queue->duration.fetch_sub(duration);
+    // 不改变 is_block 读到结束后已经打断的队列 由生产线程决定是否恢复
     pthread_mutex_lock(queue->mutex_id);
-    Node* node = queue->head;
-    while (node != NULL) {
-        queue->head = queue->head->next;
-        free(node);
-        node = queue->head;
-    }
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
-    queue->is_block = true;
     pthread_cond_signal(queue->not_full_condition);
     pthread_mutex_unlock(queue->mutex_id);
 }
 
+/**
+ * 清空队列并增加序号
+ * @param queue
+ */
+void queue_flush(Queue* queue) {
+    queue_clear(queue);
+    queue->serial.fetch_add(1);
+}
+
 /**
  * 打断阻塞
  * @param queue
  */
 void break_block(Queue* queue) {
-    queue->is_block = false;
+    queue->is_block.store(false);
+    pthread_mutex_lock(queue->mutex_id);
     pthread_cond_signal(queue->not_empty_condition);
     pthread_cond_signal(queue->not_full_condition);
-}
\ No newline at end of file
+    pthread_mutex_unlock(queue->mutex_id);
+    if (queue->consumer_notify != NULL) {
+        queue->consumer_notify(queue->consumer_opaque);
+    }
+}
+
+/**
+ * 恢复阻塞
+ * @param queue
+ * @return
+ */
+bool queue_resume(Queue* queue) {
+    pthread_mutex_lock(queue->mutex_id);
+    bool resumed = !queue->is_end.load();
+    if (resumed) {
+        queue->is_block.store(true);
+    }
+    pthread_mutex_unlock(queue->mutex_id);
+    return resumed;
+}
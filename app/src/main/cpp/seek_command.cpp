@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include "seek_command.h"
+
+extern "C" {
+#include "libavutil/time.h"
+}
+
+/**
+ * 初始化命令通道
+ * @param command
+ */
+void seek_command_init(SeekCommand* command) {
+    command->pending = false;
+    command->is_closed = false;
+    command->posted.store(0);
+    command->coalesced.store(0);
+    command->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(command->mutex_id, NULL);
+    command->condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(command->condition, NULL);
+}
+
+/**
+ * 投递请求
+ * @param command
+ * @param target
+ * @param flags
+ */
+void seek_command_post(SeekCommand* command, int64_t target, int flags) {
+    pthread_mutex_lock(command->mutex_id);
+    if (command->pending) {
+        command->coalesced.fetch_add(1);
+    }
+    command->request.target = target;
+    command->request.flags = flags;
+    command->request.request_time = av_gettime_relative();
+    command->pending = true;
+    command->posted.fetch_add(1);
+    pthread_cond_signal(command->condition);
+    pthread_mutex_unlock(command->mutex_id);
+}
+
+/**
+ * 取出最新的请求
+ * @param command
+ * @param request
+ * @return
+ */
+bool seek_command_take(SeekCommand* command, SeekRequest* request) {
+    pthread_mutex_lock(command->mutex_id);
+    bool pending = command->pending;
+    if (pending) {
+        *request = command->request;
+        command->pending = false;
+    }
+    pthread_mutex_unlock(command->mutex_id);
+    return pending;
+}
+
+/**
+ * 等待并取出最新的请求
+ * @param command
+ * @param request
+ * @return
+ */
+bool seek_command_wait(SeekCommand* command, SeekRequest* request) {
+    pthread_mutex_lock(command->mutex_id);
+    while (!command->pending && !command->is_closed) {
+        pthread_cond_wait(command->condition, command->mutex_id);
+    }
+    bool pending = command->pending;
+    if (pending) {
+        *request = command->request;
+        command->pending = false;
+    }
+    pthread_mutex_unlock(command->mutex_id);
+    return pending;
+}
+
+/**
+ * 关闭通道
+ * @param command
+ */
+void seek_command_close(SeekCommand* command) {
+    pthread_mutex_lock(command->mutex_id);
+    command->is_closed = true;
+    pthread_cond_signal(command->condition);
+    pthread_mutex_unlock(command->mutex_id);
+}
+
+/**
+ * 销毁命令通道
+ * @param command
+ */
+void seek_command_destroy(SeekCommand* command) {
+    pthread_mutex_destroy(command->mutex_id);
+    pthread_cond_destroy(command->condition);
+    free(command->mutex_id);
+    free(command->condition);
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "stream_info_cache.h"
+#include "util.h"
+
+/**
+ * 缓存文件路径
+ * @param path
+ * @param directory
+ * @param cache_path
+ * @param size
+ */
+static void stream_info_cache_path(const char* path, const char* directory, char* cache_path, size_t size) {
+    snprintf(cache_path, size, "%s/%016llx%s", directory, (unsigned long long) string_hash(path), STREAM_INFO_CACHE_SUFFIX);
+}
+
+/**
+ * 读取视频文件的大小和修改时间
+ * @param path
+ * @param file_size
+ * @param file_mtime
+ * @return 不是本地普通文件返回 false
+ */
+static bool stream_info_file_identity(const char* path, int64_t* file_size, int64_t* file_mtime) {
+    if (strncmp(path, "file:", 5) == 0) {
+        path += 5;
+    }
+    struct stat info;
+    if (stat(path, &info) < 0 || !S_ISREG(info.st_mode)) {
+        return false;
+    }
+    *file_size = info.st_size;
+    *file_mtime = info.st_mtime;
+    return true;
+}
+
+/**
+ * 从流参数生成记录
+ * @param stream
+ * @param record
+ */
+static void stream_info_record_from_stream(AVStream* stream, StreamInfoRecord* record) {
+    AVCodecParameters *parameters = stream->codecpar;
+    memset(record, 0, sizeof(StreamInfoRecord));
+    record->codec_type = parameters->codec_type;
+    record->codec_id = parameters->codec_id;
+    record->codec_tag = parameters->codec_tag;
+    record->format = parameters->format;
+    record->bit_rate = parameters->bit_rate;
+    record->bits_per_coded_sample = parameters->bits_per_coded_sample;
+    record->bits_per_raw_sample = parameters->bits_per_raw_sample;
+    record->profile = parameters->profile;
+    record->level = parameters->level;
+    record->width = parameters->width;
+    record->height = parameters->height;
+    record->sample_aspect_ratio = parameters->sample_aspect_ratio;
+    record->field_order = parameters->field_order;
+    record->color_range = parameters->color_range;
+    record->color_primaries = parameters->color_primaries;
+    record->color_trc = parameters->color_trc;
+    record->color_space = parameters->color_space;
+    record->chroma_location = parameters->chroma_location;
+    record->video_delay = parameters->video_delay;
+    record->sample_rate = parameters->sample_rate;
+    record->channel_layout = parameters->channel_layout;
+    record->channels = parameters->channels;
+    record->block_align = parameters->block_align;
+    record->frame_size = parameters->frame_size;
+    record->initial_padding = parameters->initial_padding;
+    record->seek_preroll = parameters->seek_preroll;
+    record->extradata_size = parameters->extradata_size;
+    record->avg_frame_rate = stream->avg_frame_rate;
+    record->r_frame_rate = stream->r_frame_rate;
+    record->duration = stream->duration;
+    record->start_time = stream->start_time;
+}
+
+/**
+ * 把记录写回流参数
+ * @param record
+ * @param extradata 为 NULL 时保留原来的 extradata
+ * @param stream
+ */
+static void stream_info_record_to_stream(StreamInfoRecord* record, uint8_t* extradata, AVStream* stream) {
+    AVCodecParameters *parameters = stream->codecpar;
+    parameters->codec_tag = record->codec_tag;
+    parameters->format = record->format;
+    parameters->bit_rate = record->bit_rate;
+    parameters->bits_per_coded_sample = record->bits_per_coded_sample;
+    parameters->bits_per_raw_sample = record->bits_per_raw_sample;
+    parameters->profile = record->profile;
+    parameters->level = record->level;
+    parameters->width = record->width;
+    parameters->height = record->height;
+    parameters->sample_aspect_ratio = record->sample_aspect_ratio;
+    parameters->field_order = (AVFieldOrder) record->field_order;
+    parameters->color_range = (AVColorRange) record->color_range;
+    parameters->color_primaries = (AVColorPrimaries) record->color_primaries;
+    parameters->color_trc = (AVColorTransferCharacteristic) record->color_trc;
+    parameters->color_space = (AVColorSpace) record->color_space;
+    parameters->chroma_location = (AVChromaLocation) record->chroma_location;
+    parameters->video_delay = record->video_delay;
+    parameters->sample_rate = record->sample_rate;
+    parameters->channel_layout = record->channel_layout;
+    parameters->channels = record->channels;
+    parameters->block_align = record->block_align;
+    parameters->frame_size = record->frame_size;
+    parameters->initial_padding = record->initial_padding;
+    parameters->seek_preroll = record->seek_preroll;
+    if (extradata != NULL) {
+        av_freep(&(parameters->extradata));
+        parameters->extradata = extradata;
+        parameters->extradata_size = record->extradata_size;
+    }
+    stream->avg_frame_rate = record->avg_frame_rate;
+    stream->r_frame_rate = record->r_frame_rate;
+    stream->duration = record->duration;
+    stream->start_time = record->start_time;
+}
+
+/**
+ * 用缓存的参数代替 avformat_find_stream_info
+ * @param format_context
+ * @param path
+ * @param directory
+ * @return
+ */
+int stream_info_cache_load(AVFormatContext* format_context, const char* path, const char* directory) {
+    int64_t file_size, file_mtime;
+    if (!stream_info_file_identity(path, &file_size, &file_mtime)) {
+        return FAIL_CODE;
+    }
+    char cache_path[512];
+    stream_info_cache_path(path, directory, cache_path, sizeof(cache_path));
+    FILE *file = fopen(cache_path, "rb");
+    if (file == NULL) {
+        return FAIL_CODE;
+    }
+    StreamInfoHeader header;
+    if (fread(&header, sizeof(StreamInfoHeader), 1, file) != 1 || memcmp(header.magic, STREAM_INFO_CACHE_MAGIC, 4) != 0
+        || header.version != STREAM_INFO_CACHE_VERSION || header.file_size != file_size || header.file_mtime != file_mtime
+        || header.stream_count != (int) format_context->nb_streams || header.stream_count > STREAM_INFO_CACHE_MAX_STREAMS) {
+        // 文件变了 或者打开后的流数量和探测时不一样 (有的流要读数据才能发现)
+        fclose(file);
+        return FAIL_CODE;
+    }
+    // 全部读出并校验之后才修改流参数 中途失败不会留下一半的参数
+    StreamInfoRecord records[STREAM_INFO_CACHE_MAX_STREAMS];
+    uint8_t *extradatas[STREAM_INFO_CACHE_MAX_STREAMS] = {NULL};
+    int result = SUCCESS_CODE;
+    for (int i = 0; i < header.stream_count && result == SUCCESS_CODE; i++) {
+        StreamInfoRecord *record = &(records[i]);
+        AVCodecParameters *parameters = format_context->streams[i]->codecpar;
+        if (fread(record, sizeof(StreamInfoRecord), 1, file) != 1 || record->codec_type != parameters->codec_type
+            || record->codec_id != parameters->codec_id
+            || record->extradata_size < 0 || record->extradata_size > STREAM_INFO_CACHE_MAX_EXTRADATA) {
+            result = FAIL_CODE;
+            break;
+        }
+        if (record->extradata_size > 0) {
+            extradatas[i] = (uint8_t*) av_mallocz((size_t) record->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (fread(extradatas[i], (size_t) record->extradata_size, 1, file) != 1) {
+                result = FAIL_CODE;
+            }
+        }
+    }
+    fclose(file);
+    if (result != SUCCESS_CODE) {
+        for (int i = 0; i < header.stream_count; i++) {
+            av_freep(&(extradatas[i]));
+        }
+        LOGE("Player Log : stream info cache %s is stale", cache_path);
+        return FAIL_CODE;
+    }
+    for (int i = 0; i < header.stream_count; i++) {
+        stream_info_record_to_stream(&(records[i]), extradatas[i], format_context->streams[i]);
+    }
+    format_context->duration = header.duration;
+    format_context->start_time = header.start_time;
+    format_context->bit_rate = header.bit_rate;
+    return SUCCESS_CODE;
+}
+
+/**
+ * 保存探测出的参数
+ * @param format_context
+ * @param path
+ * @param directory
+ * @return
+ */
+int stream_info_cache_save(AVFormatContext* format_context, const char* path, const char* directory) {
+    int64_t file_size, file_mtime;
+    if (!stream_info_file_identity(path, &file_size, &file_mtime) || format_context->nb_streams > STREAM_INFO_CACHE_MAX_STREAMS) {
+        return FAIL_CODE;
+    }
+    char cache_path[512], temp_path[520];
+    stream_info_cache_path(path, directory, cache_path, sizeof(cache_path));
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        LOGE("Player Error : Can not save stream info cache %s", cache_path);
+        return FAIL_CODE;
+    }
+    StreamInfoHeader header;
+    memset(&header, 0, sizeof(StreamInfoHeader));
+    memcpy(header.magic, STREAM_INFO_CACHE_MAGIC, 4);
+    header.version = STREAM_INFO_CACHE_VERSION;
+    header.file_size = file_size;
+    header.file_mtime = file_mtime;
+    header.duration = format_context->duration;
+    header.start_time = format_context->start_time;
+    header.bit_rate = format_context->bit_rate;
+    header.stream_count = format_context->nb_streams;
+    bool written = fwrite(&header, sizeof(StreamInfoHeader), 1, file) == 1;
+    for (unsigned int i = 0; i < format_context->nb_streams && written; i++) {
+        StreamInfoRecord record;
+        stream_info_record_from_stream(format_context->streams[i], &record);
+        if (record.extradata_size > STREAM_INFO_CACHE_MAX_EXTRADATA) {
+            written = false;
+            break;
+        }
+        written = fwrite(&record, sizeof(StreamInfoRecord), 1, file) == 1;
+        if (written && record.extradata_size > 0) {
+            written = fwrite(format_context->streams[i]->codecpar->extradata, (size_t) record.extradata_size, 1, file) == 1;
+        }
+    }
+    if (fclose(file) != 0 || !written || rename(temp_path, cache_path) != 0) {
+        unlink(temp_path);
+        LOGE("Player Error : Can not save stream info cache %s", cache_path);
+        return FAIL_CODE;
+    }
+    return SUCCESS_CODE;
+}
+
+/**
+ * 初始化内存中的流参数
+ * @param info
+ */
+void stream_info_init(StreamInfo* info) {
+    memset(info, 0, sizeof(StreamInfo));
+}
+
+/**
+ * 从探测过的解封装器复制流参数
+ * @param format_context
+ * @param info
+ * @return
+ */
+int stream_info_capture(AVFormatContext* format_context, StreamInfo* info) {
+    stream_info_destroy(info);
+    if (format_context->nb_streams > STREAM_INFO_CACHE_MAX_STREAMS) {
+        return FAIL_CODE;
+    }
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        StreamInfoRecord *record = &(info->records[i]);
+        stream_info_record_from_stream(format_context->streams[i], record);
+        if (record->extradata_size > 0) {
+            info->extradatas[i] = (uint8_t*) av_malloc((size_t) record->extradata_size);
+            memcpy(info->extradatas[i], format_context->streams[i]->codecpar->extradata, (size_t) record->extradata_size);
+        }
+    }
+    info->header.duration = format_context->duration;
+    info->header.start_time = format_context->start_time;
+    info->header.bit_rate = format_context->bit_rate;
+    info->header.stream_count = format_context->nb_streams;
+    return SUCCESS_CODE;
+}
+
+/**
+ * 用复制的流参数代替 avformat_find_stream_info
+ * @param format_context
+ * @param info
+ * @return
+ */
+int stream_info_apply(AVFormatContext* format_context, StreamInfo* info) {
+    if (info->header.stream_count == 0 || info->header.stream_count != (int) format_context->nb_streams) {
+        return FAIL_CODE;
+    }
+    for (int i = 0; i < info->header.stream_count; i++) {
+        AVCodecParameters *parameters = format_context->streams[i]->codecpar;
+        if (info->records[i].codec_type != parameters->codec_type || info->records[i].codec_id != parameters->codec_id) {
+            return FAIL_CODE;
+        }
+    }
+    for (int i = 0; i < info->header.stream_count; i++) {
+        // 每个解封装器持有自己的 extradata
+        uint8_t *extradata = NULL;
+        int extradata_size = info->records[i].extradata_size;
+        if (extradata_size > 0) {
+            extradata = (uint8_t*) av_mallocz((size_t) extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            memcpy(extradata, info->extradatas[i], (size_t) extradata_size);
+        }
+        stream_info_record_to_stream(&(info->records[i]), extradata, format_context->streams[i]);
+    }
+    format_context->duration = info->header.duration;
+    format_context->start_time = info->header.start_time;
+    format_context->bit_rate = info->header.bit_rate;
+    return SUCCESS_CODE;
+}
+
+/**
+ * 释放内存中的流参数
+ * @param info
+ */
+void stream_info_destroy(StreamInfo* info) {
+    for (int i = 0; i < STREAM_INFO_CACHE_MAX_STREAMS; i++) {
+        av_freep(&(info->extradatas[i]));
+    }
+    info->header.stream_count = 0;
+}
+
+/**
+ * 打开文件并得到流参数
+ * @param format_context
+ * @param path
+ * @param fast_start
+ * @param directory
+ * @param shared
+ * @return
+ */
+int stream_info_open(AVFormatContext** format_context, const char* path, bool fast_start, const char* directory, StreamInfo* shared) {
+    if (*format_context == NULL) {
+        *format_context = avformat_alloc_context();
+    }
+    if (fast_start) {
+        (*format_context)->probesize = FAST_START_PROBE_SIZE;
+        (*format_context)->max_analyze_duration = FAST_START_ANALYZE_DURATION;
+    }
+    int result = avformat_open_input(format_context, path, NULL, NULL);
+    if (result < 0) {
+        LOGE("Player Error : Can not open video file");
+        return result;
+    }
+    if (shared != NULL && stream_info_apply(*format_context, shared) > 0) {
+        return SUCCESS_CODE;
+    }
+    bool use_cache = directory != NULL && directory[0] != '\0';
+    if (use_cache && stream_info_cache_load(*format_context, path, directory) > 0) {
+        // 同一个文件已经探测过 跳过探测
+        LOGE("Player Log : use cached stream info");
+    } else {
+        result = avformat_find_stream_info(*format_context, NULL);
+        if (result < 0) {
+            LOGE("Player Error : Can not find video file stream info");
+            return result;
+        }
+        if (use_cache) {
+            stream_info_cache_save(*format_context, path, directory);
+        }
+    }
+    if (shared != NULL) {
+        stream_info_capture(*format_context, shared);
+    }
+    return SUCCESS_CODE;
+}
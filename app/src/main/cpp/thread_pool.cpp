@@ -0,0 +1,441 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "thread_pool.h"
+
+// 循环任务的调度状态
+// IDLE 等待唤醒 QUEUED 已经提交 RUNNING 正在执行 WOKEN 执行中被唤醒 结束后再提交 FINISHED 已经结束
+#define TASK_LOOP_STATE_IDLE 0
+#define TASK_LOOP_STATE_QUEUED 1
+#define TASK_LOOP_STATE_RUNNING 2
+#define TASK_LOOP_STATE_WOKEN 3
+#define TASK_LOOP_STATE_FINISHED 4
+
+// 当前线程所属的工作线程 不是工作线程时为 NULL
+static __thread ThreadWorker* current_worker = NULL;
+
+// 进程共享的线程池
+static ThreadPool shared_pool;
+static pthread_once_t shared_pool_once = PTHREAD_ONCE_INIT;
+
+/**
+ * 放入队列底部
+ * @param deque
+ * @param task
+ * @return 队列已满返回 false
+ */
+static bool task_deque_push(TaskDeque* deque, Task* task) {
+    if (deque->bottom - deque->top >= THREAD_POOL_DEQUE_SIZE) {
+        return false;
+    }
+    deque->tasks[deque->bottom & (THREAD_POOL_DEQUE_SIZE - 1)] = *task;
+    deque->bottom += 1;
+    return true;
+}
+
+/**
+ * 从队列底部取出 (所属的工作线程)
+ * @param deque
+ * @param task
+ * @return
+ */
+static bool task_deque_pop(TaskDeque* deque, Task* task) {
+    if (deque->bottom == deque->top) {
+        return false;
+    }
+    deque->bottom -= 1;
+    *task = deque->tasks[deque->bottom & (THREAD_POOL_DEQUE_SIZE - 1)];
+    return true;
+}
+
+/**
+ * 从队列顶部窃取 (其他工作线程)
+ * @param deque
+ * @param task
+ * @return
+ */
+static bool task_deque_steal(TaskDeque* deque, Task* task) {
+    if (deque->bottom == deque->top) {
+        return false;
+    }
+    *task = deque->tasks[deque->top & (THREAD_POOL_DEQUE_SIZE - 1)];
+    deque->top += 1;
+    return true;
+}
+
+/**
+ * 取出队列中属于任务组的任务 (等待任务组的线程)
+ * 从顶部开始找 后面的任务依次前移
+ * @param deque
+ * @param group
+ * @param task
+ * @return
+ */
+static bool task_deque_take_group(TaskDeque* deque, TaskGroup* group, Task* task) {
+    for (unsigned int i = deque->top; i != deque->bottom; i++) {
+        if (deque->tasks[i & (THREAD_POOL_DEQUE_SIZE - 1)].group != group) {
+            continue;
+        }
+        *task = deque->tasks[i & (THREAD_POOL_DEQUE_SIZE - 1)];
+        for (unsigned int j = i + 1; j != deque->bottom; j++) {
+            deque->tasks[(j - 1) & (THREAD_POOL_DEQUE_SIZE - 1)] = deque->tasks[j & (THREAD_POOL_DEQUE_SIZE - 1)];
+        }
+        deque->bottom -= 1;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * 取一个任务
+ * 按优先级从高到低 每个优先级先找自己的队列 再从其他工作线程窃取
+ * @param pool
+ * @param worker
+ * @param task
+ * @return
+ */
+static bool thread_pool_take(ThreadPool* pool, ThreadWorker* worker, Task* task) {
+    for (int priority = 0; priority < THREAD_POOL_PRIORITIES; priority++) {
+        for (int i = 0; i < pool->thread_count; i++) {
+            ThreadWorker *victim = &(pool->workers[(worker->index + i) % pool->thread_count]);
+            pthread_mutex_lock(&(victim->mutex_id));
+            bool found = victim == worker ? task_deque_pop(&(victim->deques[priority]), task)
+                                          : task_deque_steal(&(victim->deques[priority]), task);
+            pthread_mutex_unlock(&(victim->mutex_id));
+            if (found) {
+                pthread_mutex_lock(pool->mutex_id);
+                pool->pending -= 1;
+                pthread_mutex_unlock(pool->mutex_id);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * 取一个属于任务组的任务 不管优先级
+ * @param pool
+ * @param group
+ * @param task
+ * @return
+ */
+static bool thread_pool_take_group(ThreadPool* pool, TaskGroup* group, Task* task) {
+    for (int priority = 0; priority < THREAD_POOL_PRIORITIES; priority++) {
+        for (int i = 0; i < pool->thread_count; i++) {
+            ThreadWorker *worker = &(pool->workers[i]);
+            pthread_mutex_lock(&(worker->mutex_id));
+            bool found = task_deque_take_group(&(worker->deques[priority]), group, task);
+            pthread_mutex_unlock(&(worker->mutex_id));
+            if (found) {
+                pthread_mutex_lock(pool->mutex_id);
+                pool->pending -= 1;
+                pthread_mutex_unlock(pool->mutex_id);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * 执行任务 并更新任务组
+ * @param task
+ */
+static void thread_pool_run(Task* task) {
+    task->function(task->arg);
+    if (task->group != NULL) {
+        pthread_mutex_lock(&(task->group->mutex_id));
+        task->group->pending -= 1;
+        if (task->group->pending == 0) {
+            pthread_cond_broadcast(&(task->group->done_condition));
+        }
+        pthread_mutex_unlock(&(task->group->mutex_id));
+    }
+}
+
+/**
+ * 工作线程
+ * @param arg
+ * @return
+ */
+static void* thread_pool_work(void* arg) {
+    ThreadWorker *worker = (ThreadWorker*) arg;
+    ThreadPool *pool = worker->pool;
+    current_worker = worker;
+    Task task;
+    for (;;) {
+        if (thread_pool_take(pool, worker, &task)) {
+            thread_pool_run(&task);
+            continue;
+        }
+        pthread_mutex_lock(pool->mutex_id);
+        while (pool->pending == 0 && pool->is_running) {
+            pthread_cond_wait(pool->not_empty_condition, pool->mutex_id);
+        }
+        bool finished = pool->pending == 0 && !pool->is_running;
+        pthread_mutex_unlock(pool->mutex_id);
+        if (finished) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 初始化线程池
+ * @param pool
+ * @param thread_count
+ */
+void thread_pool_init(ThreadPool* pool, int thread_count) {
+    pool->thread_count = thread_count > 0 ? thread_count : 1;
+    pool->next_worker.store(0);
+    pool->pending = 0;
+    pool->is_running = true;
+    pool->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(pool->mutex_id, NULL);
+    pool->not_empty_condition = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(pool->not_empty_condition, NULL);
+    pool->workers = (ThreadWorker*) calloc((size_t) pool->thread_count, sizeof(ThreadWorker));
+    for (int i = 0; i < pool->thread_count; i++) {
+        ThreadWorker *worker = &(pool->workers[i]);
+        worker->pool = pool;
+        worker->index = i;
+        pthread_mutex_init(&(worker->mutex_id), NULL);
+    }
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_create(&(pool->workers[i].thread_id), NULL, thread_pool_work, &(pool->workers[i]));
+    }
+}
+
+/**
+ * 创建进程共享的线程池
+ */
+static void thread_pool_shared_init() {
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_pool_init(&shared_pool, cpu_count > 0 ? (int) cpu_count : 1);
+}
+
+/**
+ * 获取进程共享的线程池
+ * @return
+ */
+ThreadPool* thread_pool_shared() {
+    pthread_once(&shared_pool_once, thread_pool_shared_init);
+    return &shared_pool;
+}
+
+/**
+ * 提交任务
+ * @param pool
+ * @param function
+ * @param arg
+ * @param group
+ * @param priority
+ */
+void thread_pool_submit(ThreadPool* pool, void (*function)(void*), void* arg, TaskGroup* group, int priority) {
+    Task task;
+    task.function = function;
+    task.arg = arg;
+    task.group = group;
+    if (group != NULL) {
+        pthread_mutex_lock(&(group->mutex_id));
+        group->pending += 1;
+        group->pool = pool;
+        pthread_mutex_unlock(&(group->mutex_id));
+    }
+    if (priority < 0 || priority >= THREAD_POOL_PRIORITIES) {
+        priority = THREAD_POOL_PRIORITY_NORMAL;
+    }
+    // 先计数再放入队列 工作线程取到任务时计数不会变成负数
+    pthread_mutex_lock(pool->mutex_id);
+    pool->pending += 1;
+    pthread_mutex_unlock(pool->mutex_id);
+    int start;
+    if (current_worker != NULL && current_worker->pool == pool) {
+        start = current_worker->index;
+    } else {
+        start = (int) (pool->next_worker.fetch_add(1) % pool->thread_count);
+    }
+    bool pushed = false;
+    for (int i = 0; i < pool->thread_count && !pushed; i++) {
+        ThreadWorker *worker = &(pool->workers[(start + i) % pool->thread_count]);
+        pthread_mutex_lock(&(worker->mutex_id));
+        pushed = task_deque_push(&(worker->deques[priority]), &task);
+        pthread_mutex_unlock(&(worker->mutex_id));
+    }
+    pthread_mutex_lock(pool->mutex_id);
+    if (pushed) {
+        pthread_cond_signal(pool->not_empty_condition);
+    } else {
+        pool->pending -= 1;
+    }
+    pthread_mutex_unlock(pool->mutex_id);
+    if (!pushed) {
+        // 所有队列都满了 调用线程自己执行
+        thread_pool_run(&task);
+    }
+}
+
+/**
+ * 销毁线程池
+ * @param pool
+ */
+void thread_pool_destroy(ThreadPool* pool) {
+    pthread_mutex_lock(pool->mutex_id);
+    pool->is_running = false;
+    pthread_cond_broadcast(pool->not_empty_condition);
+    pthread_mutex_unlock(pool->mutex_id);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->workers[i].thread_id, NULL);
+    }
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_mutex_destroy(&(pool->workers[i].mutex_id));
+    }
+    free(pool->workers);
+    pthread_mutex_destroy(pool->mutex_id);
+    pthread_cond_destroy(pool->not_empty_condition);
+    free(pool->mutex_id);
+    free(pool->not_empty_condition);
+}
+
+/**
+ * 初始化任务组
+ * @param group
+ */
+void task_group_init(TaskGroup* group) {
+    group->pending = 0;
+    group->pool = NULL;
+    pthread_mutex_init(&(group->mutex_id), NULL);
+    pthread_cond_init(&(group->done_condition), NULL);
+}
+
+/**
+ * 等待任务组的任务全部完成
+ * @param group
+ */
+void task_group_wait(TaskGroup* group) {
+    pthread_mutex_lock(&(group->mutex_id));
+    ThreadPool *pool = group->pool;
+    pthread_mutex_unlock(&(group->mutex_id));
+    // 还没开始的任务自己执行 剩下的都已经在工作线程中执行 等它们完成即可
+    Task task;
+    while (pool != NULL && thread_pool_take_group(pool, group, &task)) {
+        thread_pool_run(&task);
+    }
+    pthread_mutex_lock(&(group->mutex_id));
+    while (group->pending > 0) {
+        pthread_cond_wait(&(group->done_condition), &(group->mutex_id));
+    }
+    pthread_mutex_unlock(&(group->mutex_id));
+}
+
+/**
+ * 销毁任务组
+ * @param group
+ */
+void task_group_destroy(TaskGroup* group) {
+    pthread_mutex_destroy(&(group->mutex_id));
+    pthread_cond_destroy(&(group->done_condition));
+}
+
+/**
+ * 执行循环任务的一步
+ * @param arg
+ */
+static void task_loop_run(void* arg) {
+    TaskLoop *loop = (TaskLoop*) arg;
+    loop->state.store(TASK_LOOP_STATE_RUNNING);
+    int result = loop->step(loop->arg);
+    if (result == TASK_LOOP_FINISH) {
+        // 等待的线程可能马上销毁循环任务 解锁之后不能再访问
+        pthread_mutex_lock(&(loop->mutex_id));
+        loop->state.store(TASK_LOOP_STATE_FINISHED);
+        pthread_cond_broadcast(&(loop->finish_condition));
+        pthread_mutex_unlock(&(loop->mutex_id));
+        return;
+    }
+    int expected = TASK_LOOP_STATE_RUNNING;
+    if (result == TASK_LOOP_IDLE && loop->state.compare_exchange_strong(expected, TASK_LOOP_STATE_IDLE)) {
+        return;
+    }
+    // 还有事可做 或者执行过程中被唤醒
+    loop->state.store(TASK_LOOP_STATE_QUEUED);
+    thread_pool_submit(loop->pool, task_loop_run, loop, NULL, loop->priority);
+}
+
+/**
+ * 初始化循环任务
+ * @param loop
+ * @param pool
+ * @param step
+ * @param arg
+ * @param priority
+ */
+void task_loop_init(TaskLoop* loop, ThreadPool* pool, int (*step)(void*), void* arg, int priority) {
+    loop->pool = pool;
+    loop->priority = priority;
+    loop->step = step;
+    loop->arg = arg;
+    loop->state.store(TASK_LOOP_STATE_IDLE);
+    pthread_mutex_init(&(loop->mutex_id), NULL);
+    pthread_cond_init(&(loop->finish_condition), NULL);
+}
+
+/**
+ * 唤醒循环任务
+ * @param loop
+ */
+void task_loop_wake(TaskLoop* loop) {
+    for (;;) {
+        int state = loop->state.load();
+        if (state == TASK_LOOP_STATE_IDLE) {
+            if (loop->state.compare_exchange_weak(state, TASK_LOOP_STATE_QUEUED)) {
+                thread_pool_submit(loop->pool, task_loop_run, loop, NULL, loop->priority);
+                return;
+            }
+        } else if (state == TASK_LOOP_STATE_RUNNING) {
+            if (loop->state.compare_exchange_weak(state, TASK_LOOP_STATE_WOKEN)) {
+                return;
+            }
+        } else {
+            // 已经提交 已经会再执行一次 或者已经结束
+            return;
+        }
+    }
+}
+
+/**
+ * 等待循环任务结束
+ * @param loop
+ */
+void task_loop_wait(TaskLoop* loop) {
+    pthread_mutex_lock(&(loop->mutex_id));
+    while (loop->state.load() != TASK_LOOP_STATE_FINISHED) {
+        pthread_cond_wait(&(loop->finish_condition), &(loop->mutex_id));
+    }
+    pthread_mutex_unlock(&(loop->mutex_id));
+}
+
+/**
+ * 销毁循环任务
+ * @param loop
+ */
+void task_loop_destroy(TaskLoop* loop) {
+    pthread_mutex_destroy(&(loop->mutex_id));
+    pthread_cond_destroy(&(loop->finish_condition));
+}
+
+/**
+ * 按任务优先级调整当前线程的 nice 值
+ * @param priority
+ */
+void thread_set_priority(int priority) {
+    if (priority == THREAD_POOL_PRIORITY_HIGH) {
+        return;
+    }
+    int nice = priority == THREAD_POOL_PRIORITY_NORMAL ? THREAD_NICE_NORMAL : THREAD_NICE_LOW;
+    // Linux 的 nice 是线程级的 用线程 ID 只影响当前线程
+    setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), nice);
+}
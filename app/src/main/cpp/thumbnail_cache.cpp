@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include "thumbnail_cache.h"
+#include "util.h"
+
+/**
+ * 计算键的哈希
+ * @param path
+ * @param time
+ * @param width
+ * @param height
+ * @return
+ */
+static uint64_t thumbnail_hash(const char* path, int64_t time, int width, int height) {
+    uint64_t hash = string_hash(path);
+    int64_t values[3] = {time, width, height};
+    for (int i = 0; i < 3; i++) {
+        hash ^= (uint64_t) values[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * 在哈希桶中查找
+ * @param cache
+ * @param hash
+ * @param path
+ * @param time
+ * @param width
+ * @param height
+ * @return
+ */
+static Thumbnail* thumbnail_cache_find(ThumbnailCache* cache, uint64_t hash, const char* path, int64_t time, int width, int height) {
+    Thumbnail *thumbnail = cache->buckets[hash & (THUMBNAIL_CACHE_BUCKETS - 1)];
+    while (thumbnail != NULL) {
+        if (thumbnail->hash == hash && thumbnail->time == time && thumbnail->width == width
+            && thumbnail->height == height && strcmp(thumbnail->path, path) == 0) {
+            return thumbnail;
+        }
+        thumbnail = thumbnail->bucket_next;
+    }
+    return NULL;
+}
+
+/**
+ * 从 LRU 链表中摘下
+ * @param cache
+ * @param thumbnail
+ */
+static void thumbnail_cache_unlink(ThumbnailCache* cache, Thumbnail* thumbnail) {
+    if (thumbnail->prev != NULL) {
+        thumbnail->prev->next = thumbnail->next;
+    } else {
+        cache->head = thumbnail->next;
+    }
+    if (thumbnail->next != NULL) {
+        thumbnail->next->prev = thumbnail->prev;
+    } else {
+        cache->tail = thumbnail->prev;
+    }
+    thumbnail->prev = NULL;
+    thumbnail->next = NULL;
+}
+
+/**
+ * 放到 LRU 链表头部
+ * @param cache
+ * @param thumbnail
+ */
+static void thumbnail_cache_push_front(ThumbnailCache* cache, Thumbnail* thumbnail) {
+    thumbnail->prev = NULL;
+    thumbnail->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = thumbnail;
+    }
+    cache->head = thumbnail;
+    if (cache->tail == NULL) {
+        cache->tail = thumbnail;
+    }
+}
+
+/**
+ * 移除并释放
+ * @param cache
+ * @param thumbnail
+ */
+static void thumbnail_cache_remove(ThumbnailCache* cache, Thumbnail* thumbnail) {
+    Thumbnail **link = &(cache->buckets[thumbnail->hash & (THUMBNAIL_CACHE_BUCKETS - 1)]);
+    while (*link != thumbnail) {
+        link = &((*link)->bucket_next);
+    }
+    *link = thumbnail->bucket_next;
+    thumbnail_cache_unlink(cache, thumbnail);
+    cache->bytes -= thumbnail->size;
+    free(thumbnail->path);
+    free(thumbnail->pixels);
+    free(thumbnail);
+}
+
+/**
+ * 初始化缓存
+ * @param cache
+ * @param max_bytes
+ */
+void thumbnail_cache_init(ThumbnailCache* cache, int64_t max_bytes) {
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->bytes = 0;
+    cache->max_bytes = max_bytes;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->mutex_id = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(cache->mutex_id, NULL);
+}
+
+/**
+ * 查找缩略图
+ * @param cache
+ * @param path
+ * @param time
+ * @param width
+ * @param height
+ * @param dst
+ * @param dst_linesize
+ * @return
+ */
+bool thumbnail_cache_get(ThumbnailCache* cache, const char* path, int64_t time, int width, int height, uint8_t* dst, int dst_linesize) {
+    uint64_t hash = thumbnail_hash(path, time, width, height);
+    pthread_mutex_lock(cache->mutex_id);
+    Thumbnail *thumbnail = thumbnail_cache_find(cache, hash, path, time, width, height);
+    if (thumbnail == NULL) {
+        cache->misses += 1;
+        pthread_mutex_unlock(cache->mutex_id);
+        return false;
+    }
+    cache->hits += 1;
+    thumbnail_cache_unlink(cache, thumbnail);
+    thumbnail_cache_push_front(cache, thumbnail);
+    for (int y = 0; y < height; y++) {
+        memcpy(dst + y * dst_linesize, thumbnail->pixels + y * width * 4, (size_t) width * 4);
+    }
+    pthread_mutex_unlock(cache->mutex_id);
+    return true;
+}
+
+/**
+ * 放入缩略图
+ * @param cache
+ * @param path
+ * @param time
+ * @param width
+ * @param height
+ * @param pixels
+ */
+void thumbnail_cache_put(ThumbnailCache* cache, const char* path, int64_t time, int width, int height, const uint8_t* pixels) {
+    int size = width * height * 4;
+    if (size > cache->max_bytes) {
+        return;
+    }
+    uint64_t hash = thumbnail_hash(path, time, width, height);
+    pthread_mutex_lock(cache->mutex_id);
+    Thumbnail *thumbnail = thumbnail_cache_find(cache, hash, path, time, width, height);
+    if (thumbnail != NULL) {
+        // 同时有两个请求生成了同一张 保留已有的
+        thumbnail_cache_unlink(cache, thumbnail);
+        thumbnail_cache_push_front(cache, thumbnail);
+        pthread_mutex_unlock(cache->mutex_id);
+        return;
+    }
+    while (cache->tail != NULL && cache->bytes + size > cache->max_bytes) {
+        thumbnail_cache_remove(cache, cache->tail);
+    }
+    thumbnail = (Thumbnail*) malloc(sizeof(Thumbnail));
+    thumbnail->path = strdup(path);
+    thumbnail->time = time;
+    thumbnail->width = width;
+    thumbnail->height = height;
+    thumbnail->hash = hash;
+    thumbnail->size = size;
+    thumbnail->pixels = (uint8_t*) malloc((size_t) size);
+    memcpy(thumbnail->pixels, pixels, (size_t) size);
+    Thumbnail **bucket = &(cache->buckets[hash & (THUMBNAIL_CACHE_BUCKETS - 1)]);
+    thumbnail->bucket_next = *bucket;
+    *bucket = thumbnail;
+    thumbnail_cache_push_front(cache, thumbnail);
+    cache->bytes += size;
+    pthread_mutex_unlock(cache->mutex_id);
+}
+
+/**
+ * 清空缓存
+ * @param cache
+ */
+void thumbnail_cache_clear(ThumbnailCache* cache) {
+    pthread_mutex_lock(cache->mutex_id);
+    while (cache->tail != NULL) {
+        thumbnail_cache_remove(cache, cache->tail);
+    }
+    pthread_mutex_unlock(cache->mutex_id);
+}
+
+/**
+ * 销毁缓存
+ * @param cache
+ */
+void thumbnail_cache_destroy(ThumbnailCache* cache) {
+    thumbnail_cache_clear(cache);
+    pthread_mutex_destroy(cache->mutex_id);
+    free(cache->mutex_id);
+}
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include "thumbnailer.h"
+#include "color_convert.h"
+#include "util.h"
+
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libavutil/cpu.h"
+}
+
+// 一个任务使用的解封装器和解码器
+typedef struct _ThumbnailSource {
+    AVFormatContext* format_context;
+    AVCodecContext* codec_context;
+    int stream_index;
+    AVPacket* packet;
+    AVFrame* frame;
+    ColorConverter converter;
+    // 输出的 RGBA (紧密排列) 放入缓存用
+    uint8_t* pixels;
+    int pixels_size;
+} ThumbnailSource;
+
+/**
+ * 选择 lowres 级别
+ * 解码器支持时 在不小于输出尺寸的前提下尽量缩小解码分辨率
+ * @param codec
+ * @param parameters
+ * @param width
+ * @param height
+ * @return
+ */
+static int thumbnail_lowres(AVCodec* codec, AVCodecParameters* parameters, int width, int height) {
+    int lowres = 0;
+    int max_lowres = av_codec_get_max_lowres(codec);
+    while (lowres < max_lowres && (parameters->width >> (lowres + 1)) >= width && (parameters->height >> (lowres + 1)) >= height) {
+        lowres++;
+    }
+    return lowres;
+}
+
+/**
+ * 打开解封装器和解码器
+ * 使用批次开始时打开的解封装器 或者用批次的探测结果打开
+ * @param source
+ * @param job
+ * @param width 最大输出宽度
+ * @param height 最大输出高度
+ * @return
+ */
+static int thumbnail_source_open(ThumbnailSource* source, ThumbnailJob* job, int width, int height) {
+    memset((void*) source, 0, sizeof(ThumbnailSource));
+    color_converter_init(&(source->converter));
+    int result;
+    if (job->format_context != NULL) {
+        source->format_context = job->format_context;
+        job->format_context = NULL;
+    } else {
+        result = stream_info_open(&(source->format_context), job->path, true, NULL, job->stream_info);
+        if (result < 0) {
+            LOGE("Player Error : Thumbnail can not open %s", job->path);
+            return result;
+        }
+    }
+    AVCodec *codec = NULL;
+    source->stream_index = av_find_best_stream(source->format_context, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (source->stream_index < 0 || codec == NULL) {
+        LOGE("Player Error : Thumbnail can not find video stream");
+        return FAIL_CODE;
+    }
+    for (unsigned int i = 0; i < source->format_context->nb_streams; i++) {
+        if ((int) i != source->stream_index) {
+            source->format_context->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    AVCodecParameters *parameters = source->format_context->streams[source->stream_index]->codecpar;
+    source->codec_context = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(source->codec_context, parameters);
+    // 只解码关键帧 并行在任务之间 解码器本身单线程
+    source->codec_context->skip_frame = AVDISCARD_NONKEY;
+    source->codec_context->skip_loop_filter = AVDISCARD_ALL;
+    source->codec_context->flags2 |= AV_CODEC_FLAG2_FAST;
+    source->codec_context->thread_count = 1;
+    source->codec_context->lowres = thumbnail_lowres(codec, parameters, width, height);
+    result = avcodec_open2(source->codec_context, codec, NULL);
+    if (result < 0) {
+        LOGE("Player Error : Thumbnail can not open codec");
+        return result;
+    }
+    source->packet = av_packet_alloc();
+    source->frame = av_frame_alloc();
+    return SUCCESS_CODE;
+}
+
+/**
+ * 解码 time 之前最近的关键帧
+ * @param source
+ * @param time 毫秒
+ * @return
+ */
+static int thumbnail_source_decode(ThumbnailSource* source, int64_t time) {
+    AVFormatContext *format_context = source->format_context;
+    int64_t target = av_rescale(time, AV_TIME_BASE, 1000);
+    if (format_context->start_time != AV_NOPTS_VALUE) {
+        target += format_context->start_time;
+    }
+    int result = avformat_seek_file(format_context, -1, INT64_MIN, target, target, 0);
+    if (result < 0) {
+        return result;
+    }
+    avcodec_flush_buffers(source->codec_context);
+    int packets = 0;
+    bool draining = false;
+    while (packets < THUMBNAIL_MAX_PACKETS) {
+        if (!draining) {
+            result = av_read_frame(format_context, source->packet);
+            if (result < 0) {
+                // 文件结束 取出解码器里剩下的帧
+                draining = true;
+                result = avcodec_send_packet(source->codec_context, NULL);
+            } else if (source->packet->stream_index == source->stream_index) {
+                packets++;
+                result = avcodec_send_packet(source->codec_context, source->packet);
+                av_packet_unref(source->packet);
+            } else {
+                av_packet_unref(source->packet);
+                continue;
+            }
+            // EAGAIN 表示解码器里已经有帧 下面先取出 其他错误 (关键帧损坏等) 不再往后找 避免取到后面 GOP 的帧
+            if (result < 0 && result != AVERROR(EAGAIN)) {
+                print_error(result);
+                LOGE("Player Error : Thumbnail send packet fail");
+                return result;
+            }
+        }
+        result = avcodec_receive_frame(source->codec_context, source->frame);
+        if (result == 0) {
+            return SUCCESS_CODE;
+        }
+        if (draining || result != AVERROR(EAGAIN)) {
+            return result;
+        }
+    }
+    return FAIL_CODE;
+}
+
+/**
+ * 关闭解封装器和解码器
+ * @param source
+ */
+static void thumbnail_source_close(ThumbnailSource* source) {
+    av_frame_free(&(source->frame));
+    av_packet_free(&(source->packet));
+    avcodec_free_context(&(source->codec_context));
+    avformat_close_input(&(source->format_context));
+    color_converter_destroy(&(source->converter));
+    free(source->pixels);
+}
+
+/**
+ * 工作线程执行的任务
+ * 按时间顺序生成一段缩略图
+ * @param arg
+ */
+static void thumbnail_job_run(void* arg) {
+    ThumbnailJob *job = (ThumbnailJob*) arg;
+    int width = 0, height = 0;
+    for (int i = 0; i < job->count; i++) {
+        width = FFMAX(width, job->requests[i]->width);
+        height = FFMAX(height, job->requests[i]->height);
+    }
+    ThumbnailSource source;
+    if (thumbnail_source_open(&source, job, width, height) > 0) {
+        for (int i = 0; i < job->count; i++) {
+            ThumbnailRequest *request = job->requests[i];
+            if (thumbnail_source_decode(&source, request->time) < 0) {
+                continue;
+            }
+            int size = request->width * request->height * 4;
+            if (size > source.pixels_size) {
+                free(source.pixels);
+                source.pixels = (uint8_t*) malloc((size_t) size);
+                source.pixels_size = size;
+            }
+            int result = color_convert(&(source.converter), source.frame, source.pixels, request->width * 4, request->width, request->height);
+            av_frame_unref(source.frame);
+            if (result < 0) {
+                continue;
+            }
+            for (int y = 0; y < request->height; y++) {
+                memcpy(request->dst + y * request->dst_linesize, source.pixels + y * request->width * 4, (size_t) request->width * 4);
+            }
+            thumbnail_cache_put(&(job->thumbnailer->cache), job->path, request->time, request->width, request->height, source.pixels);
+            request->done = true;
+        }
+    }
+    thumbnail_source_close(&source);
+}
+
+/**
+ * 按时间比较请求
+ * @param a
+ * @param b
+ * @return
+ */
+static int thumbnail_request_compare(const void* a, const void* b) {
+    int64_t time_a = (*(ThumbnailRequest* const*) a)->time;
+    int64_t time_b = (*(ThumbnailRequest* const*) b)->time;
+    return time_a < time_b ? -1 : (time_a > time_b ? 1 : 0);
+}
+
+/**
+ * 初始化缩略图服务
+ * @param thumbnailer
+ * @param thread_count
+ * @param cache_bytes
+ * @param stream_info_cache_dir
+ */
+void thumbnailer_init(Thumbnailer* thumbnailer, int thread_count, int64_t cache_bytes, const char* stream_info_cache_dir) {
+    av_register_all();
+    if (thread_count <= 0) {
+        thread_count = thread_pool_shared()->thread_count;
+    }
+    thumbnailer->thread_count = thread_count;
+    thumbnailer->stream_info_cache_dir[0] = '\0';
+    if (stream_info_cache_dir != NULL) {
+        strncpy(thumbnailer->stream_info_cache_dir, stream_info_cache_dir, sizeof(thumbnailer->stream_info_cache_dir) - 1);
+        thumbnailer->stream_info_cache_dir[sizeof(thumbnailer->stream_info_cache_dir) - 1] = '\0';
+    }
+    thumbnail_cache_init(&(thumbnailer->cache), cache_bytes);
+}
+
+/**
+ * 生成一批缩略图
+ * @param thumbnailer
+ * @param path
+ * @param requests
+ * @param count
+ * @return
+ */
+int thumbnailer_get(Thumbnailer* thumbnailer, const char* path, ThumbnailRequest* requests, int count) {
+    ThumbnailRequest **pending = (ThumbnailRequest**) malloc(sizeof(ThumbnailRequest*) * FFMAX(count, 1));
+    int pending_count = 0;
+    for (int i = 0; i < count; i++) {
+        ThumbnailRequest *request = &(requests[i]);
+        request->done = thumbnail_cache_get(&(thumbnailer->cache), path, request->time, request->width, request->height, request->dst, request->dst_linesize);
+        if (!request->done) {
+            pending[pending_count++] = request;
+        }
+    }
+    // 只打开和探测一次 第一段直接使用这个解封装器 其他段用探测结果打开
+    AVFormatContext *format_context = NULL;
+    StreamInfo stream_info;
+    stream_info_init(&stream_info);
+    if (pending_count > 0 && stream_info_open(&format_context, path, true, thumbnailer->stream_info_cache_dir, &stream_info) < 0) {
+        LOGE("Player Error : Thumbnail can not open %s", path);
+        pending_count = 0;
+    }
+    if (pending_count > 0) {
+        // 按时间排序后平均分段 每段顺序 seek 解封装器只打开一次
+        // 每段不超过 THUMBNAIL_JOB_MAX_REQUESTS 个 工作线程可以及时让给播放器的任务
+        qsort(pending, (size_t) pending_count, sizeof(ThumbnailRequest*), thumbnail_request_compare);
+        int job_count = FFMIN(thumbnailer->thread_count, pending_count);
+        job_count = FFMAX(job_count, (pending_count + THUMBNAIL_JOB_MAX_REQUESTS - 1) / THUMBNAIL_JOB_MAX_REQUESTS);
+        ThumbnailJob *jobs = (ThumbnailJob*) malloc(sizeof(ThumbnailJob) * job_count);
+        TaskGroup group;
+        task_group_init(&group);
+        int start = 0;
+        for (int i = 0; i < job_count; i++) {
+            int end = (int) ((int64_t) pending_count * (i + 1) / job_count);
+            jobs[i].thumbnailer = thumbnailer;
+            jobs[i].path = path;
+            jobs[i].format_context = i == 0 ? format_context : NULL;
+            jobs[i].stream_info = &stream_info;
+            jobs[i].requests = pending + start;
+            jobs[i].count = end - start;
+            thread_pool_submit(thread_pool_shared(), thumbnail_job_run, &(jobs[i]), &group, THREAD_POOL_PRIORITY_LOW);
+            start = end;
+        }
+        // 已经交给第一段 由它关闭
+        format_context = NULL;
+        task_group_wait(&group);
+        task_group_destroy(&group);
+        free(jobs);
+    }
+    avformat_close_input(&format_context);
+    stream_info_destroy(&stream_info);
+    free(pending);
+    int done_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (requests[i].done) {
+            done_count++;
+        }
+    }
+    return done_count;
+}
+
+/**
+ * 销毁缩略图服务
+ * @param thumbnailer
+ */
+void thumbnailer_destroy(Thumbnailer* thumbnailer) {
+    thumbnail_cache_destroy(&(thumbnailer->cache));
+}
@@ -0,0 +1,33 @@
+#include <string.h>
+#include "util.h"
+
+extern "C" {
+#include "libavutil/error.h"
+}
+
+/**
+ * 错误打印
+ * @param err
+ */
+void print_error(int err) {
+    char err_buf[128];
+    const char *err_buf_ptr = err_buf;
+    if (av_strerror(err, err_buf, sizeof(err_buf)) < 0) {
+        err_buf_ptr = strerror(AVUNERROR(err));
+    }
+    LOGE("ffmpeg error descript : %s", err_buf_ptr);
+}
+
+/**
+ * 字符串哈希
+ * @param value
+ * @return
+ */
+uint64_t string_hash(const char* value) {
+    uint64_t hash = HASH_OFFSET_BASIS;
+    for (const char* c = value; *c != '\0'; c++) {
+        hash ^= (uint8_t) *c;
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
@@ -3,8 +3,11 @@ package com.johan.player;
 import android.media.AudioFormat;
 import android.media.AudioManager;
 import android.media.AudioTrack;
+import android.os.Build;
 import android.view.Surface;
 
+import java.nio.ByteBuffer;
+
 /**
  * Created by johan on 2018/10/16.
  */
@@ -12,6 +15,16 @@ import android.view.Surface;
 public class Player {
 
     private AudioTrack audioTrack;
+    private int audioTrackBufferSize;
+    // 实际使用的音频输出格式
+    private volatile int audioSampleRate;
+    private volatile int audioChannels;
+    private volatile int audioFramesPerPeriod;
+    // API 21 以下 AudioTrack 不能直接写 ByteBuffer 复用这个数组中转
+    private byte[] audioData;
+    // C 层播放器 由 C 写入 播放结束后为 0
+    // 访问它的 native 方法都是 synchronized 的 C 层释放时在同一个锁里清掉
+    private long nativeHandle;
 
     static {
         System.loadLibrary("player");
@@ -48,6 +61,7 @@ public class Player {
         int bufferSize = AudioTrack.getMinBufferSize(sampleRate, channelConfig, AudioFormat.ENCODING_PCM_16BIT);
         audioTrack = new AudioTrack(AudioManager.STREAM_MUSIC, sampleRate, channelConfig,
                 AudioFormat.ENCODING_PCM_16BIT, bufferSize, AudioTrack.MODE_STREAM);
+        audioTrackBufferSize = bufferSize;
         audioTrack.play();
     }
 
@@ -63,6 +77,98 @@ public class Player {
         }
     }
 
+    /**
+     * 获取设备原生输出采样率
+     * 由 C 反射调用
+     * @return
+     */
+    public int getNativeOutputSampleRate() {
+        return AudioTrack.getNativeOutputSampleRate(AudioManager.STREAM_MUSIC);
+    }
+
+    /**
+     * 音频输出格式确定
+     * 由 C 反射调用
+     * @param sampleRate 采样率
+     * @param channels 通道数
+     * @param framesPerPeriod 每次输出的帧数
+     */
+    public void onAudioFormat(int sampleRate, int channels, int framesPerPeriod) {
+        audioSampleRate = sampleRate;
+        audioChannels = channels;
+        audioFramesPerPeriod = framesPerPeriod;
+    }
+
+    /**
+     * 实际输出的采样率 音频开始播放前为 0
+     * @return
+     */
+    public int getAudioSampleRate() {
+        return audioSampleRate;
+    }
+
+    /**
+     * 实际输出的通道数
+     * @return
+     */
+    public int getAudioChannels() {
+        return audioChannels;
+    }
+
+    /**
+     * 每次输出的帧数
+     * @return
+     */
+    public int getAudioFramesPerPeriod() {
+        return audioFramesPerPeriod;
+    }
+
+    /**
+     * 获取 AudioTrack 已经播放的帧数
+     * 由 C 反射调用
+     * @return
+     */
+    public int getAudioTrackPosition() {
+        if (audioTrack == null) {
+            return 0;
+        }
+        return audioTrack.getPlaybackHeadPosition();
+    }
+
+    /**
+     * 获取 AudioTrack 缓冲区大小
+     * C 按这个大小攒数据 一次写入
+     * 由 C 反射调用
+     * @return
+     */
+    public int getAudioTrackBufferSize() {
+        return audioTrackBufferSize;
+    }
+
+    /**
+     * 播放 AudioTrack
+     * buffer 是 C 分配的 DirectByteBuffer 每次都是同一个对象 不产生垃圾
+     * 由 C 反射调用
+     * @param buffer
+     * @param length
+     */
+    public void playAudioBuffer(ByteBuffer buffer, int length) {
+        if (audioTrack == null || audioTrack.getPlayState() != AudioTrack.PLAYSTATE_PLAYING) {
+            return;
+        }
+        buffer.clear();
+        buffer.limit(length);
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.LOLLIPOP) {
+            audioTrack.write(buffer, length, AudioTrack.WRITE_BLOCKING);
+        } else {
+            if (audioData == null || audioData.length < length) {
+                audioData = new byte[length];
+            }
+            buffer.get(audioData, 0, length);
+            audioTrack.write(audioData, 0, length);
+        }
+    }
+
     /**
      * 释放 AudioTrack
      * 由 C 反射调用
@@ -83,13 +189,118 @@ public class Player {
      * @param surface
      * @param callback
      */
-    public native void play(String path, Surface surface, PlayerCallback callback);
+    public void play(String path, Surface surface, PlayerCallback callback) {
+        play(path, surface, callback, new Options());
+    }
 
     /**
-     * 快进/快退
+     * 同步播放音视频
+     * @param path
+     * @param surface
+     * @param callback
+     * @param options
+     */
+    public void play(String path, Surface surface, PlayerCallback callback, Options options) {
+        play(path, surface, callback, options, null);
+    }
+
+    /**
+     * 同步播放音视频
+     * preloader 中有这个文件预加载好的会话时直接接管 跳过打开 探测和缓冲 (使用预加载时的配置)
+     * @param path
+     * @param surface
+     * @param callback
+     * @param options
+     * @param preloader 可以为 null
+     */
+    public synchronized native void play(String path, Surface surface, PlayerCallback callback, Options options, Preloader preloader);
+
+    /**
+     * 快进/快退 (定位到目标之前最近的关键帧)
      * @param progress
      */
-    public native void seekTo(int progress);
+    public void seekTo(int progress) {
+        seekTo(progress, false);
+    }
+
+    /**
+     * 快进/快退
+     * 连续调用只处理最后一次
+     * @param progress 目标位置 (秒)
+     * @param accurate 是否精确定位 false 定位到关键帧 速度快 true 丢掉目标之前的帧 从目标位置开始播放
+     */
+    public synchronized native void seekTo(int progress, boolean accurate);
+
+    /**
+     * 拖动预览
+     * 拖动时调用 只显示目标位置之前的关键帧 不播放声音 松手后调用 seekTo(progress, true) 恢复播放
+     * 不阻塞 连续调用只处理最后一次
+     * @param progress 目标位置 (秒)
+     */
+    public synchronized native void scrubTo(int progress);
+
+    /**
+     * 获取播放统计
+     * @param stats
+     */
+    public synchronized native void getStats(Stats stats);
+
+    /**
+     * 播放统计
+     * 由 C 反射写入
+     */
+    public static class Stats {
+        /**
+         * 解码的视频帧数
+         */
+        public long framesDecoded;
+        /**
+         * 显示的视频帧数
+         */
+        public long framesRendered;
+        /**
+         * 落后丢掉的视频帧数
+         */
+        public long framesDropped;
+        /**
+         * 当前跳过解码的级别 0 正常 1 跳过非参考帧 2 再跳过环路滤波 3 再跳过非关键帧 IDCT
+         */
+        public int skipLevel;
+        /**
+         * 快进/快退次数
+         */
+        public long seekCount;
+        /**
+         * 还没处理就被新请求覆盖的快进/快退次数
+         */
+        public long seekCoalesced;
+        /**
+         * 预读 IO 从源读取的字节数和耗时 (毫秒) 两者相除就是读取速度
+         */
+        public long ioBytesRead;
+        public long ioReadTimeMs;
+        /**
+         * 解封装线程等待预读数据的次数和耗时 (毫秒)
+         */
+        public long ioStallCount;
+        public long ioStallTimeMs;
+        /**
+         * 打开文件 (解封装和探测) 的耗时 (毫秒)
+         */
+        public long openTimeMs;
+        /**
+         * 最近一次快进/快退从请求到显示第一帧的耗时 (毫秒)
+         */
+        public long seekLatencyMs;
+        /**
+         * 从调用 play 到显示第一帧的耗时 (毫秒)
+         */
+        public long firstFrameTimeMs;
+        /**
+         * 是否由预加载的会话开始播放
+         */
+        public boolean preloaded;
+    }
 
     /**
      * 播放器回调
@@ -111,6 +322,140 @@ public class Player {
         void onEnd();
     }
 
+    /**
+     * 播放器配置
+     * 由 C 反射读取
+     */
+    public static class Options {
+        /**
+         * 视频队列水位
+         * 缓冲超过 Max 时暂停读取 回落到 Min 以下才继续 0 表示不限制
+         */
+        public long videoQueueMaxBytes = 16 * 1024 * 1024;
+        public long videoQueueMinBytes = 8 * 1024 * 1024;
+        public long videoQueueMaxMs = 5000;
+        public long videoQueueMinMs = 2500;
+        /**
+         * 音频队列水位
+         */
+        public long audioQueueMaxBytes = 2 * 1024 * 1024;
+        public long audioQueueMinBytes = 1024 * 1024;
+        public long audioQueueMaxMs = 10000;
+        public long audioQueueMinMs = 5000;
+        /**
+         * 解码线程类型
+         */
+        public static final int THREAD_TYPE_AUTO = 0;
+        public static final int THREAD_TYPE_FRAME = 1;
+        public static final int THREAD_TYPE_SLICE = 2;
+        /**
+         * 视频解码线程数 0 表示按 CPU 核数自动选择
+         */
+        public int decoderThreads = 0;
+        /**
+         * 视频解码线程类型
+         */
+        public int decoderThreadType = THREAD_TYPE_AUTO;
+        /**
+         * 低延迟模式 自动选择时优先切片线程
+         */
+        public boolean lowLatency = false;
+        /**
+         * 按解码器名称覆盖线程策略 如 "hevc=frame:8,h264=slice:0"
+         */
+        public String decoderThreadOverrides;
+        /**
+         * 优先使用 MediaCodec 硬件解码 不支持或出错时自动回退到软件解码
+         */
+        public boolean hardwareDecode = true;
+        /**
+         * 硬件解码直接渲染到 Surface 省去拷贝和格式转换
+         */
+        public boolean hardwareRender = false;
+        /**
+         * 窗口支持 YV12 时直接渲染 YUV 跳过 RGBA 转换
+         */
+        public boolean yuvRender = true;
+        /**
+         * 高分辨率颜色转换的并行线程数 0 表示自动 1 表示不并行
+         */
+        public int convertThreads = 0;
+        /**
+         * 音频输出类型
+         * OPENSL 由 OpenSL ES 回调拉取数据 不经过 JNI 打开失败自动回退到 AUDIO_TRACK
+         * NULL 不输出声音 只按实时速度消耗数据
+         */
+        public static final int AUDIO_SINK_OPENSL = 0;
+        public static final int AUDIO_SINK_AUDIO_TRACK = 1;
+        public static final int AUDIO_SINK_NULL = 2;
+        public int audioSink = AUDIO_SINK_OPENSL;
+        /**
+         * 音频输出为 NULL 时把 PCM 写到这个文件 用于调试
+         */
+        public String audioDumpPath;
+        /**
+         * 音频输出采样率 0 表示使用设备原生采样率 避免系统混音器再重采样一次
+         */
+        public int audioSampleRate = 0;
+        /**
+         * 设备每次混音的帧数 可以取 AudioManager.PROPERTY_OUTPUT_FRAMES_PER_BUFFER 0 表示未知
+         */
+        public int audioFramesPerBurst = 0;
+        /**
+         * 主时钟 音视频按主时钟同步
+         */
+        public static final int SYNC_MASTER_AUDIO = 0;
+        public static final int SYNC_MASTER_VIDEO = 1;
+        public static final int SYNC_MASTER_EXTERNAL = 2;
+        public int syncMaster = SYNC_MASTER_AUDIO;
+        /**
+         * 视频落后时丢帧 丢帧持续出现时让解码器逐级跳过部分解码工作
+         */
+        public boolean frameDrop = true;
+        /**
+         * 关键帧索引文件目录 (例如 Context.getCacheDir()) 为空不使用
+         * MPEG-TS / FLV / 裸流这类没有索引的容器 记录关键帧位置 快进/快退直接按字节定位
+         */
+        public String keyframeIndexDir;
+        /**
+         * 是否在后台扫描整个文件建立关键帧索引 否则只记录播放过的部分
+         */
+        public boolean keyframeIndexScan = false;
+        /**
+         * 预读缓冲区字节数 由独立的 IO 线程按大块顺序预读 0 表示不预读
+         */
+        public int ioPrefetchBytes = 4 * 1024 * 1024;
+        /**
+         * 本地文件使用内存映射读取 映射失败 (例如 32 位进程映射超大文件) 时回退到预读
+         */
+        public boolean ioMmap = true;
+        /**
+         * 快速启动 限制打开时探测读取的数据量和时长 缩短首帧时间
+         */
+        public boolean fastStart = false;
+        /**
+         * 探测结果缓存目录 (例如 Context.getCacheDir()) 为空不缓存
+         * 再次打开同一个文件时直接使用缓存的流参数 跳过探测
+         */
+        public String streamInfoCacheDir;
+        /**
+         * 调度优先级 所有播放器的视频解码和颜色转换在一个线程池中执行 前台播放器的任务先于后台 (多路预览) 播放器执行
+         * 后台播放器的解封装 渲染和音频线程调低调度优先级 (nice)
+         * 后台播放器未指定 decoderThreads 时只用一个解码线程 避免多路播放时线程过多
+         */
+        public static final int PRIORITY_FOREGROUND = 0;
+        public static final int PRIORITY_BACKGROUND = 1;
+        public int priority = PRIORITY_FOREGROUND;
+        /**
+         * 预加载 (Preloader) 时缓冲的字节数 不会超过队列水位
+         */
+        public int preloadBytes = 2 * 1024 * 1024;
+        /**
+         * 预加载时提前解出第一帧 开始播放时立即显示
+         */
+        public boolean preloadFirstFrame = true;
+    }
+
     /**
      * 测试C多线程
      */
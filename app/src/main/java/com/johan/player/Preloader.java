@@ -0,0 +1,68 @@
+package com.johan.player;
+
+/**
+ * 预加载器
+ * 在后台打开 探测 缓冲接下来要播放的文件 (可以提前解出第一帧)
+ * 调用 Player.play 时传入 有预加载好的会话直接接管 缩短切换到第一帧的时间
+ * 最多保留 maxItems 项 超过时淘汰最久没有使用的
+ */
+public class Preloader {
+
+    static {
+        System.loadLibrary("player");
+    }
+
+    private long nativeHandle;
+
+    public Preloader() {
+        this(3);
+    }
+
+    /**
+     * @param maxItems 最多保留的预加载项数 每项的缓冲量由 Player.Options.preloadBytes 限制
+     */
+    public Preloader(int maxItems) {
+        nativeHandle = nativeCreate(maxItems);
+    }
+
+    /**
+     * 预加载 不阻塞
+     * 已经在预加载的文件只更新使用顺序
+     * @param path 文件
+     * @param options 播放配置 接管后按这个配置播放
+     */
+    public synchronized void preload(String path, Player.Options options) {
+        if (nativeHandle == 0) {
+            return;
+        }
+        nativePreload(nativeHandle, path, options != null ? options : new Player.Options());
+    }
+
+    /**
+     * 取消预加载 释放已经缓冲的数据
+     * @param path
+     */
+    public synchronized void cancel(String path) {
+        if (nativeHandle == 0) {
+            return;
+        }
+        nativeCancel(nativeHandle, path);
+    }
+
+    /**
+     * 释放 不再使用时调用
+     */
+    public synchronized void release() {
+        nativeRelease(nativeHandle);
+        nativeHandle = 0;
+    }
+
+    private native long nativeCreate(int maxItems);
+
+    private native void nativePreload(long handle, String path, Player.Options options);
+
+    private native void nativeCancel(long handle, String path);
+
+    private native void nativeRelease(long handle);
+
+}
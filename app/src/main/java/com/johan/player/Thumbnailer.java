@@ -0,0 +1,79 @@
+package com.johan.player;
+
+import android.graphics.Bitmap;
+
+/**
+ * 缩略图服务
+ * 不需要播放器 只解码关键帧 用于进度条预览和雪碧图
+ * 生成是阻塞的 需要在后台线程调用
+ */
+public class Thumbnailer {
+
+    static {
+        System.loadLibrary("player");
+    }
+
+    private long nativeHandle;
+
+    public Thumbnailer() {
+        this(0, 32 * 1024 * 1024);
+    }
+
+    /**
+     * @param threads 并行生成的段数 0 表示 CPU 核数 (与播放器共用线程池 以低优先级执行)
+     * @param cacheBytes 缓存的像素字节数
+     */
+    public Thumbnailer(int threads, long cacheBytes) {
+        this(threads, cacheBytes, null);
+    }
+
+    /**
+     * @param threads 并行生成的段数 0 表示 CPU 核数 (与播放器共用线程池 以低优先级执行)
+     * @param cacheBytes 缓存的像素字节数
+     * @param streamInfoCacheDir 探测结果缓存目录 和 Player.Options.streamInfoCacheDir 相同时共用 为空不缓存
+     */
+    public Thumbnailer(int threads, long cacheBytes, String streamInfoCacheDir) {
+        nativeHandle = nativeCreate(threads, cacheBytes, streamInfoCacheDir);
+    }
+
+    /**
+     * 生成一张缩略图
+     * @param path 视频文件
+     * @param timeMs 时间 (毫秒) 取这个时间之前最近的关键帧
+     * @param bitmap ARGB_8888 尺寸就是缩略图的尺寸
+     * @return 是否成功
+     */
+    public boolean getThumbnail(String path, long timeMs, Bitmap bitmap) {
+        return getThumbnails(path, new long[] {timeMs}, new Bitmap[] {bitmap}) == 1;
+    }
+
+    /**
+     * 生成一批缩略图 (雪碧图)
+     * 按时间排序后分段并行生成 文件只探测一次 每段只打开一次文件
+     * @param path 视频文件
+     * @param timesMs 时间 (毫秒)
+     * @param bitmaps 和时间一一对应 ARGB_8888
+     * @return 成功的数量
+     */
+    public synchronized int getThumbnails(String path, long[] timesMs, Bitmap[] bitmaps) {
+        if (nativeHandle == 0) {
+            return 0;
+        }
+        return nativeGetThumbnails(nativeHandle, path, timesMs, bitmaps);
+    }
+
+    /**
+     * 释放 不再使用时调用
+     */
+    public synchronized void release() {
+        nativeRelease(nativeHandle);
+        nativeHandle = 0;
+    }
+
+    private native long nativeCreate(int threads, long cacheBytes, String streamInfoCacheDir);
+
+    private native int nativeGetThumbnails(long handle, String path, long[] timesMs, Bitmap[] bitmaps);
+
+    private native void nativeRelease(long handle);
+
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "audio_sink.h"
+#include "util.h"
+
+// 48kHz 双声道 每帧 4 字节 每个周期 (10ms) 1920 字节
+#define TEST_SAMPLE_RATE 48000
+#define TEST_CHANNELS 2
+#define TEST_BYTES_PER_MS (TEST_SAMPLE_RATE / 1000 * TEST_CHANNELS * 2)
+
+/**
+ * 打开写文件的空输出
+ * @param sink
+ * @param path
+ */
+static void null_sink_test_open(AudioSink* sink, char* path) {
+    snprintf(path, 256, "/tmp/player_audio_sink_test_%d.pcm", (int) getpid());
+    audio_sink_init(sink, AUDIO_SINK_NULL, NULL, NULL);
+    strncpy(sink->dump_path, path, sizeof(sink->dump_path) - 1);
+    EXPECT_EQ(SUCCESS_CODE, audio_sink_open(sink, TEST_SAMPLE_RATE, TEST_CHANNELS));
+    EXPECT_EQ(TEST_BYTES_PER_MS * AUDIO_SINK_PERIOD_MS, sink->period_bytes);
+}
+
+/**
+ * 写入一段毫秒数的 PCM 每个字节都是 value (不为 0 和静音区分)
+ * @param sink
+ * @param ms
+ * @param value
+ */
+static void write_pcm(AudioSink* sink, int ms, uint8_t value) {
+    int size = ms * TEST_BYTES_PER_MS;
+    uint8_t *data = (uint8_t*) malloc((size_t) size);
+    memset(data, value, (size_t) size);
+    audio_sink_write(sink, data, size);
+    free(data);
+}
+
+/**
+ * 读取输出文件 统计每种字节的个数
+ * @param path
+ * @param counts 256 个计数
+ * @return 文件大小
+ */
+static long read_dump(const char* path, long* counts) {
+    memset(counts, 0, 256 * sizeof(long));
+    FILE *file = fopen(path, "rb");
+    EXPECT_TRUE(file != NULL);
+    if (file == NULL) {
+        return 0;
+    }
+    long size = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        counts[c]++;
+        size++;
+    }
+    fclose(file);
+    unlink(path);
+    return size;
+}
+
+/**
+ * 写入的数据全部按顺序输出到文件 其余部分是静音
+ * 文件按整周期写入
+ */
+static void test_null_sink_dumps_all_data() {
+    AudioSink sink;
+    char path[256];
+    null_sink_test_open(&sink, path);
+    write_pcm(&sink, 100, 1);
+    write_pcm(&sink, 50, 2);
+    audio_sink_close(&sink);
+    long counts[256];
+    long size = read_dump(path, counts);
+    EXPECT_EQ(0, size % (TEST_BYTES_PER_MS * AUDIO_SINK_PERIOD_MS));
+    EXPECT_EQ(100 * TEST_BYTES_PER_MS, counts[1]);
+    EXPECT_EQ(50 * TEST_BYTES_PER_MS, counts[2]);
+    EXPECT_EQ(size, counts[0] + counts[1] + counts[2]);
+}
+
+/**
+ * flush 丢弃还没有播放的数据 之后写入的数据正常输出
+ */
+static void test_null_sink_flush() {
+    AudioSink sink;
+    char path[256];
+    null_sink_test_open(&sink, path);
+    write_pcm(&sink, 150, 1);
+    audio_sink_flush(&sink);
+    usleep(3 * AUDIO_SINK_PERIOD_MS * 1000);
+    write_pcm(&sink, 30, 2);
+    audio_sink_close(&sink);
+    long counts[256];
+    read_dump(path, counts);
+    // flush 之前最多播放了几个周期
+    EXPECT_LE(counts[1], 3 * TEST_BYTES_PER_MS * AUDIO_SINK_PERIOD_MS);
+    EXPECT_EQ(30 * TEST_BYTES_PER_MS, counts[2]);
+}
+
+/**
+ * 延迟等于还没有播放的数据时长 随输出消耗下降到 0
+ */
+static void test_null_sink_delay() {
+    AudioSink sink;
+    audio_sink_init(&sink, AUDIO_SINK_NULL, NULL, NULL);
+    EXPECT_TRUE(audio_sink_get_delay(&sink) == 0);
+    EXPECT_EQ(SUCCESS_CODE, audio_sink_open(&sink, TEST_SAMPLE_RATE, TEST_CHANNELS));
+    write_pcm(&sink, 100, 1);
+    double delay = audio_sink_get_delay(&sink);
+    EXPECT_TRUE(delay > 0.05 && delay <= 0.1);
+    usleep(60 * 1000);
+    double later = audio_sink_get_delay(&sink);
+    EXPECT_TRUE(later < delay);
+    usleep(100 * 1000);
+    EXPECT_TRUE(audio_sink_get_delay(&sink) <= AUDIO_SINK_PERIOD_MS / 1000.0);
+    // flush 之后已经写入的数据不再计入延迟
+    write_pcm(&sink, 100, 1);
+    audio_sink_flush(&sink);
+    usleep(3 * AUDIO_SINK_PERIOD_MS * 1000);
+    EXPECT_TRUE(audio_sink_get_delay(&sink) <= AUDIO_SINK_PERIOD_MS / 1000.0);
+    audio_sink_close(&sink);
+    EXPECT_TRUE(audio_sink_get_delay(&sink) == 0);
+}
+
+int main() {
+    RUN_TEST(test_null_sink_dumps_all_data);
+    RUN_TEST(test_null_sink_flush);
+    RUN_TEST(test_null_sink_delay);
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "color_convert.h"
+#include "util.h"
+
+extern "C" {
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+// 宽度不是 16 / 32 的倍数 覆盖 SIMD 之后的标量部分 高度为奇数覆盖最后一行色度
+#define TEST_WIDTH 118
+#define TEST_HEIGHT 35
+
+/**
+ * 分配测试帧 内容为固定种子的随机数
+ * @param format
+ * @param colorspace
+ * @param range
+ * @param seed
+ * @return
+ */
+static AVFrame* test_frame_alloc(int format, int colorspace, int range, unsigned int seed) {
+    AVFrame *frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = TEST_WIDTH;
+    frame->height = TEST_HEIGHT;
+    frame->colorspace = (AVColorSpace) colorspace;
+    frame->color_range = (AVColorRange) range;
+    av_frame_get_buffer(frame, 32);
+    srand(seed);
+    int planes = format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_NV21 ? 2 : 3;
+    for (int i = 0; i < planes; i++) {
+        int rows = i == 0 ? TEST_HEIGHT : (TEST_HEIGHT + 1) / 2;
+        for (int j = 0; j < rows * frame->linesize[i]; j++) {
+            frame->data[i][j] = (uint8_t) (rand() & 0xFF);
+        }
+    }
+    return frame;
+}
+
+/**
+ * 用指定的 CPU 特性转换一帧
+ * @param frame
+ * @param cpu_flags 传 0 只用标量转换
+ * @param simd 实际选中的 COLOR_SIMD_*
+ * @return RGBA 数据 调用方释放
+ */
+static uint8_t* convert_with_flags(AVFrame* frame, int cpu_flags, int* simd) {
+    av_force_cpu_flags(cpu_flags);
+    ColorConverter converter;
+    color_converter_init(&converter);
+    av_force_cpu_flags(-1);
+    uint8_t *rgba = (uint8_t*) malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    EXPECT_EQ(SUCCESS_CODE, color_convert(&converter, frame, rgba, TEST_WIDTH * 4, TEST_WIDTH, TEST_HEIGHT));
+    if (simd != NULL) {
+        *simd = converter.simd;
+    }
+    color_converter_destroy(&converter);
+    return rgba;
+}
+
+/**
+ * 用 swscale 转换一帧 按帧的颜色矩阵和范围设置
+ * @param frame
+ * @param colorspace SWS_CS_*
+ * @param full_range
+ * @return RGBA 数据 调用方释放
+ */
+static uint8_t* convert_with_swscale(AVFrame* frame, int colorspace, int full_range) {
+    struct SwsContext *context = sws_getContext(
+            frame->width, frame->height, (AVPixelFormat) frame->format,
+            frame->width, frame->height, AV_PIX_FMT_RGBA,
+            SWS_BICUBIC | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT, NULL, NULL, NULL);
+    sws_setColorspaceDetails(context, sws_getCoefficients(colorspace), full_range,
+                             sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16, 1 << 16);
+    uint8_t *rgba = (uint8_t*) malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    uint8_t *dst_data[4] = {rgba, NULL, NULL, NULL};
+    int dst_linesizes[4] = {TEST_WIDTH * 4, 0, 0, 0};
+    sws_scale(context, (const uint8_t* const*) frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesizes);
+    sws_freeContext(context);
+    return rgba;
+}
+
+/**
+ * 两个 RGBA 缓冲区的最大误差
+ * @param a
+ * @param b
+ * @return
+ */
+static int max_difference(const uint8_t* a, const uint8_t* b) {
+    int result = 0;
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT * 4; i++) {
+        result = FFMAX(result, abs(a[i] - b[i]));
+    }
+    return result;
+}
+
+/**
+ * 浮点计算一个像素 作为精度的参照
+ * @param y
+ * @param u
+ * @param v
+ * @param bt709
+ * @param full_range
+ * @param rgb 输出
+ */
+static void reference_pixel(int y, int u, int v, bool bt709, bool full_range, int* rgb) {
+    double kr = bt709 ? 0.2126 : 0.299;
+    double kb = bt709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double luma = full_range ? y : (y - 16) * 255.0 / 219.0;
+    double cb = (u - 128) * (full_range ? 1.0 : 255.0 / 224.0);
+    double cr = (v - 128) * (full_range ? 1.0 : 255.0 / 224.0);
+    double values[3] = {
+            luma + 2.0 * (1.0 - kr) * cr,
+            luma - 2.0 * kb * (1.0 - kb) / kg * cb - 2.0 * kr * (1.0 - kr) / kg * cr,
+            luma + 2.0 * (1.0 - kb) * cb
+    };
+    for (int i = 0; i < 3; i++) {
+        rgb[i] = (int) lrint(FFMAX(0.0, FFMIN(255.0, values[i])));
+    }
+}
+
+/**
+ * SIMD 的输出和标量逐字节一致
+ */
+static void test_simd_matches_scalar() {
+    const int formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_NV21};
+    const int colorspaces[] = {AVCOL_SPC_BT470BG, AVCOL_SPC_BT709};
+    const int ranges[] = {AVCOL_RANGE_MPEG, AVCOL_RANGE_JPEG};
+    for (int f = 0; f < 3; f++) {
+        for (int c = 0; c < 2; c++) {
+            for (int r = 0; r < 2; r++) {
+                AVFrame *frame = test_frame_alloc(formats[f], colorspaces[c], ranges[r], (unsigned int) (f * 4 + c * 2 + r));
+                int simd;
+                uint8_t *scalar = convert_with_flags(frame, 0, &simd);
+                EXPECT_EQ(COLOR_SIMD_NONE, simd);
+                uint8_t *native = convert_with_flags(frame, av_get_cpu_flags(), &simd);
+                EXPECT_EQ(0, memcmp(scalar, native, TEST_WIDTH * TEST_HEIGHT * 4));
+                if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+                    // 同时有 AVX2 时再单独检查 SSE2
+                    uint8_t *sse2 = convert_with_flags(frame, AV_CPU_FLAG_SSE2, &simd);
+                    EXPECT_EQ(COLOR_SIMD_SSE2, simd);
+                    EXPECT_EQ(0, memcmp(scalar, sse2, TEST_WIDTH * TEST_HEIGHT * 4));
+                    free(sse2);
+                }
+                free(scalar);
+                free(native);
+                av_frame_free(&frame);
+            }
+        }
+    }
+}
+
+/**
+ * 定点结果和浮点计算最多相差 1
+ * 覆盖所有亮度值 包括有限范围的上限 235
+ */
+static void test_matches_reference() {
+    for (int c = 0; c < 2; c++) {
+        for (int r = 0; r < 2; r++) {
+            bool bt709 = c == 1;
+            bool full_range = r == 1;
+            AVFrame *frame = test_frame_alloc(AV_PIX_FMT_YUV420P, bt709 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG,
+                                              full_range ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG, (unsigned int) (c * 2 + r));
+            uint8_t *rgba = convert_with_flags(frame, av_get_cpu_flags(), NULL);
+            int difference = 0;
+            for (int y = 0; y < TEST_HEIGHT; y++) {
+                for (int x = 0; x < TEST_WIDTH; x++) {
+                    int rgb[3];
+                    reference_pixel(frame->data[0][y * frame->linesize[0] + x],
+                                    frame->data[1][(y / 2) * frame->linesize[1] + x / 2],
+                                    frame->data[2][(y / 2) * frame->linesize[2] + x / 2],
+                                    bt709, full_range, rgb);
+                    for (int i = 0; i < 3; i++) {
+                        difference = FFMAX(difference, abs(rgb[i] - rgba[(y * TEST_WIDTH + x) * 4 + i]));
+                    }
+                }
+            }
+            EXPECT_LE(difference, 1);
+            // 有限范围的白色 (235, 128, 128) 输出 255
+            memset(frame->data[0], 235, (size_t) (frame->linesize[0] * TEST_HEIGHT));
+            memset(frame->data[1], 128, (size_t) (frame->linesize[1] * ((TEST_HEIGHT + 1) / 2)));
+            memset(frame->data[2], 128, (size_t) (frame->linesize[2] * ((TEST_HEIGHT + 1) / 2)));
+            free(rgba);
+            rgba = convert_with_flags(frame, av_get_cpu_flags(), NULL);
+            EXPECT_EQ(full_range ? 235 : 255, rgba[0]);
+            EXPECT_EQ(full_range ? 235 : 255, rgba[1]);
+            EXPECT_EQ(full_range ? 235 : 255, rgba[2]);
+            free(rgba);
+            av_frame_free(&frame);
+        }
+    }
+}
+
+/**
+ * 和 swscale 的结果接近
+ * 色度在整帧内相同 避免两者色度插值方式不同带来的差异
+ */
+static void test_matches_swscale() {
+    const int chroma_values[] = {16, 90, 128, 166, 240};
+    for (int c = 0; c < 2; c++) {
+        bool bt709 = c == 1;
+        for (int i = 0; i < 5; i++) {
+            for (int j = 0; j < 5; j++) {
+                AVFrame *frame = test_frame_alloc(AV_PIX_FMT_YUV420P, bt709 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG,
+                                                  AVCOL_RANGE_MPEG, (unsigned int) (i * 5 + j));
+                memset(frame->data[1], chroma_values[i], (size_t) (frame->linesize[1] * ((TEST_HEIGHT + 1) / 2)));
+                memset(frame->data[2], chroma_values[j], (size_t) (frame->linesize[2] * ((TEST_HEIGHT + 1) / 2)));
+                uint8_t *rgba = convert_with_flags(frame, av_get_cpu_flags(), NULL);
+                uint8_t *expected = convert_with_swscale(frame, bt709 ? SWS_CS_ITU709 : SWS_CS_ITU601, 0);
+                EXPECT_LE(max_difference(expected, rgba), 2);
+                free(rgba);
+                free(expected);
+                av_frame_free(&frame);
+            }
+        }
+    }
+}
+
+/**
+ * BT.2020 不走 SIMD 按 BT.2020 系数交给 swscale
+ */
+static void test_bt2020_uses_swscale() {
+    AVFrame *frame = test_frame_alloc(AV_PIX_FMT_YUV420P, AVCOL_SPC_BT2020_NCL, AVCOL_RANGE_MPEG, 7);
+    ColorConverter converter;
+    color_converter_init(&converter);
+    uint8_t *rgba = (uint8_t*) malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    EXPECT_EQ(SUCCESS_CODE, color_convert(&converter, frame, rgba, TEST_WIDTH * 4, TEST_WIDTH, TEST_HEIGHT));
+    EXPECT_TRUE(converter.sws_context != NULL);
+    EXPECT_EQ(AVCOL_SPC_BT2020_NCL, converter.sws_colorspace);
+    // 同一个帧按 BT.601 转换 结果应该不同
+    frame->colorspace = AVCOL_SPC_BT470BG;
+    uint8_t *bt601 = convert_with_flags(frame, av_get_cpu_flags(), NULL);
+    EXPECT_TRUE(max_difference(rgba, bt601) > 2);
+    free(bt601);
+    free(rgba);
+    color_converter_destroy(&converter);
+    av_frame_free(&frame);
+}
+
+int main() {
+    RUN_TEST(test_simd_matches_scalar);
+    RUN_TEST(test_matches_reference);
+    RUN_TEST(test_matches_swscale);
+    RUN_TEST(test_bt2020_uses_swscale);
+    return test_failures == 0 ? 0 : 1;
+}
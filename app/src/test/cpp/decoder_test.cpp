@@ -0,0 +1,224 @@
+#include <string.h>
+#include "test.h"
+#include "decoder.h"
+#include "queue.h"
+#include "packet_pool.h"
+#include "util.h"
+#include "fake_hardware_backend.h"
+
+// 测试用的流 很小的 YUV420P 原始视频 软件解码器 (rawvideo) 每个数据解出一帧
+#define TEST_WIDTH 16
+#define TEST_HEIGHT 16
+#define TEST_PACKETS 10
+// 每 4 个数据一个关键帧 (0, 4, 8)
+#define TEST_KEYFRAME_INTERVAL 4
+
+// 测试环境
+typedef struct _DecoderTest {
+    AVCodecParameters* codecpar;
+    PacketPool pool;
+    Queue queue;
+    Decoder decoder;
+    FakeHardwareDecoder fake;
+} DecoderTest;
+
+/**
+ * 准备流参数 队列和模拟的硬件解码器 队列中放入所有数据并结束
+ * @param test
+ */
+static void decoder_test_init(DecoderTest* test) {
+    av_register_all();
+    test->codecpar = avcodec_parameters_alloc();
+    test->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    test->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
+    test->codecpar->format = AV_PIX_FMT_YUV420P;
+    test->codecpar->width = TEST_WIDTH;
+    test->codecpar->height = TEST_HEIGHT;
+    packet_pool_init(&(test->pool));
+    queue_init(&(test->queue));
+    queue_set_pool(&(test->queue), &(test->pool));
+    for (int i = 0; i < TEST_PACKETS; i++) {
+        AVPacket *packet = packet_pool_get(&(test->pool));
+        av_new_packet(packet, TEST_WIDTH * TEST_HEIGHT * 3 / 2);
+        memset(packet->data, i, (size_t) packet->size);
+        packet->pts = i;
+        packet->dts = i;
+        packet->duration = 1;
+        packet->flags = i % TEST_KEYFRAME_INTERVAL == 0 ? AV_PKT_FLAG_KEY : 0;
+        queue_in(&(test->queue), packet);
+    }
+    break_block(&(test->queue));
+    fake_hardware_decoder_init(&(test->fake));
+    decoder_set_hardware_backend(&(test->fake.backend));
+}
+
+/**
+ * 打开解码器
+ * @param test
+ * @return
+ */
+static int decoder_test_open(DecoderTest* test) {
+    int result = decoder_open(&(test->decoder), test->codecpar, NULL, true, NULL);
+    test->decoder.queue = &(test->queue);
+    return result;
+}
+
+/**
+ * 解码到结束 记录每一帧的时间戳
+ * @param test
+ * @param timestamps
+ * @return 帧数
+ */
+static int decoder_test_decode_all(DecoderTest* test, int64_t* timestamps) {
+    AVFrame *frame = av_frame_alloc();
+    int count = 0;
+    while (count < TEST_PACKETS && decoder_decode_frame(&(test->decoder), frame) > 0) {
+        timestamps[count++] = frame->best_effort_timestamp;
+        av_frame_unref(frame);
+    }
+    av_frame_free(&frame);
+    return count;
+}
+
+/**
+ * 销毁测试环境
+ * @param test
+ */
+static void decoder_test_destroy(DecoderTest* test) {
+    decoder_destroy(&(test->decoder));
+    queue_destroy(&(test->queue));
+    packet_pool_destroy(&(test->pool));
+    avcodec_parameters_free(&(test->codecpar));
+    decoder_set_hardware_backend(NULL);
+}
+
+/**
+ * 硬件解码器打开失败 直接使用软件解码 所有帧都能解出
+ */
+static void test_open_failure_uses_software() {
+    DecoderTest test;
+    decoder_test_init(&test);
+    test.fake.fail_open = true;
+    test.fake.latency = 2000;
+    EXPECT_EQ(SUCCESS_CODE, decoder_test_open(&test));
+    EXPECT_TRUE(!test.decoder.is_hardware);
+    int64_t timestamps[TEST_PACKETS];
+    int count = decoder_test_decode_all(&test, timestamps);
+    EXPECT_EQ(TEST_PACKETS, count);
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(i, timestamps[i]);
+    }
+    EXPECT_EQ(0, test.fake.packets_sent);
+    decoder_test_destroy(&test);
+}
+
+/**
+ * 硬件解码正常时 所有帧由硬件解码器输出
+ */
+static void test_hardware_decode() {
+    DecoderTest test;
+    decoder_test_init(&test);
+    test.fake.latency = 500;
+    EXPECT_EQ(SUCCESS_CODE, decoder_test_open(&test));
+    EXPECT_TRUE(test.decoder.is_hardware);
+    int64_t timestamps[TEST_PACKETS];
+    EXPECT_EQ(TEST_PACKETS, decoder_test_decode_all(&test, timestamps));
+    EXPECT_EQ(TEST_PACKETS, test.fake.packets_sent);
+    EXPECT_TRUE(test.decoder.is_hardware);
+    decoder_test_destroy(&test);
+    EXPECT_EQ(1, test.fake.close_count);
+}
+
+/**
+ * 连续出错没有达到上限 继续使用硬件解码 出错的数据丢掉
+ */
+static void test_transient_errors_keep_hardware() {
+    DecoderTest test;
+    decoder_test_init(&test);
+    test.fake.fail_from_packet = 3;
+    test.fake.fail_count = DECODER_MAX_HARDWARE_ERRORS - 1;
+    EXPECT_EQ(SUCCESS_CODE, decoder_test_open(&test));
+    int64_t timestamps[TEST_PACKETS];
+    int count = decoder_test_decode_all(&test, timestamps);
+    EXPECT_EQ(TEST_PACKETS - test.fake.fail_count, count);
+    EXPECT_TRUE(test.decoder.is_hardware);
+    EXPECT_EQ(0, test.fake.close_count);
+    // 出错的是 3 和 4
+    int64_t expected[] = {0, 1, 2, 5, 6, 7, 8, 9};
+    for (int i = 0; i < count && i < 8; i++) {
+        EXPECT_EQ(expected[i], timestamps[i]);
+    }
+    decoder_test_destroy(&test);
+}
+
+/**
+ * 连续出错达到上限 回退到软件解码 从下一个关键帧继续
+ */
+static void test_persistent_errors_fall_back() {
+    DecoderTest test;
+    decoder_test_init(&test);
+    test.fake.fail_from_packet = 3;
+    test.fake.fail_count = TEST_PACKETS;
+    test.fake.latency = 1000;
+    EXPECT_EQ(SUCCESS_CODE, decoder_test_open(&test));
+    int64_t timestamps[TEST_PACKETS];
+    int count = decoder_test_decode_all(&test, timestamps);
+    // 0 1 2 硬件解出 3 4 5 出错后回退 6 7 不是关键帧被跳过 8 9 软件解出
+    int64_t expected[] = {0, 1, 2, 8, 9};
+    EXPECT_EQ(5, count);
+    for (int i = 0; i < count && i < 5; i++) {
+        EXPECT_EQ(expected[i], timestamps[i]);
+    }
+    EXPECT_EQ(DECODER_MAX_HARDWARE_ERRORS, test.fake.errors);
+    EXPECT_EQ(1, test.fake.close_count);
+    EXPECT_TRUE(!test.decoder.is_hardware);
+    EXPECT_TRUE(!test.decoder.wait_keyframe);
+    decoder_test_destroy(&test);
+    // 已经关闭的硬件解码器不会再关闭一次
+    EXPECT_EQ(1, test.fake.close_count);
+}
+
+/**
+ * 记录通知次数
+ * @param arg
+ */
+static void count_notify(void* arg) {
+    (*(int*) arg)++;
+}
+
+/**
+ * 不阻塞解码 队列为空时返回 EAGAIN 打断后通知消费者 再解码返回结束
+ */
+static void test_poll_frame() {
+    DecoderTest test;
+    decoder_test_init(&test);
+    test.fake.fail_open = true;
+    // 恢复阻塞 队列中的数据取完后还没有结束
+    EXPECT_TRUE(queue_resume(&(test.queue)));
+    EXPECT_EQ(SUCCESS_CODE, decoder_test_open(&test));
+    AVFrame *frame = av_frame_alloc();
+    for (int i = 0; i < TEST_PACKETS; i++) {
+        EXPECT_EQ(1, decoder_poll_frame(&(test.decoder), frame));
+        EXPECT_EQ(i, frame->best_effort_timestamp);
+        av_frame_unref(frame);
+    }
+    EXPECT_EQ(AVERROR(EAGAIN), decoder_poll_frame(&(test.decoder), frame));
+    int notify_count = 0;
+    queue_set_consumer_notify(&(test.queue), count_notify, &notify_count);
+    break_block(&(test.queue));
+    EXPECT_EQ(1, notify_count);
+    EXPECT_EQ(0, decoder_poll_frame(&(test.decoder), frame));
+    // 消费者已经结束 不能再恢复
+    EXPECT_TRUE(!queue_resume(&(test.queue)));
+    av_frame_free(&frame);
+    decoder_test_destroy(&test);
+}
+
+int main() {
+    RUN_TEST(test_open_failure_uses_software);
+    RUN_TEST(test_hardware_decode);
+    RUN_TEST(test_transient_errors_keep_hardware);
+    RUN_TEST(test_persistent_errors_fall_back);
+    RUN_TEST(test_poll_frame);
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include <string.h>
+#include <unistd.h>
+#include "fake_hardware_backend.h"
+
+static AVCodecContext* fake_open(void* opaque, AVCodecParameters* codecpar, void* surface) {
+    FakeHardwareDecoder *fake = (FakeHardwareDecoder*) opaque;
+    if (fake->latency > 0) {
+        usleep((useconds_t) fake->latency);
+    }
+    if (fake->fail_open) {
+        return NULL;
+    }
+    fake->open_count += 1;
+    fake->pending_count = 0;
+    fake->is_draining = false;
+    // 只用来占位 不会打开 所有调用都由后端处理
+    return avcodec_alloc_context3(NULL);
+}
+
+static int fake_send_packet(void* opaque, AVCodecContext* codec_context, const AVPacket* packet) {
+    FakeHardwareDecoder *fake = (FakeHardwareDecoder*) opaque;
+    if (fake->latency > 0) {
+        usleep((useconds_t) fake->latency);
+    }
+    if (packet == NULL) {
+        fake->is_draining = true;
+        return 0;
+    }
+    int index = fake->packets_sent++;
+    if (fake->fail_from_packet >= 0 && index >= fake->fail_from_packet && index < fake->fail_from_packet + fake->fail_count) {
+        fake->errors += 1;
+        return AVERROR(EIO);
+    }
+    if (fake->pending_count == FAKE_HARDWARE_MAX_PENDING) {
+        return AVERROR(EAGAIN);
+    }
+    fake->pending[fake->pending_count++] = packet->pts;
+    return 0;
+}
+
+static int fake_receive_frame(void* opaque, AVCodecContext* codec_context, AVFrame* frame) {
+    FakeHardwareDecoder *fake = (FakeHardwareDecoder*) opaque;
+    if (fake->pending_count == 0) {
+        return fake->is_draining ? AVERROR_EOF : AVERROR(EAGAIN);
+    }
+    frame->pts = fake->pending[0];
+    frame->best_effort_timestamp = fake->pending[0];
+    fake->pending_count -= 1;
+    memmove(fake->pending, fake->pending + 1, sizeof(int64_t) * fake->pending_count);
+    return 0;
+}
+
+static void fake_flush(void* opaque, AVCodecContext* codec_context) {
+    FakeHardwareDecoder *fake = (FakeHardwareDecoder*) opaque;
+    fake->pending_count = 0;
+    fake->is_draining = false;
+}
+
+static void fake_close(void* opaque, AVCodecContext** codec_context) {
+    FakeHardwareDecoder *fake = (FakeHardwareDecoder*) opaque;
+    fake->close_count += 1;
+    avcodec_free_context(codec_context);
+}
+
+/**
+ * 初始化模拟的硬件解码器
+ * @param fake
+ */
+void fake_hardware_decoder_init(FakeHardwareDecoder* fake) {
+    memset(fake, 0, sizeof(FakeHardwareDecoder));
+    fake->backend.opaque = fake;
+    fake->backend.open = fake_open;
+    fake->backend.send_packet = fake_send_packet;
+    fake->backend.receive_frame = fake_receive_frame;
+    fake->backend.flush = fake_flush;
+    fake->backend.close = fake_close;
+    fake->fail_from_packet = -1;
+}
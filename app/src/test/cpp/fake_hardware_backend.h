@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include "decoder.h"
+
+#ifndef PLAYER_FAKE_HARDWARE_BACKEND_H
+#define PLAYER_FAKE_HARDWARE_BACKEND_H
+
+// 模拟解码器最多缓存的帧数
+#define FAKE_HARDWARE_MAX_PENDING 16
+
+// 模拟的硬件解码器
+// 代替 MediaCodec 在 Linux 上测试回退逻辑 可以模拟打开失败 送入数据出错和延迟
+// 每送入一个数据输出一帧 帧只有时间戳 没有图像数据
+typedef struct _FakeHardwareDecoder {
+    HardwareBackend backend;
+    // 打开失败
+    bool fail_open;
+    // 从第几个数据开始出错 (从 0 开始数) -1 表示不出错
+    int fail_from_packet;
+    // 连续出错的数据数
+    int fail_count;
+    // 打开和每次送入数据的延迟 (微秒)
+    int latency;
+    // 统计
+    int open_count;
+    int close_count;
+    int packets_sent;
+    int errors;
+    // 等待取出的帧的时间戳
+    int64_t pending[FAKE_HARDWARE_MAX_PENDING];
+    int pending_count;
+    bool is_draining;
+} FakeHardwareDecoder;
+
+/**
+ * 初始化模拟的硬件解码器 默认不出错 没有延迟
+ * 之后用 decoder_set_hardware_backend(&(fake->backend)) 启用
+ * @param fake
+ */
+void fake_hardware_decoder_init(FakeHardwareDecoder* fake);
+
+#endif //PLAYER_FAKE_HARDWARE_BACKEND_H
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "keyframe_index.h"
+#include "util.h"
+
+// 每 2 秒一个关键帧 时间基为微秒 位置按时间递增
+#define TEST_GOP (2 * AV_TIME_BASE)
+#define TEST_MINUTE (60LL * AV_TIME_BASE)
+
+// 测试环境
+typedef struct _KeyframeIndexTest {
+    char path[256];
+    KeyframeIndex index;
+    AVStream stream;
+    // 模拟的播放读取位置
+    int64_t previous_pts;
+} KeyframeIndexTest;
+
+/**
+ * 创建一个空的视频文件 不保存索引文件
+ * @param test
+ */
+static void keyframe_index_test_init(KeyframeIndexTest* test) {
+    snprintf(test->path, sizeof(test->path), "/tmp/player_keyframe_index_test_%d.ts", (int) getpid());
+    FILE *file = fopen(test->path, "wb");
+    EXPECT_TRUE(file != NULL);
+    if (file != NULL) {
+        fclose(file);
+    }
+    EXPECT_EQ(SUCCESS_CODE, keyframe_index_init(&(test->index), test->path, "/tmp"));
+    memset(&(test->stream), 0, sizeof(AVStream));
+    test->stream.time_base = AV_TIME_BASE_Q;
+    test->previous_pts = AV_NOPTS_VALUE;
+}
+
+/**
+ * 顺序播放 [start, end) 记录经过的关键帧
+ * @param test
+ * @param start
+ * @param end
+ */
+static void play(KeyframeIndexTest* test, int64_t start, int64_t end) {
+    AVPacket packet;
+    memset(&packet, 0, sizeof(AVPacket));
+    for (int64_t pts = (start + TEST_GOP - 1) / TEST_GOP * TEST_GOP; pts < end; pts += TEST_GOP) {
+        packet.pts = pts;
+        packet.dts = pts;
+        packet.pos = pts / 1000;
+        packet.size = 1000;
+        packet.flags = AV_PKT_FLAG_KEY;
+        keyframe_index_add_packet(&(test->index), &packet, &(test->stream), &(test->previous_pts));
+    }
+}
+
+/**
+ * 快进/快退 之后的记录和之前的不连续
+ * @param test
+ */
+static void seek(KeyframeIndexTest* test) {
+    test->previous_pts = AV_NOPTS_VALUE;
+}
+
+/**
+ * 清理 不保存索引文件
+ * @param test
+ */
+static void keyframe_index_test_destroy(KeyframeIndexTest* test) {
+    test->index.dirty = false;
+    keyframe_index_destroy(&(test->index));
+    unlink(test->path);
+}
+
+/**
+ * 连续播放过的范围内可以找到 target 之前最近的关键帧
+ */
+static void test_lookup_inside_played_range() {
+    KeyframeIndexTest test;
+    keyframe_index_test_init(&test);
+    play(&test, 0, 10 * TEST_MINUTE);
+    KeyframeEntry entry;
+    EXPECT_TRUE(keyframe_index_lookup(&(test.index), 5 * TEST_MINUTE + 1, &entry));
+    EXPECT_EQ(5 * TEST_MINUTE, entry.pts);
+    // 最后一个记录之后可能还有没读到的关键帧
+    EXPECT_TRUE(!keyframe_index_lookup(&(test.index), 10 * TEST_MINUTE + 30 * AV_TIME_BASE, &entry));
+    keyframe_index_test_destroy(&test);
+}
+
+/**
+ * 播放 0 - 10 分钟 跳到 60 分钟 再跳到 30 分钟
+ * 10 分钟的记录和 60 分钟的记录之间没有读过 不能返回 10 分钟的关键帧
+ */
+static void test_lookup_rejects_gap_after_seek() {
+    KeyframeIndexTest test;
+    keyframe_index_test_init(&test);
+    play(&test, 0, 10 * TEST_MINUTE);
+    seek(&test);
+    play(&test, 60 * TEST_MINUTE, 61 * TEST_MINUTE);
+    KeyframeEntry entry;
+    EXPECT_TRUE(!keyframe_index_lookup(&(test.index), 30 * TEST_MINUTE, &entry));
+    EXPECT_TRUE(keyframe_index_lookup(&(test.index), 60 * TEST_MINUTE + 3 * AV_TIME_BASE, &entry));
+    EXPECT_EQ(60 * TEST_MINUTE + TEST_GOP, entry.pts);
+    keyframe_index_test_destroy(&test);
+}
+
+/**
+ * 之后从 30 分钟一直播放到 60 分钟 两段记录连起来 中间的范围也可以找到
+ */
+static void test_lookup_after_gap_is_filled() {
+    KeyframeIndexTest test;
+    keyframe_index_test_init(&test);
+    play(&test, 0, 10 * TEST_MINUTE);
+    seek(&test);
+    play(&test, 60 * TEST_MINUTE, 61 * TEST_MINUTE);
+    seek(&test);
+    play(&test, 30 * TEST_MINUTE, 60 * TEST_MINUTE + 1);
+    KeyframeEntry entry;
+    EXPECT_TRUE(keyframe_index_lookup(&(test.index), 59 * TEST_MINUTE + 59 * AV_TIME_BASE, &entry));
+    EXPECT_EQ(59 * TEST_MINUTE + 58 * AV_TIME_BASE, entry.pts);
+    // 10 - 30 分钟仍然没有读过
+    EXPECT_TRUE(!keyframe_index_lookup(&(test.index), 20 * TEST_MINUTE, &entry));
+    keyframe_index_test_destroy(&test);
+}
+
+/**
+ * 完整的索引不检查连续
+ */
+static void test_lookup_complete_index() {
+    KeyframeIndexTest test;
+    keyframe_index_test_init(&test);
+    play(&test, 0, 10 * TEST_MINUTE);
+    test.index.complete = true;
+    KeyframeEntry entry;
+    EXPECT_TRUE(keyframe_index_lookup(&(test.index), 20 * TEST_MINUTE, &entry));
+    EXPECT_EQ(10 * TEST_MINUTE - TEST_GOP, entry.pts);
+    keyframe_index_test_destroy(&test);
+}
+
+int main() {
+    RUN_TEST(test_lookup_inside_played_range);
+    RUN_TEST(test_lookup_rejects_gap_after_seek);
+    RUN_TEST(test_lookup_after_gap_is_filled);
+    RUN_TEST(test_lookup_complete_index);
+    return test_failures == 0 ? 0 : 1;
+}
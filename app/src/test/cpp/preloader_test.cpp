@@ -0,0 +1,153 @@
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include "test.h"
+#include "preloader.h"
+#include "util.h"
+
+// 测试用的会话
+typedef struct _TestSession {
+    // 加载时一直缓冲 直到被取消
+    bool block;
+    // 打开失败
+    bool fail;
+    std::atomic<bool> loading;
+    std::atomic<bool> loaded;
+    // 加载所在的线程
+    pthread_t thread_id;
+} TestSession;
+
+// 释放的会话数
+static std::atomic<int> released_count;
+
+/**
+ * 模拟打开和缓冲
+ */
+static int test_load(void* session, const char* path, std::atomic<bool>* cancel) {
+    TestSession *test_session = (TestSession*) session;
+    test_session->thread_id = pthread_self();
+    test_session->loading.store(true);
+    while (test_session->block && !cancel->load()) {
+        usleep(1000);
+    }
+    test_session->loaded.store(true);
+    return test_session->fail ? FAIL_CODE : SUCCESS_CODE;
+}
+
+/**
+ * 释放会话
+ */
+static void test_release(void* session) {
+    released_count.fetch_add(1);
+    delete (TestSession*) session;
+}
+
+/**
+ * 创建会话
+ * @param block
+ * @param fail
+ * @return
+ */
+static TestSession* test_session_create(bool block, bool fail) {
+    TestSession *session = new TestSession();
+    session->block = block;
+    session->fail = fail;
+    session->loading.store(false);
+    session->loaded.store(false);
+    return session;
+}
+
+/**
+ * 等待会话开始加载
+ * @param session
+ */
+static void wait_loading(TestSession* session) {
+    while (!session->loading.load()) {
+        usleep(1000);
+    }
+}
+
+/**
+ * 加载在预加载器自己的线程中执行 取出正在加载的会话时停止缓冲并交给调用者
+ */
+static void test_take_while_loading() {
+    released_count.store(0);
+    Preloader preloader;
+    preloader_init(&preloader, 4, test_load, test_release);
+    TestSession *session = test_session_create(true, false);
+    preloader_add(&preloader, "a", session);
+    wait_loading(session);
+    EXPECT_TRUE(!pthread_equal(session->thread_id, pthread_self()));
+    EXPECT_TRUE(preloader_take(&preloader, "a") == session);
+    EXPECT_TRUE(session->loaded.load());
+    EXPECT_TRUE(preloader_take(&preloader, "a") == NULL);
+    preloader_destroy(&preloader);
+    EXPECT_EQ(0, released_count.load());
+    delete session;
+}
+
+/**
+ * 加载线程被占用时 还没开始加载的会话直接释放 调用者冷启动
+ */
+static void test_take_queued() {
+    released_count.store(0);
+    Preloader preloader;
+    preloader_init(&preloader, 4, test_load, test_release);
+    TestSession *blocking = test_session_create(true, false);
+    preloader_add(&preloader, "a", blocking);
+    wait_loading(blocking);
+    TestSession *queued = test_session_create(false, false);
+    preloader_add(&preloader, "b", queued);
+    EXPECT_TRUE(preloader_take(&preloader, "b") == NULL);
+    EXPECT_EQ(1, released_count.load());
+    preloader_destroy(&preloader);
+    EXPECT_EQ(2, released_count.load());
+}
+
+/**
+ * 加载失败的会话不交给调用者
+ */
+static void test_take_failed() {
+    released_count.store(0);
+    Preloader preloader;
+    preloader_init(&preloader, 4, test_load, test_release);
+    TestSession *session = test_session_create(false, true);
+    preloader_add(&preloader, "a", session);
+    while (!session->loaded.load()) {
+        usleep(1000);
+    }
+    EXPECT_TRUE(preloader_take(&preloader, "a") == NULL);
+    EXPECT_EQ(1, released_count.load());
+    preloader_destroy(&preloader);
+    EXPECT_EQ(1, released_count.load());
+}
+
+/**
+ * 超过容量淘汰正在加载的项 加载线程停止缓冲后释放
+ */
+static void test_evict_loading() {
+    released_count.store(0);
+    Preloader preloader;
+    preloader_init(&preloader, 1, test_load, test_release);
+    TestSession *loading = test_session_create(true, false);
+    preloader_add(&preloader, "a", loading);
+    wait_loading(loading);
+    TestSession *next = test_session_create(false, false);
+    preloader_add(&preloader, "b", next);
+    while (!next->loaded.load()) {
+        usleep(1000);
+    }
+    EXPECT_EQ(1, released_count.load());
+    EXPECT_TRUE(preloader_take(&preloader, "b") == next);
+    preloader_destroy(&preloader);
+    EXPECT_EQ(1, released_count.load());
+    delete next;
+}
+
+int main() {
+    RUN_TEST(test_take_while_loading);
+    RUN_TEST(test_take_queued);
+    RUN_TEST(test_take_failed);
+    RUN_TEST(test_evict_loading);
+    return test_failures == 0 ? 0 : 1;
+}
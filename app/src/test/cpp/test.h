@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+#ifndef PLAYER_TEST_H
+#define PLAYER_TEST_H
+
+// 宿主机 (Linux) 单元测试的断言
+// 失败时打印位置并记录 main 返回失败数 由 ctest 判断结果
+
+// 失败的断言数
+static int test_failures = 0;
+
+#define EXPECT_TRUE(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stderr, "%s:%d: expect %s\n", __FILE__, __LINE__, #CONDITION); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define EXPECT_EQ(EXPECTED, ACTUAL) \
+    do { \
+        long long expected_value = (long long) (EXPECTED); \
+        long long actual_value = (long long) (ACTUAL); \
+        if (expected_value != actual_value) { \
+            fprintf(stderr, "%s:%d: expect %s == %s (%lld != %lld)\n", \
+                    __FILE__, __LINE__, #EXPECTED, #ACTUAL, expected_value, actual_value); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define EXPECT_LE(ACTUAL, LIMIT) \
+    do { \
+        long long actual_value = (long long) (ACTUAL); \
+        long long limit_value = (long long) (LIMIT); \
+        if (actual_value > limit_value) { \
+            fprintf(stderr, "%s:%d: expect %s <= %s (%lld > %lld)\n", \
+                    __FILE__, __LINE__, #ACTUAL, #LIMIT, actual_value, limit_value); \
+            test_failures++; \
+        } \
+    } while (0)
+
+// 运行一个测试函数
+#define RUN_TEST(FUNCTION) \
+    do { \
+        int failures_before = test_failures; \
+        FUNCTION(); \
+        fprintf(stderr, "%s %s\n", test_failures == failures_before ? "[ OK ]" : "[FAIL]", #FUNCTION); \
+    } while (0)
+
+#endif //PLAYER_TEST_H
@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include "test.h"
+#include "thread_pool.h"
+
+// 占住工作线程的任务 直到 release 为 true
+typedef struct _BlockingTask {
+    std::atomic<bool> started;
+    std::atomic<bool> release;
+} BlockingTask;
+
+/**
+ * 一直占用工作线程 模拟阻塞 I/O 的后台任务
+ * @param arg
+ */
+static void blocking_task(void* arg) {
+    BlockingTask *task = (BlockingTask*) arg;
+    task->started.store(true);
+    while (!task->release.load()) {
+        usleep(1000);
+    }
+}
+
+/**
+ * 计数任务
+ * @param arg
+ */
+static void count_task(void* arg) {
+    ((std::atomic<int>*) arg)->fetch_add(1);
+}
+
+/**
+ * 工作线程全部被后台任务占用时 等待任务组的线程自己执行本组的任务
+ */
+static void test_group_wait_runs_own_tasks() {
+    ThreadPool pool;
+    thread_pool_init(&pool, 1);
+    BlockingTask blocking;
+    blocking.started.store(false);
+    blocking.release.store(false);
+    thread_pool_submit(&pool, blocking_task, &blocking, NULL, THREAD_POOL_PRIORITY_LOW);
+    while (!blocking.started.load()) {
+        usleep(1000);
+    }
+    TaskGroup group;
+    task_group_init(&group);
+    std::atomic<int> count;
+    count.store(0);
+    for (int i = 0; i < 8; i++) {
+        thread_pool_submit(&pool, count_task, &count, &group, THREAD_POOL_PRIORITY_HIGH);
+    }
+    task_group_wait(&group);
+    EXPECT_EQ(8, count.load());
+    EXPECT_TRUE(!blocking.release.load());
+    task_group_destroy(&group);
+    blocking.release.store(true);
+    thread_pool_destroy(&pool);
+}
+
+/**
+ * 其他组的任务留在队列中 由工作线程执行
+ */
+static void test_group_wait_leaves_other_groups() {
+    ThreadPool pool;
+    thread_pool_init(&pool, 1);
+    BlockingTask blocking;
+    blocking.started.store(false);
+    blocking.release.store(false);
+    thread_pool_submit(&pool, blocking_task, &blocking, NULL, THREAD_POOL_PRIORITY_LOW);
+    while (!blocking.started.load()) {
+        usleep(1000);
+    }
+    TaskGroup group;
+    TaskGroup other_group;
+    task_group_init(&group);
+    task_group_init(&other_group);
+    std::atomic<int> count;
+    std::atomic<int> other_count;
+    count.store(0);
+    other_count.store(0);
+    for (int i = 0; i < 4; i++) {
+        thread_pool_submit(&pool, count_task, &other_count, &other_group, THREAD_POOL_PRIORITY_NORMAL);
+        thread_pool_submit(&pool, count_task, &count, &group, THREAD_POOL_PRIORITY_HIGH);
+    }
+    task_group_wait(&group);
+    EXPECT_EQ(4, count.load());
+    EXPECT_EQ(0, other_count.load());
+    blocking.release.store(true);
+    task_group_wait(&other_group);
+    EXPECT_EQ(4, other_count.load());
+    task_group_destroy(&group);
+    task_group_destroy(&other_group);
+    thread_pool_destroy(&pool);
+}
+
+// 循环任务测试 生产者线程放入数据 循环任务每步最多取 2 个
+typedef struct _LoopTest {
+    TaskLoop loop;
+    std::atomic<int> produced;
+    std::atomic<bool> finished;
+    int consumed;
+    // 同时在执行的步数 不能超过 1
+    std::atomic<int> running;
+    int max_running;
+} LoopTest;
+
+/**
+ * 循环任务的一步
+ * @param arg
+ * @return
+ */
+static int loop_test_step(void* arg) {
+    LoopTest *test = (LoopTest*) arg;
+    int running = test->running.fetch_add(1) + 1;
+    test->max_running = running > test->max_running ? running : test->max_running;
+    int result = TASK_LOOP_CONTINUE;
+    for (int i = 0; i < 2; i++) {
+        if (test->consumed < test->produced.load()) {
+            test->consumed++;
+            continue;
+        }
+        result = test->finished.load() && test->consumed == test->produced.load() ? TASK_LOOP_FINISH : TASK_LOOP_IDLE;
+        break;
+    }
+    test->running.fetch_sub(1);
+    return result;
+}
+
+/**
+ * 生产者每次放入数据后唤醒 循环任务最终取完所有数据并结束 不会同时执行两步
+ */
+static void test_task_loop() {
+    ThreadPool pool;
+    thread_pool_init(&pool, 4);
+    LoopTest test;
+    test.produced.store(0);
+    test.finished.store(false);
+    test.consumed = 0;
+    test.running.store(0);
+    test.max_running = 0;
+    task_loop_init(&(test.loop), &pool, loop_test_step, &test, THREAD_POOL_PRIORITY_NORMAL);
+    task_loop_wake(&(test.loop));
+    for (int i = 0; i < 10000; i++) {
+        test.produced.fetch_add(1);
+        task_loop_wake(&(test.loop));
+        if (i % 1000 == 0) {
+            usleep(1000);
+        }
+    }
+    test.finished.store(true);
+    task_loop_wake(&(test.loop));
+    task_loop_wait(&(test.loop));
+    task_loop_destroy(&(test.loop));
+    EXPECT_EQ(10000, test.consumed);
+    EXPECT_EQ(1, test.max_running);
+    thread_pool_destroy(&pool);
+}
+
+int main() {
+    RUN_TEST(test_group_wait_runs_own_tasks);
+    RUN_TEST(test_group_wait_leaves_other_groups);
+    RUN_TEST(test_task_loop);
+    return test_failures == 0 ? 0 : 1;
+}